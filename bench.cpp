@@ -0,0 +1,498 @@
+// Throughput benchmarks over synthetic graphs from generate.h.
+//
+//   ./bench [--min-scale 3] [--max-scale 5] [--repetitions 3] [--out bench.json]
+//
+// Inputs have 10^s vertices for every scale s in [min-scale, max-scale],
+// which may go up to 9, and about four edges per vertex. Every case is
+// timed repetitions times and keeps its fastest run. Results go to
+// stdout as a table and to the --out file as a JSON array, one object
+// per case.
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "graphs.h"
+#include "stats.h"
+#include "writer.h"
+#include "csr.h"
+#include "compressed.h"
+#include "snapshot.h"
+#include "index.h"
+#include "dg.h"
+#include "topo.h"
+#include "reach.h"
+#include "dag.h"
+#include "tree.h"
+#include "concurrent.h"
+#include "pool.h"
+#include "traverse.h"
+#include "scc.h"
+#include "intersect.h"
+#include "executor.h"
+#include "paths.h"
+#include "overlay.h"
+#include "sharded.h"
+#include "generate.h"
+#include "edgelist.h"
+
+using std::cout;
+using std::make_pair;
+
+// One input: its edges and a Vertex for every ID they use.
+struct Input {
+  string name;
+  vector<Vertex> vertices;
+  vector<EdgeSpec> edges;
+};
+
+struct Result {
+  string name;
+  string input;
+  size_t vertices;
+  size_t edges;
+  size_t ops;
+  double seconds;
+};
+
+class Bench {
+ public:
+  explicit Bench(int repetitions) : repetitions_(std::max(repetitions, 1)) {}
+
+  // Times body(state) on a fresh state from setup() per repetition;
+  // neither setup() nor the state's destruction is timed.
+  template<typename Setup, typename Body>
+  void run(const string& name, const Input& input, size_t ops, Setup setup, Body body) {
+    double best = 0;
+    for (int r = 0; r < repetitions_; r++) {
+      auto state = setup();
+      auto start = std::chrono::steady_clock::now();
+      body(state);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      best = r == 0 ? seconds : std::min(best, seconds);
+    }
+    results_.push_back(Result{name, input.name, input.vertices.size(), input.edges.size(), ops, best});
+    const Result& result = results_.back();
+    cout << "  " << result.name << string(std::max<int>(28 - result.name.size(), 1), ' ')
+	 << ops_per_second_(result) / 1e6 << " M/s (" << result.seconds * 1e3 << " ms)\n";
+  }
+
+  // As above, for a body that needs no fresh state.
+  template<typename Body>
+  void run(const string& name, const Input& input, size_t ops, Body body) {
+    run(name, input, ops, []() {
+	return 0;
+      }, [&body](int&) {
+	body();
+      });
+  }
+
+  // Keeps the optimizer from dropping a result.
+  void consume(size_t value) {
+    sink_ += value;
+  }
+
+  bool write(const string& path) const {
+    std::ofstream out(path);
+    out << "[\n";
+    for (size_t i = 0; i < results_.size(); i++) {
+      const Result& r = results_[i];
+      out << "  {\"name\": \"" << r.name << "\", \"input\": \"" << r.input << "\", \"vertices\": " << r.vertices
+	  << ", \"edges\": " << r.edges << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds
+	  << ", \"ops_per_second\": " << ops_per_second_(r) << "}" << (i + 1 < results_.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+    return bool(out);
+  }
+
+ private:
+  int repetitions_;
+  vector<Result> results_;
+  volatile size_t sink_ = 0;
+
+  static double ops_per_second_(const Result& r) {
+    return r.seconds > 0 ? r.ops / r.seconds : 0;
+  }
+};
+
+Input make_input(const string& name, int n, vector<EdgeSpec> edges) {
+  Input input;
+  input.name = name;
+  input.vertices.reserve(n);
+  for (int i = 0; i < n; i++) {
+    input.vertices.emplace_back(make_pair("V", i));
+  }
+  input.edges = std::move(edges);
+  return input;
+}
+
+// Pairs of vertex IDs to query, drawn from the input's edges so that
+// about half of them are adjacent.
+vector<std::pair<int, int>> queries(const Input& input, size_t count) {
+  std::mt19937_64 random(7);
+  std::uniform_int_distribution<size_t> edge(0, input.edges.size() - 1);
+  std::uniform_int_distribution<int> vertex(0, input.vertices.size() - 1);
+  vector<std::pair<int, int>> pairs;
+  pairs.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    const EdgeSpec& e = input.edges[edge(random)];
+    pairs.emplace_back(e.source, i % 2 ? e.dest : vertex(random));
+  }
+  return pairs;
+}
+
+// Mutation, query and traversal cases any input supports.
+void bench_graph(Bench& bench, const Input& input, ThreadPool& pool) {
+  const vector<Vertex>& vertices = input.vertices;
+  const vector<EdgeSpec>& edges = input.edges;
+  size_t m = edges.size();
+  bench.run("dg_add_edge", input, m, []() {
+      return DirectedGraph();
+    }, [&](DirectedGraph& dg) {
+      for (const EdgeSpec& e : edges) {
+	dg.add_edge(&vertices[e.source], &vertices[e.dest]);
+      }
+    });
+  bench.run("dg_add_edge_indexed", input, m, []() {
+      DirectedGraph dg;
+      dg.enable_index();
+      return dg;
+    }, [&](DirectedGraph& dg) {
+      for (const EdgeSpec& e : edges) {
+	dg.add_edge(&vertices[e.source], &vertices[e.dest]);
+      }
+    });
+  bench.run("dg_add_edges", input, m, []() {
+      return DirectedGraph();
+    }, [&](DirectedGraph& dg) {
+      dg.add_edges(edges, vertices);
+    });
+  ostringstream text;
+  for (const EdgeSpec& e : edges) {
+    text << vertices[e.source].value().first << " " << e.source << " " << vertices[e.dest].value().first << " "
+	 << e.dest << "\n";
+  }
+  string edge_list = text.str();
+  bench.run("parse_edge_list", input, m, []() {
+      return DirectedGraph();
+    }, [&](DirectedGraph& dg) {
+      graph_lib::parse_edge_list(edge_list, &dg, pool);
+    });
+
+  DirectedGraph dg;
+  dg.enable_index();
+  dg.add_edges(edges, vertices);
+  CsrGraph csr;
+  bench.run("freeze", input, m, [&]() {
+      csr = dg.freeze();
+    });
+  bench.run("to_string", input, m, [&]() {
+      bench.consume(dg.to_string().size());
+    });
+  bench.run("write_json", input, m, [&]() {
+      bench.consume(graph_lib::graph_to_string(dg, graph_lib::GraphFormat::kJson).size());
+    });
+
+  vector<std::pair<int, int>> pairs = queries(input, std::min<size_t>(m, 1000000));
+  bench.run("dg_are_adjacent", input, pairs.size(), [&]() {
+      size_t hits = 0;
+      for (const auto& pair : pairs) {
+	hits += dg.are_adjacent(&vertices[pair.first], &vertices[pair.second]);
+      }
+      bench.consume(hits);
+    });
+  bench.run("csr_are_adjacent", input, pairs.size(), [&]() {
+      size_t hits = 0;
+      for (const auto& pair : pairs) {
+	hits += csr.are_adjacent(&vertices[pair.first], &vertices[pair.second]);
+      }
+      bench.consume(hits);
+    });
+  dg.enable_reverse_index();
+  bench.run("dg_get_predecessors", input, pairs.size(), [&]() {
+      size_t total = 0;
+      for (const auto& pair : pairs) {
+	total += dg.get_predecessors(const_cast<Vertex*>(&vertices[pair.second])).size();
+      }
+      bench.consume(total);
+    });
+  bench.run("dg_in_degree", input, pairs.size(), [&]() {
+      size_t total = 0;
+      for (const auto& pair : pairs) {
+	total += dg.in_degree(&vertices[pair.second]);
+      }
+      bench.consume(total);
+    });
+  bench.run("dg_get_neighbors", input, pairs.size(), [&]() {
+      size_t total = 0;
+      for (const auto& pair : pairs) {
+	total += dg.get_neighbors(const_cast<Vertex*>(&vertices[pair.first])).size();
+      }
+      bench.consume(total);
+    });
+  bench.run("csr_get_neighbors", input, pairs.size(), [&]() {
+      size_t total = 0;
+      for (const auto& pair : pairs) {
+	total += csr.get_neighbors(const_cast<Vertex*>(&vertices[pair.first])).size();
+      }
+      bench.consume(total);
+    });
+  CompressedGraph compressed;
+  bench.run("compress", input, m, [&]() {
+      compressed = CompressedGraph(csr);
+    });
+  bench.run("compressed_neighbors", input, pairs.size(), [&]() {
+      vector<uint32_t> row;
+      size_t total = 0;
+      for (const auto& pair : pairs) {
+	compressed.neighbors(compressed.index_of(pair.first), &row);
+	total += row.size();
+      }
+      bench.consume(total);
+    });
+  bench.run("dg_vertex_count", input, pairs.size(), [&]() {
+      // Read through a volatile pointer so the call is not hoisted.
+      DirectedGraph* volatile graph = &dg;
+      size_t total = 0;
+      for (size_t i = 0; i < pairs.size(); i++) {
+	total += graph->vertex_count();
+      }
+      bench.consume(total);
+    });
+
+  Vertex* source = csr.vertex(csr.index_of(edges[0].source));
+  bench.run("bfs", input, m, [&]() {
+      bench.consume(graph_lib::bfs(csr, source).size());
+    });
+  bench.run("compressed_bfs", input, m, [&]() {
+      bench.consume(graph_lib::bfs(compressed, source).size());
+    });
+  vector<uint32_t> start = {csr.index_of(source)};
+  bench.run("parallel_bfs", input, m, [&]() {
+      bench.consume(graph_lib::parallel_bfs(csr, start, pool).size());
+    });
+  ShardedGraph sharded(8);
+  sharded.add_edges(edges, vertices, pool);
+  bench.run("sharded_add_edges", input, m, []() {
+      return std::make_unique<ShardedGraph>(8);
+    }, [&](unique_ptr<ShardedGraph>& g) {
+      g->add_edges(edges, vertices, pool);
+    });
+  Vertex* sharded_source = sharded.find(source);
+  bench.run("sharded_bfs", input, m, [&]() {
+      bench.consume(sharded.parallel_bfs(sharded_source, pool).size());
+    });
+
+  bench.run("scc", input, m, [&]() {
+      bench.consume(graph_lib::strongly_connected_components(csr).size());
+    });
+  bench.run("parallel_scc", input, m, [&]() {
+      bench.consume(graph_lib::parallel_strongly_connected_components(csr, pool).size());
+    });
+  bench.run("condense", input, m, [&]() {
+      bench.consume(graph_lib::condense(csr, pool).edge_count());
+    });
+
+  vector<std::pair<uint32_t, uint32_t>> rows;
+  for (const auto& pair : pairs) {
+    uint32_t u = csr.index_of(pair.first);
+    uint32_t v = csr.index_of(pair.second);
+    if (u != kNoVertex && v != kNoVertex) {
+      rows.emplace_back(u, v);
+    }
+  }
+  for (graph_lib::IntersectKernel kernel : {graph_lib::IntersectKernel::kScalar, graph_lib::best_intersect_kernel()}) {
+    bool scalar = kernel == graph_lib::IntersectKernel::kScalar;
+    if (!scalar && graph_lib::best_intersect_kernel() == graph_lib::IntersectKernel::kScalar) {
+      break;
+    }
+    bench.run(scalar ? "intersect_scalar" : "intersect_simd", input, rows.size(), [&]() {
+	size_t total = 0;
+	for (const auto& row : rows) {
+	  total += graph_lib::intersect(csr.neighbors(row.first), csr.neighbors(row.second), nullptr, kernel);
+	}
+	bench.consume(total);
+      });
+  }
+  bench.run("count_triangles", input, m, [&]() {
+      bench.consume(graph_lib::count_triangles(csr, pool));
+    });
+}
+
+// Cycle checking, for inputs whose edges form a DAG.
+void bench_dag(Bench& bench, const Input& input) {
+  const vector<Vertex>& vertices = input.vertices;
+  const vector<EdgeSpec>& edges = input.edges;
+  size_t m = edges.size();
+  bench.run("dag_add_edge", input, m, []() {
+      return unique_ptr<DirectedAcyclicGraph>(new DirectedAcyclicGraph());
+    }, [&](unique_ptr<DirectedAcyclicGraph>& dag) {
+      for (const EdgeSpec& e : edges) {
+	dag->add_edge(&vertices[e.source], &vertices[e.dest]);
+      }
+    });
+  bench.run("dag_add_edge_reach_index", input, m, []() {
+      unique_ptr<DirectedAcyclicGraph> dag(new DirectedAcyclicGraph());
+      dag->enable_reachability_index();
+      return dag;
+    }, [&](unique_ptr<DirectedAcyclicGraph>& dag) {
+      for (const EdgeSpec& e : edges) {
+	dag->add_edge(&vertices[e.source], &vertices[e.dest]);
+      }
+    });
+  // A whole-graph check per edge is quadratic; time only the first edges.
+  size_t checked = std::min<size_t>(m, 1000);
+  bench.run("dag_add_edge_full_check", input, checked, []() {
+      return unique_ptr<DirectedAcyclicGraph>(new DirectedAcyclicGraph(CycleCheck::kFull));
+    }, [&](unique_ptr<DirectedAcyclicGraph>& dag) {
+      for (size_t i = 0; i < checked; i++) {
+	dag->add_edge(&vertices[edges[i].source], &vertices[edges[i].dest]);
+      }
+    });
+  bench.run("dag_add_edges", input, m, []() {
+      return unique_ptr<DirectedAcyclicGraph>(new DirectedAcyclicGraph());
+    }, [&](unique_ptr<DirectedAcyclicGraph>& dag) {
+      dag->add_edges(edges, vertices);
+    });
+  const size_t kBatchSize = 64;
+  vector<DagBatch> batches((m + kBatchSize - 1) / kBatchSize);
+  for (size_t i = 0; i < m; i++) {
+    batches[i / kBatchSize].add_edge(&vertices[edges[i].source], &vertices[edges[i].dest]);
+  }
+  bench.run("dag_apply_batches_of_64", input, m, []() {
+      return unique_ptr<DirectedAcyclicGraph>(new DirectedAcyclicGraph());
+    }, [&](unique_ptr<DirectedAcyclicGraph>& dag) {
+      for (const DagBatch& batch : batches) {
+	dag->apply(batch);
+      }
+    });
+
+  DirectedAcyclicGraph dag;
+  dag.enable_reachability_index();
+  dag.add_edges(edges, vertices);
+  vector<std::pair<int, int>> pairs = queries(input, std::min<size_t>(m, 100000));
+  bench.run("dag_reaches", input, pairs.size(), [&]() {
+      size_t hits = 0;
+      for (const auto& pair : pairs) {
+	hits += dag.reaches(&vertices[pair.first], &vertices[pair.second]);
+      }
+      bench.consume(hits);
+    });
+}
+
+// Tree construction and ancestor queries, for tree inputs.
+void bench_tree(Bench& bench, const Input& input) {
+  const vector<Vertex>& vertices = input.vertices;
+  const vector<EdgeSpec>& edges = input.edges;
+  bench.run("tree_add_edge", input, edges.size(), []() {
+      return Tree();
+    }, [&](Tree& tree) {
+      for (const EdgeSpec& e : edges) {
+	tree.add_edge(&vertices[e.source], &vertices[e.dest]);
+      }
+    });
+
+  Tree tree;
+  for (const EdgeSpec& e : edges) {
+    tree.add_edge(&vertices[e.source], &vertices[e.dest]);
+  }
+  vector<std::pair<int, int>> pairs = queries(input, std::min<size_t>(edges.size(), 1000000));
+  bench.run("tree_parent", input, pairs.size(), [&]() {
+      size_t total = 0;
+      for (const auto& pair : pairs) {
+	total += tree.parent(&vertices[pair.second]) != nullptr;
+      }
+      bench.consume(total);
+    });
+  // The first query builds the ancestor index.
+  bench.run("tree_lca", input, pairs.size(), [&]() {
+      size_t total = 0;
+      for (const auto& pair : pairs) {
+	total += tree.lca(&vertices[pair.first], &vertices[pair.second])->value().second;
+      }
+      bench.consume(total);
+    });
+}
+
+// Reads all of arg as an int in [low, high].
+bool parse_int(const char* arg, int low, int high, int* value) {
+  const char* end = arg + strlen(arg);
+  std::from_chars_result result = std::from_chars(arg, end, *value);
+  return result.ec == std::errc() && result.ptr == end && end != arg && *value >= low && *value <= high;
+}
+
+int main(int argc, char** argv) {
+  // Inputs have up to 10^scale vertices and 4 * 10^scale edges, so
+  // anything above 9 overflows an int.
+  const int kMaxScale = 9;
+  int min_scale = 3;
+  int max_scale = 5;
+  int repetitions = 3;
+  string out = "bench.json";
+  for (int i = 1; i < argc; i += 2) {
+    const char* flag = argv[i];
+    bool known = !strcmp(flag, "--min-scale") || !strcmp(flag, "--max-scale") || !strcmp(flag, "--repetitions")
+      || !strcmp(flag, "--out");
+    if (!known) {
+      std::cerr << "Unknown flag " << flag << "\n";
+      return 1;
+    }
+    if (i + 1 == argc) {
+      std::cerr << "Missing value for " << flag << "\n";
+      return 1;
+    }
+    const char* value = argv[i + 1];
+    bool ok = true;
+    if (!strcmp(flag, "--min-scale")) {
+      ok = parse_int(value, 0, kMaxScale, &min_scale);
+    } else if (!strcmp(flag, "--max-scale")) {
+      ok = parse_int(value, 0, kMaxScale, &max_scale);
+    } else if (!strcmp(flag, "--repetitions")) {
+      ok = parse_int(value, 1, INT_MAX, &repetitions);
+    } else {
+      out = value;
+    }
+    if (!ok) {
+      std::cerr << "Bad value " << value << " for " << flag << "\n";
+      return 1;
+    }
+  }
+  if (min_scale > max_scale) {
+    std::cerr << "--min-scale " << min_scale << " is above --max-scale " << max_scale << "\n";
+    return 1;
+  }
+
+  Bench bench(repetitions);
+  ThreadPool pool;
+  for (int scale = min_scale; scale <= max_scale; scale++) {
+    int n = 1;
+    for (int i = 0; i < scale; i++) {
+      n *= 10;
+    }
+    int rmat_scale = 0;
+    while ((1 << rmat_scale) < n) {
+      rmat_scale++;
+    }
+    int width = std::max(1, std::min(n / 10, 1000));
+    vector<Input> graphs;
+    graphs.push_back(make_input("random/" + std::to_string(n), n, graph_lib::random_graph(n, 4 * size_t(n))));
+    graphs.push_back(make_input("rmat/" + std::to_string(n), 1 << rmat_scale,
+				graph_lib::rmat_graph(rmat_scale, 4 * size_t(n))));
+    Input dag = make_input("layered_dag/" + std::to_string(n), n, graph_lib::layered_dag(n / width, width, 4));
+    Input tree = make_input("deep_tree/" + std::to_string(n), n, graph_lib::deep_tree(n));
+    for (const Input& input : graphs) {
+      cout << input.name << ":\n";
+      bench_graph(bench, input, pool);
+    }
+    cout << dag.name << ":\n";
+    bench_graph(bench, dag, pool);
+    bench_dag(bench, dag);
+    cout << tree.name << ":\n";
+    bench_tree(bench, tree);
+  }
+  if (!bench.write(out)) {
+    std::cerr << "Could not write " << out << "\n";
+    return 1;
+  }
+  cout << "Wrote " << out << "\n";
+}
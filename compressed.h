@@ -0,0 +1,424 @@
+// Rows of sorted dense indices, gap-encoded as varints. A row holds the
+// zigzag distance from its own index to its first entry, then the gap
+// from each entry to the next; repeats are gaps of 0. Every integer is
+// LEB128: seven bits per byte, low bits first, high bit set on all but
+// the last byte. Neighbors tend to sit near each other in ID order, so
+// most gaps take a byte or two where a CSR target takes four.
+//
+// Decoding reads eight bytes at a time and, when none continues a
+// varint, adds all eight gaps without a branch per byte. The byte array
+// is padded so that this may read past the last row.
+class CompressedRows {
+ public:
+  CompressedRows() : offsets_(1, 0), bytes_(kPadding, 0) {}
+
+  // Encodes the rows of g.
+  explicit CompressedRows(const CsrGraph& g) : CompressedRows() {
+    uint32_t n = g.vertex_count();
+    offsets_.reserve(n + 1);
+    bytes_.clear();
+    bytes_.reserve(g.edge_count() + kPadding);
+    for (uint32_t i = 0; i < n; i++) {
+      encode_row_(i, g.neighbors(i));
+    }
+    bytes_.insert(bytes_.end(), kPadding, 0);
+    count_ = g.edge_count();
+  }
+
+  size_t size() const {
+    return offsets_.size() - 1;
+  }
+
+  // Number of entries over all rows.
+  uint64_t count() const {
+    return count_;
+  }
+
+  // Bytes held, row offsets included.
+  size_t bytes() const {
+    return bytes_.size() + offsets_.size() * sizeof(uint64_t);
+  }
+
+  // Calls visit(index) for each entry of row in order while it returns
+  // true.
+  template<typename Visit>
+  void decode(uint32_t row, const Visit& visit) const {
+    const uint8_t* p = bytes_.data() + offsets_[row];
+    const uint8_t* end = bytes_.data() + offsets_[row + 1];
+    if (p == end) {
+      return;
+    }
+    uint64_t first = read_varint_(&p);
+    uint32_t value = uint32_t(int64_t(row) + unzigzag_(first));
+    if (!visit(value)) {
+      return;
+    }
+    while (p < end) {
+      uint64_t word;
+      memcpy(&word, p, sizeof(word));
+      if (end - p >= 8 && !(word & 0x8080808080808080ull)) {
+	for (int k = 0; k < 8; k++) {
+	  value += uint32_t(word >> (8 * k)) & 0xFF;
+	  if (!visit(value)) {
+	    return;
+	  }
+	}
+	p += 8;
+	continue;
+      }
+      value += uint32_t(read_varint_(&p));
+      if (!visit(value)) {
+	return;
+      }
+    }
+  }
+
+  // Number of entries in row: one per byte that ends a varint.
+  uint32_t length(uint32_t row) const {
+    uint32_t n = 0;
+    for (uint64_t i = offsets_[row]; i < offsets_[row + 1]; i++) {
+      n += bytes_[i] < 0x80;
+    }
+    return n;
+  }
+
+  // The same entries by column: row j of the result lists, in order,
+  // every row of this one holding j. columns is the number of rows the
+  // result gets. Entries are gathered for a range of columns at a time,
+  // at most about block_entries of them, so building the transpose needs
+  // little more than its own size.
+  CompressedRows transpose(uint32_t columns, uint64_t block_entries = uint64_t(1) << 24) const {
+    vector<uint64_t> lengths(columns, 0);
+    for (uint32_t i = 0; i < size(); i++) {
+      decode(i, [&lengths](uint32_t j) {
+	  lengths[j]++;
+	  return true;
+	});
+    }
+    CompressedRows t;
+    t.offsets_.reserve(columns + 1);
+    t.bytes_.clear();
+    vector<uint32_t> entries;
+    vector<uint64_t> cursor;
+    for (uint32_t lo = 0; lo < columns; ) {
+      uint32_t hi = lo;
+      uint64_t total = 0;
+      while (hi < columns && (hi == lo || total + lengths[hi] <= block_entries)) {
+	total += lengths[hi++];
+      }
+      cursor.assign(hi - lo + 1, 0);
+      for (uint32_t j = lo; j < hi; j++) {
+	cursor[j - lo + 1] = cursor[j - lo] + lengths[j];
+      }
+      vector<uint64_t> starts(cursor.begin(), cursor.end());
+      entries.resize(total);
+      for (uint32_t i = 0; i < size(); i++) {
+	decode(i, [&, i](uint32_t j) {
+	    if (j >= lo && j < hi) {
+	      entries[cursor[j - lo]++] = i;
+	    }
+	    return true;
+	  });
+      }
+      for (uint32_t j = lo; j < hi; j++) {
+	t.encode_row_(j, Span<const uint32_t>(entries.data() + starts[j - lo], lengths[j]));
+      }
+      lo = hi;
+    }
+    t.bytes_.insert(t.bytes_.end(), kPadding, 0);
+    t.count_ = count_;
+    return t;
+  }
+
+ private:
+  static const size_t kPadding = 8;
+
+  vector<uint64_t> offsets_;
+  vector<uint8_t> bytes_;
+  uint64_t count_ = 0;
+
+  static uint64_t zigzag_(int64_t v) {
+    return uint64_t(v) << 1 ^ uint64_t(v >> 63);
+  }
+
+  static int64_t unzigzag_(uint64_t v) {
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+  }
+
+  void put_varint_(uint64_t v) {
+    while (v >= 0x80) {
+      bytes_.push_back(uint8_t(v) | 0x80);
+      v >>= 7;
+    }
+    bytes_.push_back(uint8_t(v));
+  }
+
+  static uint64_t read_varint_(const uint8_t** p) {
+    uint64_t v = 0;
+    for (int shift = 0; ; shift += 7) {
+      uint8_t byte = *(*p)++;
+      v |= uint64_t(byte & 0x7F) << shift;
+      if (byte < 0x80) {
+	return v;
+      }
+    }
+  }
+
+  void encode_row_(uint32_t row, Span<const uint32_t> entries) {
+    if (!entries.empty()) {
+      put_varint_(zigzag_(int64_t(entries[0]) - int64_t(row)));
+      for (size_t k = 1; k < entries.size(); k++) {
+	put_varint_(entries[k] - entries[k - 1]);
+      }
+    }
+    offsets_.push_back(bytes_.size());
+  }
+};
+
+// A read-only graph like CsrGraph, with its rows held as CompressedRows
+// instead of 32-bit targets. Vertices keep their IDs and names as flat
+// arrays, sorted by ID, and the Vertex*-based half of the Graph concept
+// works as it does on a CsrGraph. In-edges come from a transpose
+// compressed the same way, built on first use.
+//
+// The mutating half of the Graph concept refuses every change.
+class CompressedGraph {
+ public:
+  // The out-neighbors of one vertex as Vertex*, decoded once into the
+  // view.
+  class NeighborView {
+   public:
+    class iterator {
+     public:
+      iterator(const CompressedGraph* graph, const uint32_t* target) : graph_(graph), target_(target) {}
+      Vertex* operator*() const {
+	return graph_->vertex(*target_);
+      }
+      iterator& operator++() {
+	++target_;
+	return *this;
+      }
+      bool operator==(const iterator& other) const {
+	return target_ == other.target_;
+      }
+      bool operator!=(const iterator& other) const {
+	return target_ != other.target_;
+      }
+
+     private:
+      const CompressedGraph* graph_;
+      const uint32_t* target_;
+    };
+
+    NeighborView(const CompressedGraph* graph, uint32_t source) : graph_(graph) {
+      if (source != kNoVertex) {
+	graph->neighbors(source, &row_);
+      }
+    }
+    iterator begin() const {
+      return iterator(graph_, row_.data());
+    }
+    iterator end() const {
+      return iterator(graph_, row_.data() + row_.size());
+    }
+    size_t size() const {
+      return row_.size();
+    }
+    bool empty() const {
+      return row_.empty();
+    }
+
+   private:
+    const CompressedGraph* graph_;
+    vector<uint32_t> row_;
+  };
+
+  CompressedGraph() : state_(std::make_shared<State>()) {}
+
+  explicit CompressedGraph(const CsrGraph& g) : CompressedGraph() {
+    ids_.assign(g.ids().begin(), g.ids().end());
+    name_offsets_.assign(g.name_offsets().begin(), g.name_offsets().end());
+    names_.assign(g.names().begin(), g.names().size());
+    out_ = CompressedRows(g);
+  }
+
+  bool add(const Vertex*) {
+    return false;
+  }
+
+  bool add_edge(const Vertex*, const Vertex*) {
+    return false;
+  }
+
+  bool add_edge(const Edge*) {
+    return false;
+  }
+
+  void remove(const Vertex*) {}
+
+  bool are_adjacent(const Vertex* u, const Vertex* v) const {
+    uint32_t source = index_of(u);
+    uint32_t dest = index_of(v);
+    if (source == kNoVertex || dest == kNoVertex) {
+      return false;
+    }
+    bool found = false;
+    out_.decode(source, [dest, &found](uint32_t j) {
+	found = j == dest;
+	return j < dest;
+      });
+    return found;
+  }
+
+  int edge_count() const {
+    return out_.count();
+  }
+
+  vector<Vertex*> get_neighbors(Vertex* vertex) const {
+    vector<Vertex*> neighbors;
+    uint32_t source = index_of(vertex);
+    if (source != kNoVertex) {
+      out_.decode(source, [this, &neighbors](uint32_t j) {
+	  neighbors.push_back(this->vertex(j));
+	  return true;
+	});
+    }
+    return neighbors;
+  }
+
+  NeighborView neighbor_view(const Vertex* vertex) const {
+    return NeighborView(this, index_of(vertex));
+  }
+
+  vector<Vertex*> get_predecessors(Vertex* vertex) const {
+    vector<Vertex*> predecessors;
+    uint32_t dest = index_of(vertex);
+    if (dest != kNoVertex) {
+      in_().decode(dest, [this, &predecessors](uint32_t i) {
+	  predecessors.push_back(this->vertex(i));
+	  return true;
+	});
+    }
+    return predecessors;
+  }
+
+  int in_degree(const Vertex* v) const {
+    uint32_t i = index_of(v);
+    return i != kNoVertex ? in_degree(i) : 0;
+  }
+
+  int out_degree(const Vertex* v) const {
+    uint32_t i = index_of(v);
+    return i != kNoVertex ? out_degree(i) : 0;
+  }
+
+  string to_string() const {
+    return decompress().to_string();
+  }
+
+  Vertex* top() const {
+    return ids_.empty() ? nullptr : vertex(0);
+  }
+
+  int vertex_count() const {
+    return ids_.size();
+  }
+
+  // Dense index of the vertex with v's ID, or kNoVertex if absent.
+  uint32_t index_of(const Vertex* v) const {
+    return index_of(v->value().second);
+  }
+
+  uint32_t index_of(int id) const {
+    auto it = std::lower_bound(ids_.begin(), ids_.end(), id);
+    return it != ids_.end() && *it == id ? uint32_t(it - ids_.begin()) : kNoVertex;
+  }
+
+  int id(uint32_t index) const {
+    return ids_[index];
+  }
+
+  std::string_view name(uint32_t index) const {
+    return std::string_view(names_.data() + name_offsets_[index], name_offsets_[index + 1] - name_offsets_[index]);
+  }
+
+  Vertex* vertex(uint32_t index) const {
+    return state_->cache.get(this, index);
+  }
+
+  // Replaces *out with the sorted out-neighbors of the vertex at index.
+  void neighbors(uint32_t index, vector<uint32_t>* out) const {
+    out->clear();
+    out->reserve(out_.length(index));
+    out_.decode(index, [out](uint32_t j) {
+	out->push_back(j);
+	return true;
+      });
+  }
+
+  void in_neighbors(uint32_t index, vector<uint32_t>* out) const {
+    out->clear();
+    in_().decode(index, [out](uint32_t i) {
+	out->push_back(i);
+	return true;
+      });
+  }
+
+  uint32_t out_degree(uint32_t index) const {
+    return out_.length(index);
+  }
+
+  uint32_t in_degree(uint32_t index) const {
+    return in_().length(index);
+  }
+
+  const CompressedRows& rows() const {
+    return out_;
+  }
+
+  // Bytes held by the edges: the rows and their offsets.
+  size_t edge_bytes() const {
+    return out_.bytes();
+  }
+
+  // The same graph as a CsrGraph.
+  CsrGraph decompress() const {
+    vector<const Vertex*> vertices;
+    vertices.reserve(ids_.size());
+    for (uint32_t i = 0; i < ids_.size(); i++) {
+      vertices.push_back(vertex(i));
+    }
+    vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.reserve(out_.count());
+    for (uint32_t i = 0; i < ids_.size(); i++) {
+      out_.decode(i, [&edges, i](uint32_t j) {
+	  edges.emplace_back(i, j);
+	  return true;
+	});
+    }
+    return CsrGraph(vertices, edges);
+  }
+
+ private:
+  // Built on first use; safe to race between threads. Copies share it,
+  // as they share nothing they could change.
+  struct State {
+    VertexCache<CompressedGraph> cache;
+    std::once_flag transposed;
+    CompressedRows in;
+  };
+
+  vector<int> ids_;
+  vector<uint64_t> name_offsets_ = vector<uint64_t>(1, 0);
+  string names_;
+  CompressedRows out_;
+  std::shared_ptr<State> state_;
+
+  const CompressedRows& in_() const {
+    State& state = *state_;
+    std::call_once(state.transposed, [this, &state]() {
+	state.in = out_.transpose(ids_.size());
+      });
+    return state.in;
+  }
+};
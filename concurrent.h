@@ -0,0 +1,147 @@
+// A graph that many threads can read while one thread at a time changes
+// it. Writes go to a private DirectedGraph and are published as a new
+// immutable CsrGraph version with a single atomic pointer swap, so a
+// reader sees either all of a batch or none of it.
+//
+// Readers never lock or wait for the writer. On entry a Reader pins the
+// current epoch in a slot of its own, then loads the current version. A
+// replaced version is freed only once no pinned slot has an epoch from
+// before its replacement, that is, once every reader that might hold it
+// has left (epoch-based reclamation).
+class ConcurrentGraph {
+ private:
+  struct Version;
+
+ public:
+  // A pinned view of the version current when it was made. Pointers it
+  // hands out, Vertex* included, last as long as the Reader does. Keep
+  // Readers short-lived: an old one holds back reclamation.
+  class Reader {
+   public:
+    explicit Reader(const ConcurrentGraph& graph) : graph_(graph) {
+      slot_ = graph_.pin_();
+      version_ = graph_.current_.load();
+    }
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+    ~Reader() {
+      graph_.slots_[slot_].epoch.store(0, std::memory_order_release);
+    }
+    const CsrGraph& graph() const {
+      return version_->graph;
+    }
+    const CsrGraph* operator->() const {
+      return &version_->graph;
+    }
+    uint64_t version() const {
+      return version_->number;
+    }
+
+   private:
+    const ConcurrentGraph& graph_;
+    size_t slot_;
+    const Version* version_;
+  };
+
+  // Up to max_readers Readers can be pinned at once; more wait for a
+  // free slot.
+  explicit ConcurrentGraph(size_t max_readers = 256)
+    : slots_(new Slot[std::max<size_t>(max_readers, 1)]), slot_count_(std::max<size_t>(max_readers, 1)) {
+    current_.store(new Version{0, CsrGraph()});
+  }
+
+  ConcurrentGraph(const ConcurrentGraph&) = delete;
+  ConcurrentGraph& operator=(const ConcurrentGraph&) = delete;
+
+  // No Reader may outlive the graph.
+  ~ConcurrentGraph() {
+    for (const auto& retired : retired_) {
+      delete retired.second;
+    }
+    delete current_.load();
+  }
+
+  // Runs batch on the writer's DirectedGraph, then publishes the result
+  // and returns its version number. Concurrent calls take turns.
+  template<typename Batch>
+  uint64_t update(const Batch& batch) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    batch(writer_);
+    const Version* old = current_.load();
+    uint64_t number = old->number + 1;
+    current_.store(new Version{number, writer_.freeze()});
+    // Readers pinning from here on see the new version.
+    uint64_t replaced = epoch_.fetch_add(1) + 1;
+    retired_.emplace_back(replaced, old);
+    reclaim_();
+    return number;
+  }
+
+  uint64_t version() const {
+    return current_.load()->number;
+  }
+
+  // Versions replaced but not yet freed, for tests and monitoring.
+  size_t retired() const {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    return retired_.size();
+  }
+
+ private:
+  struct Version {
+    uint64_t number;
+    CsrGraph graph;
+  };
+
+  // Epoch a reader pinned, or 0 if free. One per cache line, so that
+  // readers on different cores do not contend.
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{0};
+  };
+
+  mutable std::mutex writer_mutex_;
+  DirectedGraph writer_;
+  std::atomic<const Version*> current_;
+  // Starts at 1 so that 0 can mark a free slot.
+  std::atomic<uint64_t> epoch_{1};
+  unique_ptr<Slot[]> slots_;
+  size_t slot_count_;
+  // Replaced versions, each with the first epoch that cannot see it.
+  vector<std::pair<uint64_t, const Version*>> retired_;
+
+  // Claims a free slot, starting from one picked per thread so that
+  // threads rarely probe past each other, and pins the current epoch.
+  size_t pin_() const {
+    static thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (size_t i = hint % slot_count_; ; i = (i + 1) % slot_count_) {
+      uint64_t free = 0;
+      if (slots_[i].epoch.load(std::memory_order_relaxed) == 0
+	  && slots_[i].epoch.compare_exchange_strong(free, epoch_.load())) {
+	return i;
+      }
+      if ((i + 1) % slot_count_ == hint % slot_count_) {
+	std::this_thread::yield();
+      }
+    }
+  }
+
+  // Frees the retired versions that no pinned reader can hold.
+  void reclaim_() {
+    uint64_t oldest = UINT64_MAX;
+    for (size_t i = 0; i < slot_count_; i++) {
+      uint64_t epoch = slots_[i].epoch.load();
+      if (epoch != 0) {
+	oldest = std::min(oldest, epoch);
+      }
+    }
+    size_t kept = 0;
+    for (const auto& retired : retired_) {
+      if (retired.first <= oldest) {
+	delete retired.second;
+      } else {
+	retired_[kept++] = retired;
+      }
+    }
+    retired_.resize(kept);
+  }
+};
@@ -0,0 +1,393 @@
+// The Vertex objects of a frozen graph G, which lists vertex_count()
+// vertices by dense index with their id() and name(). One slot per
+// vertex, allocated when the first Vertex is asked for and filled by
+// compare-and-swap so that racing readers agree on one copy. A copy of
+// the graph starts with an empty cache of its own.
+template<typename G>
+class VertexCache {
+ public:
+  VertexCache() : slots_(std::make_unique<Slots>()) {}
+  VertexCache(const VertexCache&) : VertexCache() {}
+  VertexCache& operator=(const VertexCache&) {
+    slots_ = std::make_unique<Slots>();
+    return *this;
+  }
+  Vertex* get(const G* graph, uint32_t index) {
+    Slots& slots = *slots_;
+    std::call_once(slots.allocated, [&slots, graph]() {
+	slots.size = graph->vertex_count();
+	slots.vertices.reset(new std::atomic<Vertex*>[slots.size]());
+      });
+    Vertex* vertex = slots.vertices[index].load(std::memory_order_acquire);
+    if (vertex) {
+      return vertex;
+    }
+    Vertex* built = new Vertex(Value(string(graph->name(index)), graph->id(index)));
+    if (slots.vertices[index].compare_exchange_strong(vertex, built, std::memory_order_acq_rel)) {
+      return built;
+    }
+    delete built;
+    return vertex;
+  }
+
+ private:
+  struct Slots {
+    ~Slots() {
+      for (size_t i = 0; i < size; i++) {
+	delete vertices[i].load(std::memory_order_relaxed);
+      }
+    }
+    std::once_flag allocated;
+    size_t size = 0;
+    unique_ptr<std::atomic<Vertex*>[]> vertices;
+  };
+  unique_ptr<Slots> slots_;
+};
+
+// An immutable graph in compressed sparse row form, built by freezing a
+// mutable graph. Vertices are sorted by ID (the second part of their
+// Value) and addressed by their dense index in that order. The
+// out-neighbors of vertex i are the sorted run of dense indices
+// targets_[offsets_[i], offsets_[i + 1]), so neighbor queries touch one
+// contiguous block instead of scanning every edge.
+//
+// The graph is nothing but flat arrays: vertex IDs, a pool holding the
+// first part of every vertex's Value back to back, row offsets and
+// targets. Copies share them. The arrays are either owned or, for a
+// snapshot loaded with graph_lib::load_snapshot(), read straight from a
+// file mapping. Vertex objects are only built, once each, when the
+// Vertex*-based half of the API first asks for them; this is safe to
+// race between threads.
+//
+// The mutating half of the Graph concept is present but refuses every
+// change: add() and add_edge() return false and remove() does nothing.
+class CsrGraph {
+ public:
+  // The out-neighbors of one vertex as Vertex*, read straight from its
+  // row of targets.
+  class NeighborView {
+   public:
+    class iterator {
+     public:
+      iterator(const CsrGraph* graph, const uint32_t* target) : graph_(graph), target_(target) {}
+      Vertex* operator*() const {
+	return graph_->vertex(*target_);
+      }
+      iterator& operator++() {
+	++target_;
+	return *this;
+      }
+      bool operator==(const iterator& other) const {
+	return target_ == other.target_;
+      }
+      bool operator!=(const iterator& other) const {
+	return target_ != other.target_;
+      }
+
+     private:
+      const CsrGraph* graph_;
+      const uint32_t* target_;
+    };
+
+    NeighborView(const CsrGraph* graph, Span<const uint32_t> row) : graph_(graph), row_(row) {}
+    iterator begin() const {
+      return iterator(graph_, row_.begin());
+    }
+    iterator end() const {
+      return iterator(graph_, row_.end());
+    }
+    size_t size() const {
+      return row_.size();
+    }
+    bool empty() const {
+      return row_.empty();
+    }
+
+   private:
+    const CsrGraph* graph_;
+    Span<const uint32_t> row_;
+  };
+
+  CsrGraph() {
+    adopt_(std::make_shared<Arrays>());
+  }
+
+  // Builds from a table holding one vertex per ID, in any order, and
+  // edges given as (source, dest) positions in that table.
+  CsrGraph(const vector<const Vertex*>& vertices, const vector<std::pair<uint32_t, uint32_t>>& edges) {
+    vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&vertices](uint32_t a, uint32_t b) {
+	return vertices[a]->value().second < vertices[b]->value().second;
+      });
+    std::shared_ptr<Arrays> arrays = std::make_shared<Arrays>();
+    vector<uint32_t> rank(vertices.size());
+    arrays->ids.reserve(vertices.size());
+    arrays->name_offsets.reserve(vertices.size() + 1);
+    for (uint32_t i = 0; i < order.size(); i++) {
+      const Value& value = vertices[order[i]]->value();
+      arrays->ids.push_back(value.second);
+      arrays->names += value.first;
+      arrays->name_offsets.push_back(arrays->names.size());
+      rank[order[i]] = i;
+    }
+
+    // Count out-degrees, turn them into row offsets, then scatter.
+    vector<uint64_t>& offsets = arrays->offsets;
+    offsets.assign(vertices.size() + 1, 0);
+    for (const auto& edge : edges) {
+      offsets[rank[edge.first] + 1]++;
+    }
+    for (size_t i = 1; i < offsets.size(); i++) {
+      offsets[i] += offsets[i - 1];
+    }
+    vector<uint32_t>& targets = arrays->targets;
+    targets.resize(offsets.back());
+    vector<uint64_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (const auto& edge : edges) {
+      targets[cursor[rank[edge.first]]++] = rank[edge.second];
+    }
+    for (size_t i = 0; i < vertices.size(); i++) {
+      std::sort(targets.begin() + offsets[i], targets.begin() + offsets[i + 1]);
+    }
+    adopt_(arrays);
+  }
+
+  // Serves a graph from arrays laid out as above that live in storage
+  // kept alive by backing, such as a file mapping. name_offsets and
+  // offsets hold one more entry than ids, the first being 0.
+  CsrGraph(std::shared_ptr<const void> backing, Span<const int> ids, Span<const uint64_t> name_offsets,
+	   Span<const char> names, Span<const uint64_t> offsets, Span<const uint32_t> targets)
+    : backing_(std::move(backing)), ids_(ids), name_offsets_(name_offsets), names_(names),
+      offsets_(offsets), targets_(targets) {
+    index_ids_();
+  }
+
+  bool add(const Vertex*) {
+    return false;
+  }
+
+  bool add_edge(const Vertex*, const Vertex*) {
+    return false;
+  }
+
+  bool add_edge(const Edge*) {
+    return false;
+  }
+
+  void remove(const Vertex*) {}
+
+  bool are_adjacent(const Vertex* u, const Vertex* v) const {
+    uint32_t source = index_of(u);
+    uint32_t dest = index_of(v);
+    if (source == kNoVertex || dest == kNoVertex) {
+      return false;
+    }
+    Span<const uint32_t> row = neighbors(source);
+    return std::binary_search(row.begin(), row.end(), dest);
+  }
+
+  int edge_count() const {
+    return targets_.size();
+  }
+
+  vector<Vertex*> get_neighbors(Vertex* vertex) const {
+    vector<Vertex*> neighbors;
+    for (Vertex* neighbor : neighbor_view(vertex)) {
+      neighbors.push_back(neighbor);
+    }
+    return neighbors;
+  }
+
+  NeighborView neighbor_view(const Vertex* vertex) const {
+    uint32_t source = index_of(vertex);
+    return NeighborView(this, source != kNoVertex ? neighbors(source) : Span<const uint32_t>());
+  }
+
+  // The sources of the edges into vertex, in ID order, read from the
+  // transpose (see in_neighbors()).
+  vector<Vertex*> get_predecessors(Vertex* vertex) const {
+    vector<Vertex*> predecessors;
+    uint32_t dest = index_of(vertex);
+    if (dest != kNoVertex) {
+      for (uint32_t source : in_neighbors(dest)) {
+	predecessors.push_back(this->vertex(source));
+      }
+    }
+    return predecessors;
+  }
+
+  int in_degree(const Vertex* v) const {
+    uint32_t i = index_of(v);
+    return i != kNoVertex ? in_degree(i) : 0;
+  }
+
+  int out_degree(const Vertex* v) const {
+    uint32_t i = index_of(v);
+    return i != kNoVertex ? out_degree(i) : 0;
+  }
+
+  string to_string() const {
+    return graph_lib::graph_to_string(*this);
+  }
+
+  Vertex* top() const {
+    return ids_.empty() ? nullptr : vertex(0);
+  }
+
+  int vertex_count() const {
+    return ids_.size();
+  }
+
+  // Dense index of the vertex with v's ID, or kNoVertex if absent.
+  uint32_t index_of(const Vertex* v) const {
+    return index_of(v->value().second);
+  }
+
+  uint32_t index_of(int id) const {
+    if (ids_contiguous_) {
+      int64_t offset = int64_t(id) - int64_t(ids_[0]);
+      return offset >= 0 && offset < int64_t(ids_.size()) ? uint32_t(offset) : kNoVertex;
+    }
+    auto it = std::lower_bound(ids_.begin(), ids_.end(), id);
+    return it != ids_.end() && *it == id ? uint32_t(it - ids_.begin()) : kNoVertex;
+  }
+
+  int id(uint32_t index) const {
+    return ids_[index];
+  }
+
+  // The first part of the vertex's Value, read in place.
+  std::string_view name(uint32_t index) const {
+    return std::string_view(names_.begin() + name_offsets_[index], name_offsets_[index + 1] - name_offsets_[index]);
+  }
+
+  // The vertex at index, built on first use and owned by this graph.
+  Vertex* vertex(uint32_t index) const {
+    return cache_.get(this, index);
+  }
+
+  // Sorted dense indices of the out-neighbors of the vertex at index.
+  Span<const uint32_t> neighbors(uint32_t index) const {
+    return Span<const uint32_t>(targets_.begin() + offsets_[index], offsets_[index + 1] - offsets_[index]);
+  }
+
+  uint32_t out_degree(uint32_t index) const {
+    return offsets_[index + 1] - offsets_[index];
+  }
+
+  uint32_t in_degree(uint32_t index) const {
+    return in_neighbors(index).size();
+  }
+
+  // Sorted dense indices of the in-neighbors of the vertex at index,
+  // read from a transpose built on first use.
+  Span<const uint32_t> in_neighbors(uint32_t index) const {
+    const Transpose& t = transpose_.get(this);
+    return Span<const uint32_t>(t.sources.data() + t.offsets[index], t.offsets[index + 1] - t.offsets[index]);
+  }
+
+  // The underlying arrays, for writers such as graph_lib::save_snapshot().
+  Span<const int> ids() const {
+    return ids_;
+  }
+
+  Span<const uint64_t> name_offsets() const {
+    return name_offsets_;
+  }
+
+  Span<const char> names() const {
+    return names_;
+  }
+
+  Span<const uint64_t> offsets() const {
+    return offsets_;
+  }
+
+  Span<const uint32_t> targets() const {
+    return targets_;
+  }
+
+ private:
+  // Storage for a graph built in memory.
+  struct Arrays {
+    vector<int> ids;
+    vector<uint64_t> name_offsets = vector<uint64_t>(1, 0);
+    string names;
+    vector<uint64_t> offsets = vector<uint64_t>(1, 0);
+    vector<uint32_t> targets;
+  };
+
+  // The graph with every edge reversed, in the same layout.
+  struct Transpose {
+    vector<uint64_t> offsets;
+    vector<uint32_t> sources;
+  };
+
+  // Builds the transpose once, however many threads ask at once. A copy
+  // of the graph starts without one.
+  class TransposeCache {
+   public:
+    TransposeCache() : state_(std::make_unique<State>()) {}
+    TransposeCache(const TransposeCache&) : TransposeCache() {}
+    TransposeCache& operator=(const TransposeCache&) {
+      state_ = std::make_unique<State>();
+      return *this;
+    }
+    const Transpose& get(const CsrGraph* graph) {
+      State& state = *state_;
+      std::call_once(state.built, [&state, graph]() {
+	  // Counting sort by dest. Sources are visited in order, so every
+	  // row comes out sorted.
+	  Transpose& t = state.transpose;
+	  t.offsets.assign(graph->ids_.size() + 1, 0);
+	  for (uint32_t dest : graph->targets_) {
+	    t.offsets[dest + 1]++;
+	  }
+	  for (size_t i = 1; i < t.offsets.size(); i++) {
+	    t.offsets[i] += t.offsets[i - 1];
+	  }
+	  t.sources.resize(graph->targets_.size());
+	  vector<uint64_t> cursor(t.offsets.begin(), t.offsets.end() - 1);
+	  for (uint32_t source = 0; source < graph->ids_.size(); source++) {
+	    for (uint32_t dest : graph->neighbors(source)) {
+	      t.sources[cursor[dest]++] = source;
+	    }
+	  }
+	});
+      return state.transpose;
+    }
+
+   private:
+    struct State {
+      std::once_flag built;
+      Transpose transpose;
+    };
+    unique_ptr<State> state_;
+  };
+
+  std::shared_ptr<const void> backing_;
+  Span<const int> ids_;
+  Span<const uint64_t> name_offsets_;
+  Span<const char> names_;
+  Span<const uint64_t> offsets_;
+  Span<const uint32_t> targets_;
+  bool ids_contiguous_ = false;
+  mutable VertexCache<CsrGraph> cache_;
+  mutable TransposeCache transpose_;
+
+  void adopt_(std::shared_ptr<const Arrays> arrays) {
+    ids_ = Span<const int>(arrays->ids);
+    name_offsets_ = Span<const uint64_t>(arrays->name_offsets);
+    names_ = Span<const char>(arrays->names);
+    offsets_ = Span<const uint64_t>(arrays->offsets);
+    targets_ = Span<const uint32_t>(arrays->targets);
+    backing_ = std::move(arrays);
+    index_ids_();
+  }
+
+  void index_ids_() {
+    // When the IDs form one unbroken range, lookups are a subtraction.
+    ids_contiguous_ = !ids_.empty() && int64_t(ids_[ids_.size() - 1]) - int64_t(ids_[0]) + 1 == int64_t(ids_.size());
+  }
+};
@@ -1,73 +1,761 @@
+// How DirectedAcyclicGraph rejects edges that would close a cycle.
+enum class CycleCheck {
+  // Keep a dynamic topological order and search only the region an
+  // insert disturbs (see topo.h).
+  kIncremental,
+  // Insert, re-check the whole graph, and roll back on a cycle.
+  kFull,
+};
+
+// Edge changes staged for DirectedAcyclicGraph::apply(), which makes
+// them all or none. Removals take effect before inserts, so one batch
+// can reverse an edge.
+class DagBatch {
+ public:
+  void add_edge(const Vertex* source, const Vertex* dest, const Value& value = kDummyValue) {
+    inserts_.push_back(EdgeSpec{source->value().second, dest->value().second, value});
+    vertices_.push_back(*source);
+    vertices_.push_back(*dest);
+  }
+  // Stages dropping every source -> dest edge with value, as
+  // DirectedGraph::remove_edge() matches them.
+  void remove_edge(const Vertex* source, const Vertex* dest, const Value& value = kDummyValue) {
+    removals_.emplace_back(std::make_unique<Vertex>(*source), std::make_unique<Vertex>(*dest),
+			   std::make_unique<Value>(value));
+  }
+  size_t size() const {
+    return inserts_.size() + removals_.size();
+  }
+  bool empty() const {
+    return size() == 0;
+  }
+  void clear() {
+    inserts_.clear();
+    vertices_.clear();
+    removals_.clear();
+  }
+
+ private:
+  friend class DirectedAcyclicGraph;
+  vector<EdgeSpec> inserts_;
+  // The source and dest of each insert, in turn.
+  vector<Vertex> vertices_;
+  vector<Edge> removals_;
+};
+
 class DirectedAcyclicGraph {
  public:
-  DirectedAcyclicGraph() {
-    directed_graph_ = std::make_unique<DirectedGraph>();
+  DirectedAcyclicGraph() : DirectedAcyclicGraph(CycleCheck::kIncremental) {}
+  // Storage for the graph and its topological order comes from
+  // resource, which must outlive the graph (see DirectedGraph).
+  explicit DirectedAcyclicGraph(CycleCheck cycle_check,
+				std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    : cycle_check_(cycle_check), order_(resource) {
+    directed_graph_ = std::make_unique<DirectedGraph>(resource);
   }
-  DirectedAcyclicGraph(const DirectedAcyclicGraph& dag) noexcept {
+  explicit DirectedAcyclicGraph(std::pmr::memory_resource* resource)
+    : DirectedAcyclicGraph(CycleCheck::kIncremental, resource) {}
+  DirectedAcyclicGraph(const DirectedAcyclicGraph& dag) noexcept
+    : cycle_check_(dag.cycle_check_), order_(dag.order_), reach_enabled_(dag.reach_enabled_) {
     if (dag.directed_graph_.get()) {
       directed_graph_ = std::make_unique<DirectedGraph>(*(dag.directed_graph_.get()));
     }
   }
   bool add(const Vertex* u) {
+    note_vertex_(u);
     return directed_graph_.get()->add(u);
   }
   bool add_edge(const Vertex* source, const Vertex* dest) {
+    GRAPHS_STATS_OP(kDagAddEdge);
+    // A valid reachability index settles the cycle check in one query.
+    bool settled = reach_valid_;
+    if (settled && reaches_(dest, source)) {
+      return false;
+    }
+    if (cycle_check_ == CycleCheck::kIncremental) {
+      if (!order_.add_edge(order_.node(source->value().second), order_.node(dest->value().second))) {
+	return false;
+      }
+      note_edge_(source, dest);
+      note_reach_(source, dest);
+      return directed_graph_.get()->add_edge(source, dest);
+    }
     directed_graph_.get()->add_edge(source, dest);
-    if (check_for_cycles_()) {
+    if (!settled && check_for_cycles_()) {
       Edge edge(std::make_unique<Vertex>(*source), std::make_unique<Vertex>(*dest), std::make_unique<Value>(kDummyValue));
+      GRAPHS_STATS_ALLOCATED(3);
       directed_graph_.get()->remove_edge(&edge);
       return false;
     }
+    note_edge_(source, dest);
+    note_reach_(source, dest);
     return true;
   }
   bool add_edge(const Edge* edge) {
+    GRAPHS_STATS_OP(kDagAddEdge);
+    // Without both endpoints there is no edge that could close a cycle.
+    bool whole = edge->get_source() && edge->get_dest();
+    bool settled = reach_valid_ || !whole;
+    if (whole && reach_valid_ && reaches_(edge->get_dest().get(), edge->get_source().get())) {
+      return false;
+    }
+    if (cycle_check_ == CycleCheck::kIncremental) {
+      if (whole && !order_.add_edge(order_.node(edge->get_source()->value().second),
+				    order_.node(edge->get_dest()->value().second))) {
+	return false;
+      }
+      note_edge_(edge);
+      return directed_graph_.get()->add_edge(edge);
+    }
     directed_graph_.get()->add_edge(edge);
-    if (check_for_cycles_()) {
+    if (!settled && check_for_cycles_()) {
       directed_graph_.get()->remove_edge(edge);
       return false;
     }
+    note_edge_(edge);
+    return true;
+  }
+  // Adds edges in bulk (see DirectedGraph::add_edges), checking for
+  // cycles once over the combined graph with a single Kahn pass instead
+  // of once per edge. If the batch would close a cycle nothing is added,
+  // false is returned, and cycle_edges (when given) receives the batch
+  // edges that lie on or between cycles.
+  bool add_edges(Span<const EdgeSpec> edges, Span<const Vertex> vertices = Span<const Vertex>(),
+		 vector<EdgeSpec>* cycle_edges = nullptr) {
+    GRAPHS_STATS_OP(kDagAddEdges);
+    // Number every endpoint of the existing and new edges densely.
+    std::unordered_map<int, uint32_t> local;
+    vector<int> ids;
+    vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(directed_graph_.get()->edge_count() + edges.size());
+    auto number = [&local, &ids](int id) {
+      auto inserted = local.emplace(id, ids.size());
+      if (inserted.second) {
+	ids.push_back(id);
+      }
+      return inserted.first->second;
+    };
+    for (const DirectedGraph::EdgeRef& e : directed_graph_.get()->edges()) {
+      if (e.get_source() && e.get_dest()) {
+	uint32_t source = number(e.get_source()->value().second);
+	pairs.emplace_back(source, number(e.get_dest()->value().second));
+      }
+    }
+    size_t first_new = pairs.size();
+    for (const EdgeSpec& e : edges) {
+      uint32_t source = number(e.source);
+      pairs.emplace_back(source, number(e.dest));
+    }
+
+    GRAPHS_STATS_SCANNED(pairs.size());
+    vector<uint32_t> order = kahn_order_(ids.size(), pairs);
+    if (order.size() < ids.size()) {
+      if (cycle_edges) {
+	vector<bool> cyclic = cyclic_core_(ids.size(), pairs, order);
+	for (size_t i = first_new; i < pairs.size(); i++) {
+	  if (cyclic[pairs[i].first] && cyclic[pairs[i].second]) {
+	    cycle_edges->push_back(edges[i - first_new]);
+	  }
+	}
+      }
+      return false;
+    }
+    directed_graph_.get()->add_edges(edges, vertices);
+    sorted_valid_ = false;
+    levels_valid_ = false;
+    reach_valid_ = false;
+    if (cycle_check_ == CycleCheck::kIncremental) {
+      // Restart the dynamic order from the one Kahn's algorithm found.
+      vector<uint32_t> position(ids.size());
+      vector<int> ordered_ids;
+      ordered_ids.reserve(ids.size());
+      for (uint32_t i = 0; i < order.size(); i++) {
+	position[order[i]] = i;
+	ordered_ids.push_back(ids[order[i]]);
+      }
+      for (auto& pair : pairs) {
+	pair = std::make_pair(position[pair.first], position[pair.second]);
+      }
+      order_.assign(ordered_ids, pairs);
+    }
+    return true;
+  }
+  // Applies every change in batch, checking for cycles once at the end
+  // rather than per edge. Under CycleCheck::kIncremental the check runs
+  // the batch's inserts through the dynamic order, which searches only
+  // the region they disturb; under kFull it is one Kahn pass, as in
+  // add_edges(). Returns false, leaving the graph untouched, if the
+  // result would have a cycle.
+  bool apply(const DagBatch& batch) {
+    GRAPHS_STATS_OP(kDagApply);
+    vector<std::pair<int, int>> dropped = dropped_pairs_(batch.removals_);
+    bool acyclic = cycle_check_ == CycleCheck::kIncremental ? reorder_for_(batch, dropped)
+      : acyclic_after_(batch, dropped);
+    if (!acyclic) {
+      return false;
+    }
+    if (!batch.removals_.empty()) {
+      vector<const Edge*> removals;
+      removals.reserve(batch.removals_.size());
+      for (const Edge& e : batch.removals_) {
+	removals.push_back(&e);
+      }
+      directed_graph_.get()->remove_edges(removals);
+      prune_sorted_();
+      reach_valid_ = false;
+    }
+    directed_graph_.get()->add_edges(batch.inserts_, batch.vertices_);
+    for (size_t i = 0; i < batch.inserts_.size(); i++) {
+      const Vertex* source = &batch.vertices_[2 * i];
+      const Vertex* dest = &batch.vertices_[2 * i + 1];
+      note_vertex_(source);
+      note_vertex_(dest);
+      note_edge_(source, dest);
+      note_reach_(source, dest);
+    }
     return true;
   }
   vector<Edge> get_adjacency_list() {
     return directed_graph_.get()->get_adjacency_list();
   }
+  DirectedGraph::EdgeRange edges() const {
+    return directed_graph_.get()->edges();
+  }
+  CsrGraph freeze() const {
+    return directed_graph_.get()->freeze();
+  }
   bool are_adjacent(const Vertex* u, const Vertex* v) {
     return directed_graph_.get()->are_adjacent(u, v);
   }
-  int edge_count() {
+  int edge_count() const {
     return directed_graph_.get()->edge_count();
   }
   vector<Vertex*> get_neighbors(Vertex* u) {
     return directed_graph_.get()->get_neighbors(u);
   }
+  DirectedGraph::NeighborView neighbor_view(const Vertex* u) {
+    return directed_graph_.get()->neighbor_view(u);
+  }
+  vector<Vertex*> get_predecessors(Vertex* u) {
+    return directed_graph_.get()->get_predecessors(u);
+  }
+  int in_degree(const Vertex* u) const {
+    return directed_graph_.get()->in_degree(u);
+  }
+  int out_degree(const Vertex* u) const {
+    return directed_graph_.get()->out_degree(u);
+  }
+  // See DirectedGraph::enable_reverse_index().
+  void enable_reverse_index() {
+    directed_graph_.get()->enable_reverse_index();
+  }
   void remove(const Vertex* u) {
+    GRAPHS_STATS_OP(kDagRemove);
     directed_graph_.get()->remove(u);
+    forget_(u);
+    prune_sorted_();
+    reach_valid_ = false;
+  }
+  void remove_vertices(Span<const Vertex* const> vertices) {
+    GRAPHS_STATS_OP(kDagRemove);
+    directed_graph_.get()->remove_vertices(vertices);
+    for (const Vertex* u : vertices) {
+      forget_(u);
+    }
+    prune_sorted_();
+    reach_valid_ = false;
+  }
+  // Keeps a reachability index (see reach.h) for reaches(). It is built
+  // on the first query, kept up to date by inserts it can absorb, and
+  // rebuilt on the query after one it cannot or after a removal. While
+  // it is valid, add_edge() rejects a cycle with one query: an edge
+  // closes one exactly when dest already reaches source.
+  void enable_reachability_index() {
+    reach_enabled_ = true;
+  }
+  void disable_reachability_index() {
+    reach_enabled_ = false;
+    reach_valid_ = false;
+    reach_ = ReachabilityIndex();
+    reach_node_.clear();
+  }
+  // Whether a path leads from u to v; a vertex in the graph reaches
+  // itself. Uses the reachability index when enabled and searches the
+  // graph otherwise.
+  bool reaches(const Vertex* u, const Vertex* v) {
+    GRAPHS_STATS_OP(kDagReaches);
+    if (!directed_graph_.get()->find(u) || !directed_graph_.get()->find(v)) {
+      return false;
+    }
+    if (reach_enabled_) {
+      if (!reach_valid_) {
+	build_reach_();
+      }
+      return reaches_(u, v);
+    }
+    // Group the edges by source once, rather than scan them per vertex.
+    std::unordered_map<int, vector<int>> successors;
+    for (const DirectedGraph::EdgeRef& e : directed_graph_.get()->edges()) {
+      if (e.get_source() && e.get_dest()) {
+	successors[e.get_source()->value().second].push_back(e.get_dest()->value().second);
+      }
+    }
+    int target = v->value().second;
+    std::unordered_set<int> seen = {u->value().second};
+    vector<int> queue = {u->value().second};
+    for (size_t i = 0; i < queue.size(); i++) {
+      if (queue[i] == target) {
+	return true;
+      }
+      for (int next : successors[queue[i]]) {
+	if (seen.insert(next).second) {
+	  queue.push_back(next);
+	}
+      }
+    }
+    return false;
+  }
+  // Every vertex, each edge's source before its dest. The result is
+  // cached: inserts that keep it valid, such as an edge between vertices
+  // already in order, leave it alone, and removals only drop the vertices
+  // that left. The reference lasts until the next mutation.
+  const vector<const Vertex*>& topological_order() {
+    if (!sorted_valid_) {
+      sort_();
+    }
+    return sorted_;
+  }
+  // The vertices grouped into antichains that can run concurrently:
+  // level 0 holds those without predecessors, and every other vertex sits
+  // one level past its latest predecessor, so each edge leads to a later
+  // level. Cached like topological_order(); an edge into a vertex already
+  // on a later level than its source keeps it, a removal drops it.
+  const vector<vector<const Vertex*>>& levels() {
+    if (!levels_valid_) {
+      sort_();
+    }
+    return levels_;
   }
   Vertex* top() {
     return directed_graph_.get()->top();
   }
-  int vertex_count() {
+  int vertex_count() const {
     return directed_graph_.get()->vertex_count();
   }
-  string to_string() {
+  string to_string() const {
     return directed_graph_.get()->to_string();
   } 
  private:
   unique_ptr<DirectedGraph> directed_graph_;
+  CycleCheck cycle_check_;
+  // Only maintained under CycleCheck::kIncremental.
+  TopologicalOrder order_;
+  // Caches for topological_order() and levels(), with each cached
+  // vertex's position in sorted_ and level. Copies start without them.
+  bool sorted_valid_ = false;
+  bool levels_valid_ = false;
+  vector<const Vertex*> sorted_;
+  std::unordered_map<int, uint32_t> sorted_position_;
+  vector<vector<const Vertex*>> levels_;
+  std::unordered_map<int, uint32_t> level_of_;
+  // The reachability index over nodes numbered by reach_node_. Copies
+  // start without it.
+  bool reach_enabled_ = false;
+  bool reach_valid_ = false;
+  ReachabilityIndex reach_;
+  std::unordered_map<int, uint32_t> reach_node_;
+
+  // Groups edges by source: the dests of node u are
+  // targets[offsets[u], offsets[u + 1]).
+  static void by_source_(size_t n, const vector<std::pair<uint32_t, uint32_t>>& edges, vector<uint32_t>* offsets,
+			 vector<uint32_t>* targets) {
+    offsets->assign(n + 1, 0);
+    for (const auto& edge : edges) {
+      (*offsets)[edge.first + 1]++;
+    }
+    for (size_t i = 1; i <= n; i++) {
+      (*offsets)[i] += (*offsets)[i - 1];
+    }
+    targets->resize(edges.size());
+    vector<uint32_t> cursor(offsets->begin(), offsets->end() - 1);
+    for (const auto& edge : edges) {
+      (*targets)[cursor[edge.first]++] = edge.second;
+    }
+  }
+
+  // Kahn's algorithm over nodes 0..n-1. Returns the nodes in a
+  // topological order; on a cycle it covers only the nodes outside it.
+  static vector<uint32_t> kahn_order_(size_t n, const vector<std::pair<uint32_t, uint32_t>>& edges) {
+    vector<uint32_t> offsets;
+    vector<uint32_t> targets;
+    by_source_(n, edges, &offsets, &targets);
+    vector<uint32_t> in_degree(n, 0);
+    for (const auto& edge : edges) {
+      in_degree[edge.second]++;
+    }
+    // order doubles as the queue: nodes are appended once their
+    // in-degree reaches zero and read back in the same order.
+    vector<uint32_t> order;
+    order.reserve(n);
+    for (uint32_t i = 0; i < n; i++) {
+      if (in_degree[i] == 0) {
+	order.push_back(i);
+      }
+    }
+    for (size_t head = 0; head < order.size(); head++) {
+      uint32_t u = order[head];
+      for (uint32_t i = offsets[u]; i < offsets[u + 1]; i++) {
+	if (--in_degree[targets[i]] == 0) {
+	  order.push_back(targets[i]);
+	}
+      }
+    }
+    return order;
+  }
+
+  // After a Kahn pass that stopped short, marks the nodes left once the
+  // nodes without successors among the leftovers are peeled away too:
+  // what remains lies on a cycle or on a path between cycles.
+  static vector<bool> cyclic_core_(size_t n, const vector<std::pair<uint32_t, uint32_t>>& edges,
+				   const vector<uint32_t>& sorted) {
+    vector<bool> core(n, true);
+    for (uint32_t u : sorted) {
+      core[u] = false;
+    }
+    vector<uint32_t> out_degree(n, 0);
+    vector<uint32_t> offsets(n + 1, 0);
+    for (const auto& edge : edges) {
+      if (core[edge.first] && core[edge.second]) {
+	out_degree[edge.first]++;
+	offsets[edge.second + 1]++;
+      }
+    }
+    for (size_t i = 1; i <= n; i++) {
+      offsets[i] += offsets[i - 1];
+    }
+    vector<uint32_t> sources(offsets.back());
+    vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (const auto& edge : edges) {
+      if (core[edge.first] && core[edge.second]) {
+	sources[cursor[edge.second]++] = edge.first;
+      }
+    }
+    vector<uint32_t> peeled;
+    for (uint32_t i = 0; i < n; i++) {
+      if (core[i] && out_degree[i] == 0) {
+	peeled.push_back(i);
+      }
+    }
+    for (size_t head = 0; head < peeled.size(); head++) {
+      uint32_t v = peeled[head];
+      core[v] = false;
+      for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+	if (--out_degree[sources[i]] == 0) {
+	  peeled.push_back(sources[i]);
+	}
+      }
+    }
+    return core;
+  }
+
+  // Rebuilds both caches with one Kahn pass over the live edges.
+  void sort_() {
+    GRAPHS_STATS_OP(kDagSort);
+    std::unordered_map<int, uint32_t> local;
+    vector<const Vertex*> vertices;
+    vector<std::pair<uint32_t, uint32_t>> pairs;
+    auto number = [&local, &vertices](const Vertex* v) {
+      auto inserted = local.emplace(v->value().second, vertices.size());
+      if (inserted.second) {
+	vertices.push_back(v);
+      }
+      return inserted.first->second;
+    };
+    for (const DirectedGraph::EdgeRef& e : directed_graph_.get()->edges()) {
+      uint32_t source = e.get_source() ? number(e.get_source()) : kNoVertex;
+      uint32_t dest = e.get_dest() ? number(e.get_dest()) : kNoVertex;
+      if (source != kNoVertex && dest != kNoVertex) {
+	pairs.emplace_back(source, dest);
+      }
+    }
+    GRAPHS_STATS_SCANNED(pairs.size());
+    vector<uint32_t> order = kahn_order_(vertices.size(), pairs);
+
+    // Walking in order, every predecessor of a vertex is settled before
+    // the vertex pushes its own successors.
+    vector<uint32_t> offsets;
+    vector<uint32_t> targets;
+    by_source_(vertices.size(), pairs, &offsets, &targets);
+    vector<uint32_t> level(vertices.size(), 0);
+    sorted_.clear();
+    sorted_position_.clear();
+    levels_.clear();
+    level_of_.clear();
+    for (uint32_t u : order) {
+      for (uint32_t i = offsets[u]; i < offsets[u + 1]; i++) {
+	level[targets[i]] = std::max(level[targets[i]], level[u] + 1);
+      }
+      int id = vertices[u]->value().second;
+      sorted_position_.emplace(id, sorted_.size());
+      sorted_.push_back(vertices[u]);
+      if (level[u] >= levels_.size()) {
+	levels_.resize(level[u] + 1);
+      }
+      levels_[level[u]].push_back(vertices[u]);
+      level_of_.emplace(id, level[u]);
+    }
+    sorted_valid_ = true;
+    levels_valid_ = true;
+  }
+
+  // Numbers every vertex and indexes the live edges.
+  void build_reach_() {
+    reach_node_.clear();
+    vector<std::pair<uint32_t, uint32_t>> pairs;
+    auto number = [this](const Vertex* v) {
+      return reach_node_.emplace(v->value().second, reach_node_.size()).first->second;
+    };
+    for (const DirectedGraph::EdgeRef& e : directed_graph_.get()->edges()) {
+      uint32_t source = e.get_source() ? number(e.get_source()) : kNoVertex;
+      uint32_t dest = e.get_dest() ? number(e.get_dest()) : kNoVertex;
+      if (source != kNoVertex && dest != kNoVertex) {
+	pairs.emplace_back(source, dest);
+      }
+    }
+    reach_.build(reach_node_.size(), kahn_order_(reach_node_.size(), pairs), pairs);
+    reach_valid_ = true;
+  }
+
+  // Queries the index, which must be valid. A vertex it has not numbered
+  // is new and has no edges yet.
+  bool reaches_(const Vertex* u, const Vertex* v) {
+    if (u->value().second == v->value().second) {
+      return true;
+    }
+    auto from = reach_node_.find(u->value().second);
+    auto to = reach_node_.find(v->value().second);
+    return from != reach_node_.end() && to != reach_node_.end() && reach_.reaches(from->second, to->second);
+  }
+
+  // The index's node for v, added if new; kNoVertex, with the index
+  // dropped, if it cannot take one.
+  uint32_t reach_node_of_(const Vertex* v) {
+    auto it = reach_node_.find(v->value().second);
+    if (it != reach_node_.end()) {
+      return it->second;
+    }
+    uint32_t node = reach_.add_node();
+    if (node == kNoVertex) {
+      reach_valid_ = false;
+      return kNoVertex;
+    }
+    reach_node_.emplace(v->value().second, node);
+    return node;
+  }
+
+  // Records an inserted edge in the index, or drops the index when it
+  // cannot take it.
+  void note_reach_(const Vertex* source, const Vertex* dest) {
+    if (!reach_valid_) {
+      return;
+    }
+    uint32_t u = reach_node_of_(source);
+    uint32_t v = u != kNoVertex ? reach_node_of_(dest) : kNoVertex;
+    if (v == kNoVertex || !reach_.add_edge(u, v)) {
+      reach_valid_ = false;
+    }
+  }
+
+  // A vertex new to the graph has no place in either cache yet.
+  void note_vertex_(const Vertex* v) {
+    if (reach_valid_) {
+      reach_node_of_(v);
+    }
+    if (sorted_valid_ && !sorted_position_.count(v->value().second)) {
+      sorted_valid_ = false;
+    }
+    if (levels_valid_ && !level_of_.count(v->value().second)) {
+      levels_valid_ = false;
+    }
+  }
+
+  // Keeps each cache that already agrees with source -> dest.
+  void note_edge_(const Vertex* source, const Vertex* dest) {
+    auto before = [](const std::unordered_map<int, uint32_t>& rank, const Vertex* u, const Vertex* v) {
+      auto u_rank = rank.find(u->value().second);
+      auto v_rank = rank.find(v->value().second);
+      return u_rank != rank.end() && v_rank != rank.end() && u_rank->second < v_rank->second;
+    };
+    sorted_valid_ = sorted_valid_ && before(sorted_position_, source, dest);
+    levels_valid_ = levels_valid_ && before(level_of_, source, dest);
+  }
+
+  void note_edge_(const Edge* edge) {
+    const Vertex* source = edge->get_source().get();
+    const Vertex* dest = edge->get_dest().get();
+    if (source && dest) {
+      note_edge_(source, dest);
+      note_reach_(source, dest);
+    } else if (source || dest) {
+      note_vertex_(source ? source : dest);
+    }
+  }
+
+  // After a removal, keeps the cached order minus the vertices that left
+  // the graph, which is still an order of what remains. Levels may have
+  // shrunk, so they are dropped.
+  void prune_sorted_() {
+    levels_valid_ = false;
+    if (!sorted_valid_) {
+      return;
+    }
+    size_t kept = 0;
+    for (const Vertex* v : sorted_) {
+      if (directed_graph_.get()->find(v)) {
+	sorted_[kept++] = v;
+      } else {
+	sorted_position_.erase(v->value().second);
+      }
+    }
+    sorted_.resize(kept);
+  }
+
+  static uint64_t id_key_(int source, int dest) {
+    return uint64_t(uint32_t(source)) << 32 | uint32_t(dest);
+  }
+
+  // The (source, dest) ID pairs left without any edge once removals
+  // are made, found in one pass over the graph.
+  vector<std::pair<int, int>> dropped_pairs_(const vector<Edge>& removals) const {
+    struct Doomed {
+      std::pair<int, int> ids;
+      vector<const Value*> values;
+      bool matched = false;
+      bool kept = false;
+    };
+    vector<std::pair<int, int>> dropped;
+    if (removals.empty()) {
+      return dropped;
+    }
+    std::unordered_map<uint64_t, Doomed> doomed;
+    for (const Edge& e : removals) {
+      int source = e.get_source()->value().second;
+      int dest = e.get_dest()->value().second;
+      Doomed& d = doomed[id_key_(source, dest)];
+      d.ids = std::make_pair(source, dest);
+      d.values.push_back(e.value());
+    }
+    GRAPHS_STATS_SCANNED(directed_graph_.get()->edges().size());
+    for (const DirectedGraph::EdgeRef& e : directed_graph_.get()->edges()) {
+      if (!e.get_source() || !e.get_dest()) {
+	continue;
+      }
+      auto it = doomed.find(id_key_(e.get_source()->value().second, e.get_dest()->value().second));
+      if (it == doomed.end()) {
+	continue;
+      }
+      bool match = false;
+      for (const Value* value : it->second.values) {
+	match = match || *value == e.value();
+      }
+      (match ? it->second.matched : it->second.kept) = true;
+    }
+    for (const auto& entry : doomed) {
+      if (entry.second.matched && !entry.second.kept) {
+	dropped.push_back(entry.second.ids);
+      }
+    }
+    return dropped;
+  }
+
+  // Moves order_ to the graph batch would leave: drops the dropped
+  // pairs, then inserts each new edge. On a cycle puts order_ back as it
+  // was, give or take positions, and returns false.
+  bool reorder_for_(const DagBatch& batch, const vector<std::pair<int, int>>& dropped) {
+    vector<std::pair<uint32_t, uint32_t>> removed;
+    for (const auto& pair : dropped) {
+      uint32_t x = order_.find(pair.first);
+      uint32_t y = order_.find(pair.second);
+      if (x == kNoVertex || y == kNoVertex || !order_.remove_edge(x, y)) {
+	continue;
+      }
+      while (order_.remove_edge(x, y)) {}
+      removed.emplace_back(x, y);
+    }
+    vector<std::pair<uint32_t, uint32_t>> added;
+    added.reserve(batch.inserts_.size());
+    for (const EdgeSpec& e : batch.inserts_) {
+      uint32_t x = order_.node(e.source);
+      uint32_t y = order_.node(e.dest);
+      if (!order_.add_edge(x, y)) {
+	for (auto it = added.rbegin(); it != added.rend(); ++it) {
+	  order_.remove_edge(it->first, it->second);
+	}
+	// Edges of the acyclic graph as it was always fit back in.
+	for (const auto& edge : removed) {
+	  order_.add_edge(edge.first, edge.second);
+	}
+	return false;
+      }
+      added.emplace_back(x, y);
+    }
+    return true;
+  }
+
+  // Whether the graph batch would leave is acyclic, by one Kahn pass
+  // over the edges that stay and the inserts.
+  bool acyclic_after_(const DagBatch& batch, const vector<std::pair<int, int>>& dropped) const {
+    std::unordered_set<uint64_t> gone;
+    for (const auto& pair : dropped) {
+      gone.insert(id_key_(pair.first, pair.second));
+    }
+    std::unordered_map<int, uint32_t> local;
+    vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(directed_graph_.get()->edge_count() + batch.inserts_.size());
+    auto number = [&local](int id) {
+      return local.emplace(id, local.size()).first->second;
+    };
+    for (const DirectedGraph::EdgeRef& e : directed_graph_.get()->edges()) {
+      if (e.get_source() && e.get_dest()) {
+	int source = e.get_source()->value().second;
+	int dest = e.get_dest()->value().second;
+	if (!gone.count(id_key_(source, dest))) {
+	  uint32_t u = number(source);
+	  pairs.emplace_back(u, number(dest));
+	}
+      }
+    }
+    for (const EdgeSpec& e : batch.inserts_) {
+      uint32_t u = number(e.source);
+      pairs.emplace_back(u, number(e.dest));
+    }
+    GRAPHS_STATS_SCANNED(pairs.size());
+    return kahn_order_(local.size(), pairs).size() == local.size();
+  }
+
+  // Drops u's edges from the topological order after its removal.
+  void forget_(const Vertex* u) {
+    uint32_t node = order_.find(u->value().second);
+    if (node != kNoVertex) {
+      order_.remove_edges_of(node);
+    }
+  }
 
   bool check_for_cycles_() {
+    GRAPHS_STATS_OP(kDagCheckForCycles);
+    GRAPHS_STATS_SCANNED(directed_graph_.get()->edges().size());
     // Based on http://www.geeksforgeeks.org/detect-cycle-in-a-graph/.
-    std::map<int, Vertex> vertex_ids_to_ptrs;
+    std::map<int, const Vertex*> vertex_ids_to_ptrs;
     std::map<int, bool> recursive_stack;
-    for (const Edge& e : directed_graph_.get()->get_adjacency_list()) {
-      if (e.get_source().get()) {
+    for (const DirectedGraph::EdgeRef& e : directed_graph_.get()->edges()) {
+      if (e.get_source()) {
 	// the second part of a Value is its ID.
-	vertex_ids_to_ptrs.insert(std::pair<int, Vertex>(e.get_source().get()->value().second, *e.get_source().get()));
-	recursive_stack.insert(std::pair<int, bool>(e.get_source().get()->value().second, false));
+	vertex_ids_to_ptrs.insert(std::pair<int, const Vertex*>(e.get_source()->value().second, e.get_source()));
+	recursive_stack.insert(std::pair<int, bool>(e.get_source()->value().second, false));
       }
-      if (e.get_dest().get()) {
-	vertex_ids_to_ptrs.insert(std::pair<int, Vertex>(e.get_dest().get()->value().second, *e.get_dest().get()));
-	recursive_stack.insert(std::pair<int, bool>(e.get_dest().get()->value().second, false));
+      if (e.get_dest()) {
+	vertex_ids_to_ptrs.insert(std::pair<int, const Vertex*>(e.get_dest()->value().second, e.get_dest()));
+	recursive_stack.insert(std::pair<int, bool>(e.get_dest()->value().second, false));
       }
     }
     std::set<int> visited_set;
@@ -78,13 +766,14 @@ class DirectedAcyclicGraph {
     }
     return false;
   }
-  bool cycle_checker_(std::map<int, Vertex>& vertex_id_to_ptrs, int vertex_id, std::set<int>& visited_set, std::map<int, bool>& recursive_stack) {
+  bool cycle_checker_(std::map<int, const Vertex*>& vertex_id_to_ptrs, int vertex_id, std::set<int>& visited_set, std::map<int, bool>& recursive_stack) {
     if (visited_set.find(vertex_id) == visited_set.end()) {
       visited_set.insert(vertex_id);
       recursive_stack[vertex_id] = true;
-      Vertex vtx = vertex_id_to_ptrs[vertex_id];
-      vector<Vertex*> neighbors = directed_graph_.get()->get_neighbors(&vtx);
-      for (Vertex* neighbor : neighbors) {
+      const Vertex* vtx = vertex_id_to_ptrs[vertex_id];
+      // Without the out-edge index the view reads every edge.
+      GRAPHS_STATS_SCANNED(directed_graph_.get()->edges().size());
+      for (Vertex* neighbor : directed_graph_.get()->neighbor_view(vtx)) {
 	int neighbor_id = neighbor->value().second;
 	if (visited_set.find(neighbor_id) == visited_set.end() && cycle_checker_(vertex_id_to_ptrs, neighbor_id, visited_set, recursive_stack)) {
 	  return true;
@@ -1,113 +1,694 @@
-class DirectedGraph {
+// Vertices are interned: the graph keeps one copy of each vertex, keyed
+// by ID, and the first copy added for an ID is the one kept. Edges refer
+// to vertices by 32-bit handle and carry their value inline, so adding an
+// edge copies no vertex.
+//
+// Adjacency tests and neighbor lists scan every edge unless the optional
+// out-edge index is enabled with enable_index(); it is then kept in step
+// with every mutation. Likewise get_predecessors() scans unless the
+// in-edge index is enabled with enable_reverse_index(). in_degree() and
+// out_degree() are counts kept per vertex and need neither.
+//
+// edges() and neighbor_view() are read-only views into the graph's own
+// storage; they copy nothing and stay valid until the next mutation.
+//
+// All of that storage comes from the memory resource given at
+// construction, so a graph built over a std::pmr::monotonic_buffer_resource
+// is allocated from one arena and freed with it in one shot. Strings in
+// vertex and edge Values longer than the small-string buffer still use
+// the global heap. Copies use the default resource.
+//
+// The graph is templated on the payload and ID types of its vertices and
+// edges, and DirectedGraph is the one over (string, int) Values. With
+// NoPayload, a vertex is its ID alone and every stored edge is two
+// handles and that ID, all trivially copyable. IDs are integers no wider
+// than int, as the out-edge index keys on them.
+template<typename Payload, typename Id>
+class BasicDirectedGraph {
+  static_assert(std::is_integral<Id>::value && sizeof(Id) <= sizeof(int), "IDs must fit in an int");
+
+ private:
+  struct EdgeRecord;
+
  public:
-  bool add(const Vertex* v) {
-    Edge edge;
-    edge.set_source(*v);
-    edges_.push_back(edge);
+  using vertex_type = BasicVertex<Payload, Id>;
+  using edge_type = BasicEdge<Payload, Id>;
+  using value_type = typename ValueTraits<Payload, Id>::type;
+  using edge_spec_type = BasicEdgeSpec<Payload, Id>;
+
+  // One stored edge, read in place. Mirrors BasicEdge's getters; an endpoint
+  // that is absent reads as nullptr.
+  class EdgeRef {
+   public:
+    EdgeRef(const BasicDirectedGraph* graph, const EdgeRecord* record) : graph_(graph), record_(record) {}
+    const vertex_type* get_source() const {
+      return record_->source != kNoVertex ? &graph_->vertices_[record_->source] : nullptr;
+    }
+    const vertex_type* get_dest() const {
+      return record_->dest != kNoVertex ? &graph_->vertices_[record_->dest] : nullptr;
+    }
+    const value_type& value() const {
+      return record_->value;
+    }
+
+   private:
+    const BasicDirectedGraph* graph_;
+    const EdgeRecord* record_;
+  };
+
+  // Every stored edge in insertion order, vertices added with add()
+  // included as edges without a dest.
+  class EdgeRange {
+   public:
+    class iterator {
+     public:
+      iterator(const BasicDirectedGraph* graph, const EdgeRecord* record) : graph_(graph), record_(record) {}
+      EdgeRef operator*() const {
+	return EdgeRef(graph_, record_);
+      }
+      iterator& operator++() {
+	++record_;
+	return *this;
+      }
+      bool operator==(const iterator& other) const {
+	return record_ == other.record_;
+      }
+      bool operator!=(const iterator& other) const {
+	return record_ != other.record_;
+      }
+
+     private:
+      const BasicDirectedGraph* graph_;
+      const EdgeRecord* record_;
+    };
+
+    explicit EdgeRange(const BasicDirectedGraph* graph) : graph_(graph) {}
+    iterator begin() const {
+      return iterator(graph_, graph_->edges_.data());
+    }
+    iterator end() const {
+      return iterator(graph_, graph_->edges_.data() + graph_->edges_.size());
+    }
+    EdgeRef operator[](size_t i) const {
+      return EdgeRef(graph_, &graph_->edges_[i]);
+    }
+    size_t size() const {
+      return graph_->edges_.size();
+    }
+    bool empty() const {
+      return graph_->edges_.empty();
+    }
+
+   private:
+    const BasicDirectedGraph* graph_;
+  };
+
+  // The dests of the edges leaving one vertex, one entry per edge. Walks
+  // the out-edge index when it is enabled and the edge list otherwise.
+  class NeighborView {
+   public:
+    class iterator {
+     public:
+      vertex_type* operator*() const {
+	return &graph_->vertices_[scan_ ? record_->dest : *dest_];
+      }
+      iterator& operator++() {
+	if (scan_) {
+	  ++record_;
+	  skip_();
+	} else {
+	  ++dest_;
+	}
+	return *this;
+      }
+      bool operator==(const iterator& other) const {
+	return record_ == other.record_ && dest_ == other.dest_;
+      }
+      bool operator!=(const iterator& other) const {
+	return !(*this == other);
+      }
+
+     private:
+      friend class NeighborView;
+      BasicDirectedGraph* graph_ = nullptr;
+      bool scan_ = false;
+      uint32_t source_ = kNoVertex;
+      const EdgeRecord* record_ = nullptr;
+      const EdgeRecord* end_ = nullptr;
+      const uint32_t* dest_ = nullptr;
+
+      // Advances to the next edge out of source_.
+      void skip_() {
+	while (record_ != end_ && (record_->source != source_ || record_->dest == kNoVertex)) {
+	  ++record_;
+	}
+      }
+    };
+
+    NeighborView(BasicDirectedGraph* graph, uint32_t source) : graph_(graph), source_(source) {}
+    iterator begin() const {
+      return make_iterator_(false);
+    }
+    iterator end() const {
+      return make_iterator_(true);
+    }
+    size_t size() const {
+      if (source_ != kNoVertex && graph_->indexed_) {
+	return graph_->index_.dests(source_).size();
+      }
+      size_t n = 0;
+      for (iterator it = begin(); it != end(); ++it) {
+	n++;
+      }
+      return n;
+    }
+    bool empty() const {
+      return !(begin() != end());
+    }
+
+   private:
+    BasicDirectedGraph* graph_;
+    uint32_t source_;
+
+    iterator make_iterator_(bool at_end) const {
+      iterator it;
+      it.graph_ = graph_;
+      it.source_ = source_;
+      if (source_ == kNoVertex) {
+	return it;
+      }
+      if (graph_->indexed_) {
+	Span<const uint32_t> dests = graph_->index_.dests(source_);
+	it.dest_ = at_end ? dests.end() : dests.begin();
+	return it;
+      }
+      it.scan_ = true;
+      it.end_ = graph_->edges_.data() + graph_->edges_.size();
+      it.record_ = at_end ? it.end_ : graph_->edges_.data();
+      it.skip_();
+      return it;
+    }
+  };
+
+  BasicDirectedGraph() : BasicDirectedGraph(std::pmr::get_default_resource()) {}
+  // resource must outlive the graph.
+  explicit BasicDirectedGraph(std::pmr::memory_resource* resource)
+    : vertices_(resource), refs_(resource), in_degree_(resource), out_degree_(resource), free_handles_(resource),
+      handles_(resource), edges_(resource), index_(resource), reverse_index_(resource) {}
+
+  std::pmr::memory_resource* resource() const {
+    return edges_.get_allocator().resource();
+  }
+
+  void enable_index() {
+    if (indexed_) {
+      return;
+    }
+    indexed_ = true;
+    for (const EdgeRecord& r : edges_) {
+      index_edge_(r);
+    }
+  }
+
+  void disable_index() {
+    indexed_ = false;
+    index_ = AdjacencyIndex(resource());
+  }
+
+  bool indexed() const {
+    return indexed_;
+  }
+
+  void enable_reverse_index() {
+    if (reverse_indexed_) {
+      return;
+    }
+    reverse_indexed_ = true;
+    for (const EdgeRecord& r : edges_) {
+      reverse_index_edge_(r);
+    }
+  }
+
+  void disable_reverse_index() {
+    reverse_indexed_ = false;
+    reverse_index_ = AdjacencyIndex(resource());
+  }
+
+  bool reverse_indexed() const {
+    return reverse_indexed_;
+  }
+
+  bool add(const vertex_type* v) {
+    GRAPHS_STATS_OP(kGraphAdd);
+    push_edge_(EdgeRecord{intern_(*v), kNoVertex, ValueTraits<Payload, Id>::dummy()});
+    return true;
+  }
+
+  bool add_edge(const vertex_type* u, const vertex_type* v) {
+    GRAPHS_STATS_OP(kGraphAddEdge);
+    push_edge_(EdgeRecord{intern_(*u), intern_(*v), ValueTraits<Payload, Id>::dummy()});
     return true;
-  } 
+  }
 
-  bool add_edge(const Vertex* u, const Vertex* v) {
-    Edge edge;
-    edge.set_source(*u);
-    edge.set_dest(*v);
-    edges_.push_back(edge);
+  bool add_edge(const edge_type* e) {
+    GRAPHS_STATS_OP(kGraphAddEdge);
+    EdgeRecord record{kNoVertex, kNoVertex, e->value() ? *e->value() : ValueTraits<Payload, Id>::dummy()};
+    if (e->get_source()) {
+      record.source = intern_(*e->get_source().get());
+    }
+    if (e->get_dest()) {
+      record.dest = intern_(*e->get_dest().get());
+    }
+    push_edge_(std::move(record));
     return true;
   }
 
-  bool add_edge(const Edge* e) {
-    edges_.push_back(*e);
+  bool remove_edge(const edge_type* e) {
+    GRAPHS_STATS_OP(kGraphRemoveEdge);
+    // Only an edge with both endpoints and a value can match another.
+    if (!e->get_source() || !e->get_dest() || !e->value()) {
+      return true;
+    }
+    uint32_t source = find_(e->get_source().get());
+    uint32_t dest = find_(e->get_dest().get());
+    if (source == kNoVertex || dest == kNoVertex) {
+      return true;
+    }
+    const value_type& value = *e->value();
+    erase_edges_([&](const EdgeRecord& r) {
+	return r.source == source && r.dest == dest && r.value == value;
+      });
     return true;
   }
 
-  bool remove_edge(const Edge* e) {
-    edges_.erase(std::remove(edges_.begin(), edges_.end(), *e), edges_.end());
+  // Adds edges in bulk, with endpoints given by ID, reserving storage
+  // once up front. vertices supplies the values of vertices not yet in
+  // the graph; any of them left without an edge is added on its own, as
+  // add() would. An ID found in neither gets the name "DUMMY".
+  bool add_edges(Span<const edge_spec_type> edges, Span<const vertex_type> vertices = Span<const vertex_type>()) {
+    GRAPHS_STATS_OP(kGraphAddEdges);
+    // Grow geometrically, so that many small calls stay linear overall.
+    size_t records = edges_.size() + edges.size() + vertices.size();
+    if (records > edges_.capacity()) {
+      edges_.reserve(std::max(records, 2 * edges_.capacity()));
+    }
+    size_t ids = handles_.size() + vertices.size();
+    if (ids > handles_.bucket_count() * handles_.max_load_factor()) {
+      handles_.reserve(std::max<size_t>(ids, 2 * handles_.size()));
+    }
+    for (const vertex_type& v : vertices) {
+      intern_(v);
+    }
+    auto handle = [this](Id id) {
+      auto it = handles_.find(id);
+      return it != handles_.end() ? it->second : intern_(vertex_type(ValueTraits<Payload, Id>::dummy(id)));
+    };
+    for (const edge_spec_type& e : edges) {
+      uint32_t source = handle(e.source);
+      push_edge_(EdgeRecord{source, handle(e.dest), e.value});
+    }
+    for (const vertex_type& v : vertices) {
+      uint32_t h = find_(&v);
+      if (refs_[h] == 0) {
+	push_edge_(EdgeRecord{h, kNoVertex, ValueTraits<Payload, Id>::dummy()});
+      }
+    }
     return true;
   }
 
-  bool are_adjacent(const Vertex* u, const Vertex* v) {
-    for (const Edge& e : edges_) {
-      if (e.get_source().get() && *(e.get_source().get()) == *u) {
-	if (e.get_dest().get() && *(e.get_dest().get()) == *v) {
-	  return true;
+  // Removes every edge matching one of edges, as remove_edge() would,
+  // in a single pass over the graph.
+  void remove_edges(Span<const edge_type* const> edges) {
+    GRAPHS_STATS_OP(kGraphRemoveEdge);
+    // (source, dest) handles -> values of the edges to drop between them.
+    std::unordered_map<uint64_t, vector<const value_type*>> doomed;
+    for (const edge_type* e : edges) {
+      if (!e->get_source() || !e->get_dest() || !e->value()) {
+	continue;
+      }
+      uint32_t source = find_(e->get_source().get());
+      uint32_t dest = find_(e->get_dest().get());
+      if (source != kNoVertex && dest != kNoVertex) {
+	doomed[edge_key_(source, dest)].push_back(e->value());
+      }
+    }
+    if (doomed.empty()) {
+      return;
+    }
+    erase_edges_([&](const EdgeRecord& r) {
+	if (r.source == kNoVertex || r.dest == kNoVertex) {
+	  return false;
+	}
+	auto it = doomed.find(edge_key_(r.source, r.dest));
+	if (it == doomed.end()) {
+	  return false;
+	}
+	for (const value_type* value : it->second) {
+	  if (*value == r.value) {
+	    return true;
+	  }
 	}
+	return false;
+      });
+  }
+
+  bool are_adjacent(const vertex_type* u, const vertex_type* v) {
+    GRAPHS_STATS_OP(kGraphAreAdjacent);
+    uint32_t source = find_(u);
+    if (source == kNoVertex) {
+      return false;
+    }
+    if (indexed_) {
+      return index_.contains(source, v->id());
+    }
+    uint32_t dest = find_(v);
+    if (dest == kNoVertex) {
+      return false;
+    }
+    for (size_t i = 0; i < edges_.size(); i++) {
+      if (edges_[i].source == source && edges_[i].dest == dest) {
+	GRAPHS_STATS_SCANNED(i + 1);
+	return true;
       }
     }
+    GRAPHS_STATS_SCANNED(edges_.size());
     return false;
   }
 
   int edge_count() const {
-    int num_edges = 0;
-    for (const Edge& e : edges_) {
-      // An Edge is considered a "true" edge only if it has both a
-      // source and a destination.
-      if (e.get_source() && e.get_dest()) {
-	num_edges++;
+    return num_edges_;
+  }
+
+  vector<edge_type> get_adjacency_list() {
+    GRAPHS_STATS_OP(kGraphGetAdjacencyList);
+    vector<edge_type> edges;
+    edges.reserve(edges_.size());
+    for (const EdgeRecord& r : edges_) {
+      GRAPHS_STATS_ALLOCATED(1 + (r.source != kNoVertex) + (r.dest != kNoVertex));
+      edges.emplace_back(r.source != kNoVertex ? std::make_unique<vertex_type>(vertices_[r.source]) : nullptr,
+			 r.dest != kNoVertex ? std::make_unique<vertex_type>(vertices_[r.dest]) : nullptr,
+			 std::make_unique<value_type>(r.value));
+    }
+    return edges;
+  }
+
+  CsrGraph freeze() const {
+    GRAPHS_STATS_OP(kGraphFreeze);
+    GRAPHS_STATS_SCANNED(edges_.size());
+    // Hand over only the vertices some edge still refers to.
+    vector<uint32_t> position(vertices_.size(), kNoVertex);
+    vector<const vertex_type*> live;
+    auto visit = [&](uint32_t h) {
+      if (h != kNoVertex && position[h] == kNoVertex) {
+	position[h] = live.size();
+	live.push_back(&vertices_[h]);
+      }
+    };
+    vector<std::pair<uint32_t, uint32_t>> edges;
+    for (const EdgeRecord& r : edges_) {
+      visit(r.source);
+      visit(r.dest);
+      if (r.source != kNoVertex && r.dest != kNoVertex) {
+	edges.emplace_back(position[r.source], position[r.dest]);
       }
     }
-    return num_edges;
+    return CsrGraph(live, edges);
   }
 
-  vector<Edge> get_adjacency_list() {
-    return edges_;
+  EdgeRange edges() const {
+    return EdgeRange(this);
   }
 
-  vector<Vertex*> get_neighbors(Vertex* vertex) {
-    vector<Vertex*> neighbors;
-    for (const Edge& e : edges_) {
-      if (e.get_source().get() && *(e.get_source().get()) == *vertex) {
-	if (e.get_dest().get()) {
-	  neighbors.push_back(e.get_dest().get());
-	}
-      }
+  vector<vertex_type*> get_neighbors(vertex_type* vertex) {
+    GRAPHS_STATS_OP(kGraphGetNeighbors);
+    vector<vertex_type*> neighbors;
+    for (vertex_type* neighbor : neighbor_view(vertex)) {
+      neighbors.push_back(neighbor);
     }
+    // The index hands over the list; without it every edge is read.
+    GRAPHS_STATS_SCANNED(indexed_ ? neighbors.size() : edges_.size());
     return neighbors;
   }
 
-  void remove(const Vertex* v) {
-    for (Edge& e : edges_) {
-      if (e.get_source().get() && *(e.get_source().get()) == *v) {
-	// Remove the edge: if the source is gone, the edge to the dest
-	// is no longer needed.
-	auto it = std::find(edges_.begin(), edges_.end(), e);
-	if (it != edges_.end()) {
-	  edges_.erase(it);
-	}
+  NeighborView neighbor_view(const vertex_type* vertex) {
+    return NeighborView(this, find_(vertex));
+  }
+
+  // The sources of the edges into vertex, one entry per edge. Read from
+  // the in-edge index when it is enabled and the edge list otherwise.
+  vector<vertex_type*> get_predecessors(vertex_type* vertex) {
+    GRAPHS_STATS_OP(kGraphGetPredecessors);
+    vector<vertex_type*> predecessors;
+    uint32_t dest = find_(vertex);
+    if (dest == kNoVertex) {
+      return predecessors;
+    }
+    predecessors.reserve(in_degree_[dest]);
+    if (reverse_indexed_) {
+      for (uint32_t source : reverse_index_.dests(dest)) {
+	predecessors.push_back(&vertices_[source]);
+      }
+      GRAPHS_STATS_SCANNED(predecessors.size());
+      return predecessors;
+    }
+    for (const EdgeRecord& r : edges_) {
+      if (r.dest == dest && r.source != kNoVertex) {
+	predecessors.push_back(&vertices_[r.source]);
       }
     }
+    GRAPHS_STATS_SCANNED(edges_.size());
+    return predecessors;
   }
 
-  string to_string() const {
-    string str_value = "Graph (# vertices = " + std::to_string(vertex_count()) + "):\n";
-    for (const Edge& e : edges_) {
-      str_value += e.to_string() + "\n";
+  // Number of edges into and out of v; 0 if v is not in the graph.
+  int in_degree(const vertex_type* v) const {
+    uint32_t h = find_(v);
+    return h != kNoVertex ? in_degree_[h] : 0;
+  }
+
+  int out_degree(const vertex_type* v) const {
+    uint32_t h = find_(v);
+    return h != kNoVertex ? out_degree_[h] : 0;
+  }
+
+  // Removes v with every edge into or out of it.
+  void remove(const vertex_type* v) {
+    GRAPHS_STATS_OP(kGraphRemove);
+    uint32_t h = find_(v);
+    if (h == kNoVertex) {
+      return;
+    }
+    erase_edges_([h](const EdgeRecord& r) {
+	return r.source == h || r.dest == h;
+      });
+  }
+
+  // Removes each of vertices with every edge into or out of it, in a
+  // single pass over the graph.
+  void remove_vertices(Span<const vertex_type* const> vertices) {
+    GRAPHS_STATS_OP(kGraphRemove);
+    vector<bool> doomed(vertices_.size(), false);
+    bool any = false;
+    for (const vertex_type* v : vertices) {
+      uint32_t h = find_(v);
+      if (h != kNoVertex) {
+	doomed[h] = true;
+	any = true;
+      }
+    }
+    if (!any) {
+      return;
     }
-    return str_value;
+    erase_edges_([&doomed](const EdgeRecord& r) {
+	return (r.source != kNoVertex && doomed[r.source]) || (r.dest != kNoVertex && doomed[r.dest]);
+      });
+  }
+
+  string to_string() const {
+    return graph_lib::graph_to_string(*this);
   }
 
-  Vertex* top() {
-    for (const Edge& e : edges_) {
-      if (e.get_source().get()) {
-	return e.get_source().get();
+  vertex_type* top() {
+    for (const EdgeRecord& r : edges_) {
+      if (r.source != kNoVertex) {
+	return &vertices_[r.source];
       }
     }
     return nullptr;
   }
-  
+
+  // The graph's copy of the vertex with v's ID, or nullptr if absent.
+  vertex_type* find(const vertex_type* v) {
+    uint32_t h = find_(v);
+    return h != kNoVertex ? &vertices_[h] : nullptr;
+  }
+
   int vertex_count() const {
-    std::set<int> vertex_ids;
-    for (const Edge& e : edges_) {
-      if (e.get_source().get()) {
-	// second part of a Value is its ID
-	vertex_ids.insert(e.get_source().get()->value().second);
+    // A vertex is dropped from the table when no edge refers to it.
+    return handles_.size();
+  }
+
+ private:
+  // One stored edge. A record without a dest holds a vertex added on
+  // its own with add().
+  struct EdgeRecord {
+    uint32_t source;
+    uint32_t dest;
+    value_type value;
+  };
+
+  // Indexed by handle. A deque keeps vertex_type* handed out by top() and
+  // get_neighbors() valid while the table grows; they last until their
+  // vertex leaves the graph, after which its slot may be reused.
+  std::pmr::deque<vertex_type> vertices_;
+  // Number of edge records naming each handle as source or dest.
+  std::pmr::vector<uint32_t> refs_;
+  // Per handle, the edges with both ends that lead in and out.
+  std::pmr::vector<uint32_t> in_degree_;
+  std::pmr::vector<uint32_t> out_degree_;
+  std::pmr::vector<uint32_t> free_handles_;
+  // vertex_type ID -> handle, for live vertices only.
+  std::pmr::unordered_map<Id, uint32_t> handles_;
+  std::pmr::vector<EdgeRecord> edges_;
+  // Records with both a source and a dest.
+  int num_edges_ = 0;
+  bool indexed_ = false;
+  AdjacencyIndex index_;
+  // The same over reversed edges: per dest, its sources keyed by ID.
+  bool reverse_indexed_ = false;
+  AdjacencyIndex reverse_index_;
+
+  uint32_t intern_(const vertex_type& v) {
+    auto it = handles_.find(v.id());
+    if (it != handles_.end()) {
+      return it->second;
+    }
+    uint32_t h;
+    if (!free_handles_.empty()) {
+      h = free_handles_.back();
+      free_handles_.pop_back();
+      vertices_[h] = v;
+    } else {
+      h = vertices_.size();
+      vertices_.push_back(v);
+      GRAPHS_STATS_ALLOCATED(1);
+      refs_.push_back(0);
+      in_degree_.push_back(0);
+      out_degree_.push_back(0);
+    }
+    handles_.emplace(v.id(), h);
+    return h;
+  }
+
+  void retain_(uint32_t h) {
+    if (h != kNoVertex) {
+      refs_[h]++;
+    }
+  }
+
+  void release_(uint32_t h) {
+    if (h != kNoVertex && --refs_[h] == 0) {
+      handles_.erase(vertices_[h].id());
+      free_handles_.push_back(h);
+    }
+  }
+
+  void push_edge_(EdgeRecord&& r) {
+    retain_(r.source);
+    retain_(r.dest);
+    if (r.source != kNoVertex && r.dest != kNoVertex) {
+      // An edge is considered a "true" edge only if it has both a
+      // source and a destination.
+      num_edges_++;
+      out_degree_[r.source]++;
+      in_degree_[r.dest]++;
+    }
+    edges_.push_back(std::move(r));
+    index_edge_(edges_.back());
+    reverse_index_edge_(edges_.back());
+  }
+
+  // Drops the records matching pred, compacting edges_ in one pass, and
+  // returns how many went. Sources (and, for the in-edge index, dests)
+  // that lost an edge get their index entries rebuilt in a second pass.
+  template<typename Pred>
+  size_t erase_edges_(Pred pred) {
+    GRAPHS_STATS_SCANNED(edges_.size());
+    vector<bool> touched(indexed_ ? vertices_.size() : 0, false);
+    vector<bool> touched_dests(reverse_indexed_ ? vertices_.size() : 0, false);
+    size_t kept = 0;
+    for (size_t i = 0; i < edges_.size(); i++) {
+      EdgeRecord& r = edges_[i];
+      if (pred(r)) {
+	if (r.source != kNoVertex && r.dest != kNoVertex) {
+	  num_edges_--;
+	  out_degree_[r.source]--;
+	  in_degree_[r.dest]--;
+	  if (indexed_) {
+	    touched[r.source] = true;
+	  }
+	  if (reverse_indexed_) {
+	    touched_dests[r.dest] = true;
+	  }
+	}
+	release_(r.source);
+	release_(r.dest);
+      } else {
+	if (kept != i) {
+	  edges_[kept] = std::move(r);
+	}
+	kept++;
       }
-      if (e.get_dest().get()) {
-	vertex_ids.insert(e.get_dest().get()->value().second);
+    }
+    size_t removed = edges_.size() - kept;
+    edges_.erase(edges_.begin() + kept, edges_.end());
+    if (indexed_ && removed > 0) {
+      for (uint32_t h = 0; h < touched.size(); h++) {
+	if (touched[h]) {
+	  index_.clear(h);
+	}
+      }
+      for (const EdgeRecord& r : edges_) {
+	if (r.source != kNoVertex && touched[r.source]) {
+	  index_edge_(r);
+	}
+      }
+    }
+    if (reverse_indexed_ && removed > 0) {
+      for (uint32_t h = 0; h < touched_dests.size(); h++) {
+	if (touched_dests[h]) {
+	  reverse_index_.clear(h);
+	}
+      }
+      for (const EdgeRecord& r : edges_) {
+	if (r.dest != kNoVertex && touched_dests[r.dest]) {
+	  reverse_index_edge_(r);
+	}
       }
     }
-    return vertex_ids.size();
+    return removed;
   }
 
- private:
-  vector<Edge> edges_;
+  static uint64_t edge_key_(uint32_t source, uint32_t dest) {
+    return uint64_t(source) << 32 | dest;
+  }
+
+  void index_edge_(const EdgeRecord& r) {
+    if (indexed_ && r.source != kNoVertex && r.dest != kNoVertex) {
+      index_.add_edge(r.source, r.dest, vertices_[r.dest].id());
+    }
+  }
+
+  void reverse_index_edge_(const EdgeRecord& r) {
+    if (reverse_indexed_ && r.source != kNoVertex && r.dest != kNoVertex) {
+      reverse_index_.add_edge(r.dest, r.source, vertices_[r.source].id());
+    }
+  }
+
+  uint32_t find_(const vertex_type* v) const {
+    auto it = handles_.find(v->id());
+    return it != handles_.end() ? it->second : kNoVertex;
+  }
 };
+
+using DirectedGraph = BasicDirectedGraph<string, int>;
@@ -0,0 +1,171 @@
+// Text edge lists, one edge per line:
+//
+//   src_name src_id dst_name dst_id [weight]
+//
+// Fields are separated by spaces or tabs; IDs and the weight are decimal
+// ints. The weight becomes the second part of the edge's Value, as the
+// weighted searches read it, and an edge without one gets kDummyValue.
+// Blank lines and lines starting with '#' are skipped. As with add_edge(),
+// the first name seen for an ID is the one kept.
+//
+// load_edge_list() maps the file and parse_edge_list() splits the text
+// into chunks on line boundaries, parses them in parallel on a pool, and
+// hands the lot to DirectedGraph::add_edges() in file order.
+namespace graph_lib {
+  // What one chunk of text parses to.
+  struct EdgeListChunk {
+    vector<EdgeSpec> edges;
+    // The first name in the chunk for each ID, in order of appearance.
+    vector<Vertex> vertices;
+    size_t lines = 0;
+    // 1-based within the chunk, or 0 if every line parsed.
+    size_t bad_line = 0;
+  };
+
+  void parse_edge_list_chunk_(const char* begin, const char* end, EdgeListChunk* chunk) {
+    std::unordered_set<int> named;
+    auto blank = [](char c) {
+      return c == ' ' || c == '\t' || c == '\r';
+    };
+    const char* p = begin;
+    while (p < end) {
+      const char* eol = std::find(p, end, '\n');
+      chunk->lines++;
+      const char* q = p;
+      auto skip = [&]() {
+	while (q < eol && blank(*q)) {
+	  q++;
+	}
+      };
+      auto token = [&](std::string_view* out) {
+	skip();
+	const char* start = q;
+	while (q < eol && !blank(*q)) {
+	  q++;
+	}
+	*out = std::string_view(start, q - start);
+	return q > start;
+      };
+      auto number = [&](int* out) {
+	skip();
+	std::from_chars_result result = std::from_chars(q, eol, *out);
+	if (result.ec != std::errc() || result.ptr == q || (result.ptr < eol && !blank(*result.ptr))) {
+	  return false;
+	}
+	q = result.ptr;
+	return true;
+      };
+
+      skip();
+      if (q < eol && *q != '#') {
+	std::string_view names[2];
+	int ids[2];
+	int weight = kDummyValue.second;
+	bool ok = token(&names[0]) && number(&ids[0]) && token(&names[1]) && number(&ids[1]);
+	skip();
+	if (ok && q < eol) {
+	  ok = number(&weight);
+	  skip();
+	}
+	if (!ok || q < eol) {
+	  chunk->bad_line = chunk->lines;
+	  return;
+	}
+	for (int i = 0; i < 2; i++) {
+	  if (named.insert(ids[i]).second) {
+	    chunk->vertices.emplace_back(Value(string(names[i]), ids[i]));
+	  }
+	}
+	chunk->edges.push_back(EdgeSpec{ids[0], ids[1], Value(kDummyValue.first, weight)});
+      }
+      p = eol + 1;
+    }
+  }
+
+  // Adds the edges listed in text to graph. Returns false, leaving graph
+  // untouched, if a line is malformed; bad_line, if given, then gets its
+  // 1-based number.
+  bool parse_edge_list(std::string_view text, DirectedGraph* graph, ThreadPool& pool, size_t* bad_line = nullptr) {
+    // One chunk per thread, each at least kMinChunk bytes, cut just after
+    // a newline. Every chunk lists the vertices it names and add_edges()
+    // interns each list in turn, so more chunks than threads would only
+    // add to that serial step.
+    const size_t kMinChunk = 1 << 16;
+    size_t target = std::max<size_t>(1, std::min(pool.size() + 1, text.size() / kMinChunk));
+    vector<size_t> cuts = {0};
+    for (size_t k = 1; k < target; k++) {
+      size_t at = std::max(cuts.back(), text.size() * k / target);
+      size_t newline = text.find('\n', at);
+      if (newline == std::string_view::npos) {
+	break;
+      }
+      cuts.push_back(newline + 1);
+    }
+    cuts.push_back(text.size());
+
+    vector<EdgeListChunk> chunks(cuts.size() - 1);
+    pool.parallel_for(chunks.size(), [&](size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) {
+	  parse_edge_list_chunk_(text.data() + cuts[i], text.data() + cuts[i + 1], &chunks[i]);
+	}
+      });
+
+    size_t lines = 0;
+    size_t num_edges = 0;
+    size_t num_vertices = 0;
+    for (const EdgeListChunk& chunk : chunks) {
+      if (chunk.bad_line) {
+	if (bad_line) {
+	  *bad_line = lines + chunk.bad_line;
+	}
+	return false;
+      }
+      lines += chunk.lines;
+      num_edges += chunk.edges.size();
+      num_vertices += chunk.vertices.size();
+    }
+    vector<EdgeSpec> edges;
+    vector<Vertex> vertices;
+    edges.reserve(num_edges);
+    vertices.reserve(num_vertices);
+    for (EdgeListChunk& chunk : chunks) {
+      std::move(chunk.edges.begin(), chunk.edges.end(), std::back_inserter(edges));
+      std::move(chunk.vertices.begin(), chunk.vertices.end(), std::back_inserter(vertices));
+      chunk = EdgeListChunk();
+    }
+    return graph->add_edges(edges, vertices);
+  }
+
+  // Maps the file at path and parses it as parse_edge_list() does.
+  // Returns false, leaving graph untouched, if the file cannot be read or
+  // a line is malformed; bad_line then gets 0 or the line's number.
+  bool load_edge_list(const string& path, DirectedGraph* graph, ThreadPool& pool, size_t* bad_line = nullptr) {
+    if (bad_line) {
+      *bad_line = 0;
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+      close(fd);
+      return true;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      return false;
+    }
+    // Each chunk is read front to back.
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    bool ok = parse_edge_list(std::string_view(static_cast<const char*>(mapping), size), graph, pool, bad_line);
+    munmap(mapping, size);
+    return ok;
+  }
+}
@@ -0,0 +1,123 @@
+// Runs a task for every vertex of a DirectedAcyclicGraph on a
+// WorkStealingPool, each as soon as the tasks of all its predecessors
+// have finished. A run numbers the vertices by the DAG's cached
+// topological order and lays its edges out by source once, so releasing
+// the successors of a finished vertex is one atomic decrement per edge,
+// with no neighbor lookups.
+class DagExecutor {
+ public:
+  explicit DagExecutor(WorkStealingPool& pool) : pool_(pool) {}
+
+  // Calls task on every vertex and returns once no task is running. The
+  // DAG must not change meanwhile, and run must not be called from one
+  // of the pool's workers. Returns false if the run was cancelled; tasks
+  // already started then finish, and no other task starts.
+  bool run(DirectedAcyclicGraph& dag, const std::function<void(const Vertex*)>& task) {
+    cancelled_.store(false);
+    const vector<const Vertex*>& order = dag.topological_order();
+    if (order.empty()) {
+      return true;
+    }
+    std::unordered_map<int, uint32_t> position;
+    position.reserve(order.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+      position.emplace(order[i]->value().second, i);
+    }
+
+    Run run(order, task);
+    run.offsets.assign(order.size() + 1, 0);
+    for (const DirectedGraph::EdgeRef& e : dag.edges()) {
+      if (e.get_source() && e.get_dest()) {
+	run.offsets[position[e.get_source()->value().second] + 1]++;
+      }
+    }
+    for (size_t i = 1; i < run.offsets.size(); i++) {
+      run.offsets[i] += run.offsets[i - 1];
+    }
+    run.targets.resize(run.offsets.back());
+    run.pending.reset(new std::atomic<uint32_t>[order.size()]());
+    vector<uint32_t> cursor(run.offsets.begin(), run.offsets.end() - 1);
+    for (const DirectedGraph::EdgeRef& e : dag.edges()) {
+      if (e.get_source() && e.get_dest()) {
+	uint32_t dest = position[e.get_dest()->value().second];
+	run.targets[cursor[position[e.get_source()->value().second]]++] = dest;
+	run.pending[dest].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    // Count the roots before submitting any, since a root's task may
+    // finish, and the run with it, while the rest are still going in.
+    vector<uint32_t> roots;
+    for (uint32_t v = 0; v < order.size(); v++) {
+      if (run.pending[v].load(std::memory_order_relaxed) == 0) {
+	roots.push_back(v);
+      }
+    }
+    run.outstanding.store(roots.size());
+    for (uint32_t v : roots) {
+      submit_(run, v);
+    }
+    std::unique_lock<std::mutex> lock(run.mutex);
+    run.idle.wait(lock, [&run]() {
+	return run.done;
+      });
+    return run.finished.load() == order.size();
+  }
+
+  // Stops the run in progress. Safe to call from any thread, tasks
+  // included.
+  void cancel() {
+    cancelled_.store(true);
+  }
+
+ private:
+  // The state of one run, shared by its tasks.
+  struct Run {
+    Run(const vector<const Vertex*>& order, const std::function<void(const Vertex*)>& task)
+      : order(order), task(task) {}
+    const vector<const Vertex*>& order;
+    const std::function<void(const Vertex*)>& task;
+    // Successors of position v are targets[offsets[v], offsets[v + 1]).
+    vector<uint32_t> offsets;
+    vector<uint32_t> targets;
+    // Predecessors of each position whose tasks have not finished.
+    unique_ptr<std::atomic<uint32_t>[]> pending;
+    // Tasks submitted to the pool and not yet returned.
+    std::atomic<size_t> outstanding{0};
+    std::atomic<size_t> finished{0};
+    std::mutex mutex;
+    std::condition_variable idle;
+    bool done = false;
+  };
+
+  WorkStealingPool& pool_;
+  std::atomic<bool> cancelled_{false};
+
+  void submit_(Run& run, uint32_t v) {
+    pool_.submit([this, &run, v]() {
+	execute_(run, v);
+      });
+  }
+
+  void execute_(Run& run, uint32_t v) {
+    if (!cancelled_.load()) {
+      run.task(run.order[v]);
+      run.finished.fetch_add(1);
+      for (uint32_t i = run.offsets[v]; i < run.offsets[v + 1]; i++) {
+	// The last predecessor to finish releases the successor; acq_rel
+	// makes every predecessor's work visible to it.
+	if (run.pending[run.targets[i]].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+	  run.outstanding.fetch_add(1);
+	  submit_(run, run.targets[i]);
+	}
+      }
+    }
+    // Successors were submitted above, so outstanding only reaches zero
+    // once nothing is left to run.
+    if (run.outstanding.fetch_sub(1) == 1) {
+      std::lock_guard<std::mutex> lock(run.mutex);
+      run.done = true;
+      run.idle.notify_one();
+    }
+  }
+};
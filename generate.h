@@ -0,0 +1,72 @@
+// Synthetic inputs for tests and benchmarks, as edge lists for
+// add_edges() over vertex IDs 0..n-1. Each generator is deterministic
+// for a given seed.
+namespace graph_lib {
+  // m edges with both ends drawn uniformly from n vertices.
+  vector<EdgeSpec> random_graph(int n, size_t m, uint64_t seed = 1) {
+    std::mt19937_64 random(seed);
+    std::uniform_int_distribution<int> vertex(0, n - 1);
+    vector<EdgeSpec> edges;
+    edges.reserve(m);
+    for (size_t i = 0; i < m; i++) {
+      int source = vertex(random);
+      edges.push_back(EdgeSpec{source, vertex(random), kDummyValue});
+    }
+    return edges;
+  }
+
+  // m edges over 2^scale vertices with a power-law degree distribution,
+  // after Chakrabarti, Zhan & Faloutsos, "R-MAT: A Recursive Model for
+  // Graph Mining" (2004). Every edge picks one quadrant of the adjacency
+  // matrix per bit, with probabilities a, b, c and 1 - a - b - c.
+  vector<EdgeSpec> rmat_graph(int scale, size_t m, uint64_t seed = 1, double a = 0.57, double b = 0.19,
+			      double c = 0.19) {
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> coin(0, 1);
+    vector<EdgeSpec> edges;
+    edges.reserve(m);
+    for (size_t i = 0; i < m; i++) {
+      int source = 0;
+      int dest = 0;
+      for (int bit = 0; bit < scale; bit++) {
+	double p = coin(random);
+	source = source << 1 | (p >= a + b);
+	dest = dest << 1 | ((p >= a && p < a + b) || p >= a + b + c);
+      }
+      edges.push_back(EdgeSpec{source, dest, kDummyValue});
+    }
+    return edges;
+  }
+
+  // A DAG of layers vertices deep and width wide, where every vertex but
+  // those in the last layer has fanout edges into the next one. Vertex
+  // IDs grow layer by layer, so every edge goes to a larger ID.
+  vector<EdgeSpec> layered_dag(int layers, int width, int fanout, uint64_t seed = 1) {
+    std::mt19937_64 random(seed);
+    std::uniform_int_distribution<int> column(0, width - 1);
+    vector<EdgeSpec> edges;
+    edges.reserve(size_t(std::max(layers - 1, 0)) * width * fanout);
+    for (int layer = 0; layer + 1 < layers; layer++) {
+      for (int i = 0; i < width; i++) {
+	for (int k = 0; k < fanout; k++) {
+	  edges.push_back(EdgeSpec{layer * width + i, (layer + 1) * width + column(random), kDummyValue});
+	}
+      }
+    }
+    return edges;
+  }
+
+  // A tree on n vertices rooted at 0 in which the parent of vertex i is
+  // one of the span vertices just before it, so it is about n / span
+  // levels deep. Edges come parent first, in ID order.
+  vector<EdgeSpec> deep_tree(int n, int span = 2, uint64_t seed = 1) {
+    std::mt19937_64 random(seed);
+    vector<EdgeSpec> edges;
+    edges.reserve(std::max(n - 1, 0));
+    for (int i = 1; i < n; i++) {
+      int back = std::uniform_int_distribution<int>(1, std::min(i, span))(random);
+      edges.push_back(EdgeSpec{i - back, i, kDummyValue});
+    }
+    return edges;
+  }
+}
@@ -1,23 +1,141 @@
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <numeric>
+#include <random>
 #include <set>
 #include <sstream>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 using std::ostringstream; 
 using std::string;
 using std::unique_ptr;
 using std::vector;
+// An empty payload, for vertices and edges that carry nothing but an ID.
+struct NoPayload {};
+
+// What a vertex or edge with the given payload and ID types stores: a
+// (payload, ID) pair, or the ID alone for NoPayload, so that such a
+// vertex is the size of its ID and trivially copyable.
+template<typename Payload, typename Id>
+struct ValueTraits {
+  using type = std::pair<Payload, Id>;
+  static Id id(const type& value) {
+    return value.second;
+  }
+  // The value given to vertices known only by ID, and to edges added
+  // without one.
+  static type dummy(Id id = Id(-1)) {
+    if constexpr (std::is_same<Payload, string>::value) {
+      return type("DUMMY", id);
+    } else {
+      return type(Payload(), id);
+    }
+  }
+  static string to_string(const type& value) {
+    ostringstream oss;
+    oss << "(" << value.first << ", " << value.second << ")";
+    return oss.str();
+  }
+};
+
+template<typename Id>
+struct ValueTraits<NoPayload, Id> {
+  using type = Id;
+  static Id id(type value) {
+    return value;
+  }
+  static type dummy(Id id = Id(-1)) {
+    return id;
+  }
+  static string to_string(type value) {
+    return "(" + std::to_string(value) + ")";
+  }
+};
+
 using Value = std::pair<string, int>;
 
 const Value kDummyValue = std::pair<string, int>("DUMMY", -1);
 
+// One edge for bulk loading: its endpoints by vertex ID, and its value.
+template<typename Payload, typename Id>
+struct BasicEdgeSpec {
+  Id source;
+  Id dest;
+  typename ValueTraits<Payload, Id>::type value;
+};
+
+using EdgeSpec = BasicEdgeSpec<string, int>;
+
+// Marks a missing vertex wherever a graph hands out dense vertex
+// indices (positions in its own storage) rather than vertex IDs.
+const uint32_t kNoVertex = UINT32_MAX;
+
 // Forward-declarations.
-class Edge;
-class Vertex;
+class CsrGraph;
+template<typename Payload, typename Id>
+class BasicEdge;
+template<typename Payload, typename Id>
+class BasicVertex;
+using Edge = BasicEdge<string, int>;
+using Vertex = BasicVertex<string, int>;
+
+// A non-owning view over a contiguous run of elements.
+template<typename T>
+class Span {
+ public:
+  Span() : data_(nullptr), size_(0) {}
+  Span(T* data, size_t size) : data_(data), size_(size) {}
+  // Views any contiguous container with data() and size().
+  template<typename C, typename = decltype(std::declval<C&>().data())>
+  Span(C&& c) : data_(c.data()), size_(c.size()) {}
+  T* begin() const {
+    return data_;
+  }
+  T* end() const {
+    return data_ + size_;
+  }
+  T& operator[](size_t i) const {
+    return data_[i];
+  }
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+
+ private:
+  T* data_;
+  size_t size_;
+};
 
 // Concept definitions.
 template<typename S>
@@ -25,17 +143,21 @@ concept bool Stringable = requires(S s) {
   { s.to_string() } -> string;
 };
 
+// What a pointer-like P points at.
+template<typename P>
+using pointee_t = std::remove_cv_t<std::remove_reference_t<decltype(*std::declval<P>())>>;
+
 template<typename V>
-concept bool Vertex_ptr = requires(V v, Value w) {
-  { *v } -> const Vertex&;
-  { v->value() } -> Value&;
+concept bool Vertex_ptr = requires(V v, typename pointee_t<V>::value_type w) {
+  { *v } -> const BasicVertex<typename pointee_t<V>::payload_type, typename pointee_t<V>::id_type>&;
+  { v->value() } -> typename pointee_t<V>::value_type&;
   { v->set_value(w) } -> void;
 };
 
 template<typename E>
-concept bool Edge_ptr = requires(E e, Value v) {
-  { *e } -> const Edge&;
-  { e->value() } -> Value*;
+concept bool Edge_ptr = requires(E e, typename pointee_t<E>::value_type v) {
+  { *e } -> const BasicEdge<typename pointee_t<E>::payload_type, typename pointee_t<E>::id_type>&;
+  { e->value() } -> typename pointee_t<E>::value_type*;
   { e->set_value(v) } -> void;
 };
 
@@ -51,11 +173,18 @@ concept bool Graph =
   { g.are_adjacent(u, v) } -> bool;
   { g.edge_count() } -> int;
   { g.get_neighbors(u) } -> std::vector<V>;
+  { g.get_predecessors(u) } -> std::vector<V>;
+  { g.in_degree(u) } -> int;
+  { g.out_degree(u) } -> int;
   { g.remove(u) } -> void;
   { g.top() } -> V;
   { g.vertex_count() } -> int;
 };
 
+// A Graph over the vertices and edges of one payload and ID type.
+template<typename G, typename Payload, typename Id>
+concept bool BasicGraph = Graph<G, BasicVertex<Payload, Id>*, BasicEdge<Payload, Id>*>;
+
 // Library functions using concepts.
 namespace graph_lib {
   bool adjacent(Graph<Vertex*, Edge*>&& g, const Vertex_ptr& u, const Vertex_ptr& v) {
@@ -65,6 +194,29 @@ namespace graph_lib {
   vector<Vertex*> neighbors(Graph<Vertex*, Edge*>& g, Vertex_ptr x) {
     return g.get_neighbors(x);
   }
+
+  // The sources of the edges into x.
+  vector<Vertex*> predecessors(Graph<Vertex*, Edge*>& g, Vertex_ptr x) {
+    return g.get_predecessors(x);
+  }
+
+  int in_degree(Graph<Vertex*, Edge*>& g, Vertex_ptr x) {
+    return g.in_degree(x);
+  }
+
+  int out_degree(Graph<Vertex*, Edge*>& g, Vertex_ptr x) {
+    return g.out_degree(x);
+  }
+
+  // Like neighbors(), but a view into g that allocates nothing.
+  auto neighbor_view(Graph<Vertex*, Edge*>& g, Vertex_ptr x) {
+    return g.neighbor_view(x);
+  }
+
+  // Every stored edge of g, read in place.
+  auto edges(Graph<Vertex*, Edge*>& g) {
+    return g.edges();
+  }
   
   bool add(Graph<Vertex*, Edge*>& g, Vertex_ptr x) {
     return g.add(x);
@@ -82,7 +234,7 @@ namespace graph_lib {
     return g.add_edge(x);
   }
 
-  Value value(Vertex_ptr x) {
+  auto value(Vertex_ptr x) {
     return x->value();
   }
 
@@ -90,7 +242,7 @@ namespace graph_lib {
     x->set_value(v);
   }
 
-  Value value(Edge_ptr e) {
+  auto value(Edge_ptr e) {
     return *e->value();
   }
 
@@ -102,75 +254,86 @@ namespace graph_lib {
     return g.top();
   }
   
-  void print(Graph<Vertex*, Edge*> g) {
-    std::cout << g.to_string() << "\n";
-  }
-  
-  int count_vertices(Graph<Vertex*, Edge*> g) {
+  int count_vertices(Graph<Vertex*, Edge*>& g) {
     return g.vertex_count();
   }
 
-  int count_edges(Graph<Vertex*, Edge*> g) {
+  int count_edges(Graph<Vertex*, Edge*>& g) {
     return g.edge_count();
   }
+
+  auto freeze(Graph<Vertex*, Edge*>& g) {
+    return g.freeze();
+  }
 }
 
 // Class definitions.
-class Vertex {
+//
+// Vertices are told apart by ID alone: two vertices with the same ID are
+// equal whatever their payloads.
+template<typename Payload, typename Id>
+class BasicVertex {
  public:
-  Vertex() {
-    value_ = std::pair<string, int>("DUMMY", -1);
-  }
-  Vertex(const Vertex& vertex) : value_(vertex.value_) {}
-  Vertex(const Value value) : value_(value) {}
-  bool operator==(const Vertex& other) const {
-    if (this == &other) {
-      return true;
-    }
-    return this->value_ == other.value_;
+  using payload_type = Payload;
+  using id_type = Id;
+  using value_type = typename ValueTraits<Payload, Id>::type;
+
+  BasicVertex() : value_(ValueTraits<Payload, Id>::dummy()) {}
+  BasicVertex(const BasicVertex& vertex) = default;
+  BasicVertex(const value_type value) : value_(value) {}
+  BasicVertex& operator=(const BasicVertex& vertex) = default;
+  bool operator==(const BasicVertex& other) const {
+    return id() == other.id();
   }
-  bool operator!=(const Vertex& other) const {
-    if (this == &other) {
-      return false;
-    }
-    return this->value_ != other.value_;
+  bool operator!=(const BasicVertex& other) const {
+    return id() != other.id();
   }
   string to_string() const {
-    ostringstream oss;
-    oss << "(" << this->value_.first << ", " << this->value_.second << ")";
-    return oss.str();
+    return ValueTraits<Payload, Id>::to_string(value_);
   }
-  Value& value() {
+  Id id() const {
+    return ValueTraits<Payload, Id>::id(value_);
+  }
+  value_type& value() {
+    return value_;
+  }
+  const value_type& value() const {
     return value_;
   }
-  void set_value(Value& value) {
+  void set_value(value_type& value) {
     value_ = value;
   }
 
  private:
-  Value value_;
+  value_type value_;
 };
 
-class Edge {
+template<typename Payload, typename Id>
+class BasicEdge {
  public:
-  Edge() {}
-  Edge(unique_ptr<Vertex> source, unique_ptr<Vertex> dest, unique_ptr<Value> value) noexcept
+  using payload_type = Payload;
+  using id_type = Id;
+  using value_type = typename ValueTraits<Payload, Id>::type;
+  using vertex_type = BasicVertex<Payload, Id>;
+
+  BasicEdge() {}
+  BasicEdge(unique_ptr<vertex_type> source, unique_ptr<vertex_type> dest, unique_ptr<value_type> value) noexcept
     : source_(std::move(source)), dest_(std::move(dest)), value_(std::move(value)) {}
-  Edge(Edge&& edge) noexcept
+  BasicEdge(BasicEdge&& edge) noexcept
     : source_(std::move(edge.source_)), dest_(std::move(edge.dest_)), value_(std::move(edge.value_)) {}
-  Edge(const Edge &edge) noexcept { 
+  BasicEdge(const BasicEdge &edge) noexcept { 
     if (edge.source_) {
-      source_ = std::make_unique<Vertex>(*(edge.source_.get()));
+      source_ = std::make_unique<vertex_type>(*(edge.source_.get()));
     }
     if (edge.dest_) {
-      dest_ = std::make_unique<Vertex>(*(edge.dest_.get()));
+      dest_ = std::make_unique<vertex_type>(*(edge.dest_.get()));
     }
     if (edge.value_) {
-      value_ = std::make_unique<Value>(*(edge.value_.get()));
+      value_ = std::make_unique<value_type>(*(edge.value_.get()));
     }
   }
-  ~Edge() noexcept {}
-  Edge& operator=(Edge &&edge) noexcept {
+  ~BasicEdge() noexcept {}
+  BasicEdge& operator=(BasicEdge &&edge) noexcept {
     if (this != &edge) {
       source_ = std::move(edge.source_);
       dest_ = std::move(edge.dest_);
@@ -178,8 +341,8 @@ class Edge {
     }
     return *this;
   }
-  Edge& operator=(const Edge&) noexcept = delete;
-  bool operator==(const Edge& other) const {
+  BasicEdge& operator=(const BasicEdge&) noexcept = delete;
+  bool operator==(const BasicEdge& other) const {
     if (this == &other) {
       return true;
     }
@@ -193,12 +356,12 @@ class Edge {
     return false;
   }
 
-  void set_source(const Vertex& v) {
-    source_ = std::make_unique<Vertex>(v);
+  void set_source(const vertex_type& v) {
+    source_ = std::make_unique<vertex_type>(v);
   }
 
-  void set_dest(const Vertex& v) {
-    dest_ = std::make_unique<Vertex>(v);
+  void set_dest(const vertex_type& v) {
+    dest_ = std::make_unique<vertex_type>(v);
   }
   
   string to_string() const {
@@ -218,24 +381,28 @@ class Edge {
     return oss.str();
   }
 
-  const unique_ptr<Vertex>& get_source() const {
+  const unique_ptr<vertex_type>& get_source() const {
     return source_;
   }
 
-  const unique_ptr<Vertex>& get_dest() const {
+  const unique_ptr<vertex_type>& get_dest() const {
     return dest_;
   }
 
-  Value* value() {
+  value_type* value() {
+    return value_.get();
+  }
+
+  const value_type* value() const {
     return value_.get();
   }
 
-  void set_value(Value& value) {
-    value_ = std::make_unique<Value>(value);
+  void set_value(value_type& value) {
+    value_ = std::make_unique<value_type>(value);
   }
 
  private:
-  unique_ptr<Vertex> source_;
-  unique_ptr<Vertex> dest_;
-  unique_ptr<Value> value_ = std::make_unique<Value>(kDummyValue);
+  unique_ptr<vertex_type> source_;
+  unique_ptr<vertex_type> dest_;
+  unique_ptr<value_type> value_ = std::make_unique<value_type>(ValueTraits<Payload, Id>::dummy());
 };
@@ -0,0 +1,150 @@
+// Per-vertex out-edge index for a mutable graph. For every source handle
+// it keeps the dest handles in insertion order, one entry per edge, and
+// an open-addressing hash table from dest ID (the second part of its
+// Value) to the number of edges to that dest. Adjacency tests are then a
+// probe into one small table and neighbor lists need no scan. Storage
+// comes from the memory resource given at construction. Fed reversed
+// edges, it serves as an in-edge index the same way.
+class AdjacencyIndex {
+ public:
+  explicit AdjacencyIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : out_(resource) {}
+
+  void add_edge(uint32_t source, uint32_t dest, int dest_id) {
+    OutEdges& out = out_edges_(source);
+    out.dests.push_back(dest);
+    Slot& slot = claim_(out, dest_id);
+    slot.count++;
+  }
+
+  // Forgets every edge leaving source, keeping its storage for reuse.
+  void clear(uint32_t source) {
+    if (source < out_.size()) {
+      OutEdges& out = out_[source];
+      out.dests.clear();
+      out.slots.clear();
+      out.used = 0;
+    }
+  }
+
+  bool contains(uint32_t source, int dest_id) const {
+    if (source >= out_.size()) {
+      return false;
+    }
+    const Slot* slot = find_(out_[source], dest_id);
+    return slot && slot->count > 0;
+  }
+
+  // Dest handles of the edges leaving source, in insertion order.
+  Span<const uint32_t> dests(uint32_t source) const {
+    if (source >= out_.size()) {
+      return Span<const uint32_t>();
+    }
+    return Span<const uint32_t>(out_[source].dests.data(), out_[source].dests.size());
+  }
+
+ private:
+  static const uint32_t kEmptySlot = UINT32_MAX;
+
+  // Counts only grow. Removing edges clears a source's row with clear()
+  // and adds back the edges that are left, so no slot is ever deleted.
+  struct Slot {
+    int id;
+    uint32_t count;
+  };
+
+  // Allocator-aware, so that out_ hands its resource down.
+  struct OutEdges {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    OutEdges(const allocator_type& alloc = allocator_type()) : dests(alloc), slots(alloc) {}
+    OutEdges(const OutEdges& other, const allocator_type& alloc)
+      : dests(other.dests, alloc), slots(other.slots, alloc), used(other.used) {}
+    OutEdges(OutEdges&& other, const allocator_type& alloc)
+      : dests(std::move(other.dests), alloc), slots(std::move(other.slots), alloc), used(other.used) {}
+    std::pmr::vector<uint32_t> dests;
+    // Size is zero or a power of two.
+    std::pmr::vector<Slot> slots;
+    uint32_t used = 0;
+  };
+
+  std::pmr::vector<OutEdges> out_;
+
+  OutEdges& out_edges_(uint32_t source) {
+    if (source >= out_.size()) {
+      out_.resize(source + 1);
+    }
+    return out_[source];
+  }
+
+  static uint32_t hash_(int id) {
+    // Fold the high bits down so that IDs sharing low bits still spread.
+    uint32_t h = uint32_t(id) * 0x9E3779B1u;
+    return h ^ (h >> 16);
+  }
+
+  static Slot* find_(OutEdges& out, int id) {
+    return const_cast<Slot*>(find_(static_cast<const OutEdges&>(out), id));
+  }
+
+  static const Slot* find_(const OutEdges& out, int id) {
+    if (out.slots.empty()) {
+      return nullptr;
+    }
+    size_t mask = out.slots.size() - 1;
+    for (size_t i = hash_(id) & mask; ; i = (i + 1) & mask) {
+      const Slot& slot = out.slots[i];
+      if (slot.count == kEmptySlot) {
+	return nullptr;
+      }
+      if (slot.id == id) {
+	return &slot;
+      }
+    }
+  }
+
+  // The slot for id, inserting it with a zero count if absent.
+  static Slot& claim_(OutEdges& out, int id) {
+    Slot* slot = find_(out, id);
+    if (slot) {
+      return *slot;
+    }
+    // Keep the table at most half full.
+    if (2 * (out.used + 1) > out.slots.size()) {
+      rehash_(out);
+    }
+    size_t mask = out.slots.size() - 1;
+    size_t i = hash_(id) & mask;
+    while (out.slots[i].count != kEmptySlot) {
+      i = (i + 1) & mask;
+    }
+    out.slots[i] = Slot{id, 0};
+    out.used++;
+    return out.slots[i];
+  }
+
+  static void rehash_(OutEdges& out) {
+    uint32_t live = 0;
+    for (const Slot& slot : out.slots) {
+      if (slot.count != kEmptySlot && slot.count > 0) {
+	live++;
+      }
+    }
+    size_t size = 4;
+    while (size < 4 * size_t(live + 1)) {
+      size *= 2;
+    }
+    std::pmr::vector<Slot> old(std::move(out.slots));
+    out.slots.assign(size, Slot{0, kEmptySlot});
+    out.used = 0;
+    size_t mask = size - 1;
+    for (const Slot& slot : old) {
+      if (slot.count != kEmptySlot && slot.count > 0) {
+	size_t i = hash_(slot.id) & mask;
+	while (out.slots[i].count != kEmptySlot) {
+	  i = (i + 1) & mask;
+	}
+	out.slots[i] = slot;
+	out.used++;
+      }
+    }
+  }
+};
@@ -0,0 +1,273 @@
+// Sorted-set intersection over rows of dense indices, and the analytics
+// built on it: common neighbors, Jaccard similarity and triangle counts.
+//
+// Inputs are sorted but may repeat values, as CSR rows do for parallel
+// edges; a value counts once however often it repeats. The vector kernels
+// compare a block of one input against every rotation of a block of the
+// other, after Lemire, Boytsov & Kurz, "SIMD Compression and the
+// Intersection of Sorted Integers" (2016). The widest kernel the CPU
+// supports is picked at run time, so no build flags are needed.
+namespace graph_lib {
+  enum class IntersectKernel {
+    kScalar,
+    kAvx2,
+    kAvx512,
+  };
+
+  bool intersect_kernel_supported(IntersectKernel kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    switch (kernel) {
+    case IntersectKernel::kAvx2:
+      return __builtin_cpu_supports("avx2");
+    case IntersectKernel::kAvx512:
+      return __builtin_cpu_supports("avx512f");
+    default:
+      return true;
+    }
+#else
+    return kernel == IntersectKernel::kScalar;
+#endif
+  }
+
+  IntersectKernel best_intersect_kernel() {
+    static const IntersectKernel best = intersect_kernel_supported(IntersectKernel::kAvx512) ? IntersectKernel::kAvx512
+      : intersect_kernel_supported(IntersectKernel::kAvx2) ? IntersectKernel::kAvx2 : IntersectKernel::kScalar;
+    return best;
+  }
+
+  // Merges a[i..] with b[j..], where the vector loop left off. found has
+  // bit k set for each a[i + k] it already matched.
+  size_t intersect_tail_(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, size_t i, size_t j,
+			 uint32_t found, uint32_t* out) {
+    size_t count = 0;
+    for (size_t k = i; k < na; k++) {
+      uint32_t x = a[k];
+      if (k > 0 && a[k - 1] == x) {
+	continue;
+      }
+      bool matched = k - i < 32 && (found >> (k - i) & 1);
+      if (!matched) {
+	if (j == nb) {
+	  if (k - i >= 32) {
+	    break;
+	  }
+	  continue;
+	}
+	while (j < nb && b[j] < x) {
+	  j++;
+	}
+	matched = j < nb && b[j] == x;
+      }
+      if (matched) {
+	if (out) {
+	  out[count] = x;
+	}
+	count++;
+      }
+    }
+    return count;
+  }
+
+  // Emits the values of the a block at i whose bit is set in matched.
+  size_t intersect_flush_(const uint32_t* a, size_t i, uint32_t matched, uint32_t* out) {
+    size_t count = __builtin_popcount(matched);
+    if (out) {
+      for (; matched; matched &= matched - 1) {
+	*out++ = a[i + __builtin_ctz(matched)];
+      }
+    }
+    return count;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // An a block stays current while b blocks stream past it; its matches
+  // pile up in found until it is passed. A value repeated from the lane
+  // before it is dropped then, so that repeats count once.
+  __attribute__((target("avx2")))
+  size_t intersect_avx2_(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    const size_t kLanes = 8;
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    const __m256i shift = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    uint32_t found = 0;
+    uint32_t previous = na > 0 ? ~a[0] : 0;
+    while (i + kLanes <= na && j + kLanes <= nb) {
+      __m256i av = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i bv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+      __m256i hits = _mm256_cmpeq_epi32(av, bv);
+      for (size_t r = 1; r < kLanes; r++) {
+	bv = _mm256_permutevar8x32_epi32(bv, rotate);
+	hits = _mm256_or_si256(hits, _mm256_cmpeq_epi32(av, bv));
+      }
+      found |= _mm256_movemask_ps(_mm256_castsi256_ps(hits));
+      uint32_t a_last = a[i + kLanes - 1];
+      uint32_t b_last = b[j + kLanes - 1];
+      if (a_last <= b_last) {
+	__m256i before = _mm256_blend_epi32(_mm256_permutevar8x32_epi32(av, shift), _mm256_set1_epi32(previous), 1);
+	uint32_t repeats = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(av, before)));
+	count += intersect_flush_(a, i, found & ~repeats, out ? out + count : nullptr);
+	previous = a_last;
+	found = 0;
+	i += kLanes;
+      }
+      if (b_last <= a_last) {
+	j += kLanes;
+      }
+    }
+    return count + intersect_tail_(a, na, b, nb, i, j, found, out ? out + count : nullptr);
+  }
+
+  __attribute__((target("avx512f")))
+  size_t intersect_avx512_(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+    const size_t kLanes = 16;
+    const __m512i rotate = _mm512_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0);
+    const __m512i shift = _mm512_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14);
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    uint32_t found = 0;
+    uint32_t previous = na > 0 ? ~a[0] : 0;
+    while (i + kLanes <= na && j + kLanes <= nb) {
+      __m512i av = _mm512_loadu_si512(a + i);
+      __m512i bv = _mm512_loadu_si512(b + j);
+      __mmask16 hits = _mm512_cmpeq_epi32_mask(av, bv);
+      for (size_t r = 1; r < kLanes; r++) {
+	bv = _mm512_mask_permutexvar_epi32(bv, 0xFFFF, rotate, bv);
+	hits |= _mm512_cmpeq_epi32_mask(av, bv);
+      }
+      found |= hits;
+      uint32_t a_last = a[i + kLanes - 1];
+      uint32_t b_last = b[j + kLanes - 1];
+      if (a_last <= b_last) {
+	__m512i before = _mm512_mask_permutexvar_epi32(_mm512_set1_epi32(previous), 0xFFFE, shift, av);
+	uint32_t repeats = _mm512_cmpeq_epi32_mask(av, before);
+	count += intersect_flush_(a, i, found & ~repeats, out ? out + count : nullptr);
+	previous = a_last;
+	found = 0;
+	i += kLanes;
+      }
+      if (b_last <= a_last) {
+	j += kLanes;
+      }
+    }
+    return count + intersect_tail_(a, na, b, nb, i, j, found, out ? out + count : nullptr);
+  }
+#endif
+
+  // Number of values in both a and b, and with out those values in
+  // order; out needs room for min(a.size(), b.size()). A kernel the CPU
+  // lacks falls back to the scalar one.
+  size_t intersect(Span<const uint32_t> a, Span<const uint32_t> b, uint32_t* out = nullptr,
+		   IntersectKernel kernel = best_intersect_kernel()) {
+    if (a.empty() || b.empty() || (kernel != best_intersect_kernel() && !intersect_kernel_supported(kernel))) {
+      kernel = IntersectKernel::kScalar;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == IntersectKernel::kAvx512) {
+      return intersect_avx512_(a.begin(), a.size(), b.begin(), b.size(), out);
+    }
+    if (kernel == IntersectKernel::kAvx2) {
+      return intersect_avx2_(a.begin(), a.size(), b.begin(), b.size(), out);
+    }
+#endif
+    return intersect_tail_(a.begin(), a.size(), b.begin(), b.size(), 0, 0, 0, out);
+  }
+
+  // Number of vertices both u and v (dense indices) have an edge to.
+  size_t common_neighbors(const CsrGraph& g, uint32_t u, uint32_t v) {
+    return intersect(g.neighbors(u), g.neighbors(v));
+  }
+
+  // |N(u) & N(v)| / |N(u) | N(v)| over out-neighbors, or 0 if neither
+  // vertex has any.
+  double jaccard(const CsrGraph& g, uint32_t u, uint32_t v) {
+    auto distinct = [](Span<const uint32_t> row) {
+      size_t n = 0;
+      for (size_t i = 0; i < row.size(); i++) {
+	n += i == 0 || row[i] != row[i - 1];
+      }
+      return n;
+    };
+    size_t both = common_neighbors(g, u, v);
+    size_t either = distinct(g.neighbors(u)) + distinct(g.neighbors(v)) - both;
+    return either > 0 ? double(both) / either : 0;
+  }
+
+  // Number of triangles in g taken as an undirected simple graph: edge
+  // directions, repeats and self-loops are ignored.
+  //
+  // Every edge is kept once, pointing from the end of lower degree to the
+  // other, so each triangle is found exactly once, from its lowest vertex,
+  // as an intersection of two of these short rows.
+  uint64_t count_triangles(const CsrGraph& g, ThreadPool& pool) {
+    const size_t n = g.vertex_count();
+    if (n == 0) {
+      return 0;
+    }
+    // Undirected neighbors of v in order, without v itself.
+    auto for_each_neighbor = [&g](uint32_t v, auto visit) {
+      Span<const uint32_t> out = g.neighbors(v);
+      Span<const uint32_t> in = g.in_neighbors(v);
+      size_t i = 0;
+      size_t j = 0;
+      uint32_t last = kNoVertex;
+      while (i < out.size() || j < in.size()) {
+	uint32_t w = j == in.size() || (i < out.size() && out[i] < in[j]) ? out[i++] : in[j++];
+	if (w != last && w != v) {
+	  visit(w);
+	}
+	last = w;
+      }
+    };
+    vector<uint32_t> degree(n);
+    pool.parallel_for(n, [&](size_t begin, size_t end) {
+	for (uint32_t v = begin; v < end; v++) {
+	  for_each_neighbor(v, [&degree, v](uint32_t) {
+	      degree[v]++;
+	    });
+	}
+      });
+    auto forward = [&degree](uint32_t v, uint32_t w) {
+      return degree[v] < degree[w] || (degree[v] == degree[w] && v < w);
+    };
+
+    vector<uint64_t> offsets(n + 1, 0);
+    pool.parallel_for(n, [&](size_t begin, size_t end) {
+	for (uint32_t v = begin; v < end; v++) {
+	  for_each_neighbor(v, [&, v](uint32_t w) {
+	      offsets[v + 1] += forward(v, w);
+	    });
+	}
+      });
+    for (size_t i = 1; i <= n; i++) {
+      offsets[i] += offsets[i - 1];
+    }
+    vector<uint32_t> targets(offsets[n]);
+    pool.parallel_for(n, [&](size_t begin, size_t end) {
+	for (uint32_t v = begin; v < end; v++) {
+	  uint64_t k = offsets[v];
+	  for_each_neighbor(v, [&, v](uint32_t w) {
+	      if (forward(v, w)) {
+		targets[k++] = w;
+	      }
+	    });
+	}
+      });
+
+    std::atomic<uint64_t> triangles(0);
+    pool.parallel_for(n, [&](size_t begin, size_t end) {
+	uint64_t found = 0;
+	for (uint32_t v = begin; v < end; v++) {
+	  Span<const uint32_t> row(targets.data() + offsets[v], offsets[v + 1] - offsets[v]);
+	  for (uint32_t w : row) {
+	    found += intersect(row, Span<const uint32_t>(targets.data() + offsets[w], offsets[w + 1] - offsets[w]));
+	  }
+	}
+	triangles.fetch_add(found, std::memory_order_relaxed);
+      });
+    return triangles.load();
+  }
+}
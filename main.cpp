@@ -3,9 +3,28 @@
 #include <typeinfo>
 #include <vector>
 #include "graphs.h"
+#include "stats.h"
+#include "writer.h"
+#include "csr.h"
+#include "compressed.h"
+#include "snapshot.h"
+#include "index.h"
 #include "dg.h"
+#include "topo.h"
+#include "reach.h"
 #include "dag.h"
 #include "tree.h"
+#include "concurrent.h"
+#include "pool.h"
+#include "traverse.h"
+#include "scc.h"
+#include "intersect.h"
+#include "executor.h"
+#include "paths.h"
+#include "overlay.h"
+#include "sharded.h"
+#include "generate.h"
+#include "edgelist.h"
 
 using std::cout;
 using std::make_pair;
@@ -339,7 +358,28 @@ void test_remove() {
   assert(*(adj_list[0]).get_source() == v2);
   assert(*(adj_list[1]).get_source() == v3);
 
-  // Tree removal incomplete.
+  // Removing a vertex from a tree takes its subtree with it.
+  Vertex v4(make_pair("D", 4));
+  Tree tree;
+  tree.add_edge(&v1, &v2);
+  tree.add_edge(&v1, &v3);
+  tree.add_edge(&v2, &v4);
+  assert(graph_lib::count_vertices(tree) == 4);
+  graph_lib::remove(tree, &v2);
+  assert(graph_lib::count_vertices(tree) == 2);
+  assert(graph_lib::count_edges(tree) == 1);
+  adj_list = tree.get_adjacency_list();
+  assert(adj_list.size() == 1);
+  assert(*(adj_list[0]).get_source() == v1);
+  assert(*(adj_list[0]).get_dest() == v3);
+  assert(!tree.find(&v4));
+  // The freed vertices can come back anywhere.
+  assert(tree.add_edge(&v3, &v4));
+  assert(tree.parent(&v4)->value() == v3.value());
+  graph_lib::remove(tree, &v1);
+  assert(graph_lib::count_vertices(tree) == 0);
+  assert(!graph_lib::top(tree));
+  assert(tree.add(&v2));
 }
 
 void test_value() {
@@ -428,6 +468,1910 @@ void test_top() {
   assert(v1 == *graph_lib::top(tree));
 }
 
+void test_freeze() {
+  DirectedGraph dg;
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 7));
+  dg.add(&v4);
+  dg.add_edge(&v1, &v3);
+  dg.add_edge(&v1, &v2);
+  dg.add_edge(&v2, &v3);
+
+  CsrGraph csr = graph_lib::freeze(dg);
+  assert(graph_lib::count_vertices(csr) == 4);
+  assert(graph_lib::count_edges(csr) == 3);
+  assert(graph_lib::adjacent(csr, &v1, &v2));
+  assert(graph_lib::adjacent(csr, &v1, &v3));
+  assert(graph_lib::adjacent(csr, &v2, &v3));
+  assert(!graph_lib::adjacent(csr, &v3, &v1));
+  assert(!graph_lib::adjacent(csr, &v4, &v1));
+  assert(graph_lib::neighbors(csr, &v1).size() == 2);
+  assert(graph_lib::neighbors(csr, &v4).size() == 0);
+  assert(v1 == *graph_lib::top(csr));
+
+  // Neighbor runs are sorted by ID regardless of insertion order.
+  Span<const uint32_t> row = csr.neighbors(csr.index_of(&v1));
+  assert(row.size() == 2);
+  assert(*csr.vertex(row[0]) == v2);
+  assert(*csr.vertex(row[1]) == v3);
+  assert(csr.index_of(5) == kNoVertex);
+
+  // A frozen graph refuses mutation.
+  assert(!graph_lib::add_edge(csr, &v3, &v1));
+  assert(!graph_lib::add(csr, &v4));
+  graph_lib::remove(csr, &v1);
+  assert(graph_lib::count_edges(csr) == 3);
+
+  DirectedAcyclicGraph dag;
+  dag.add_edge(&v1, &v2);
+  dag.add_edge(&v2, &v3);
+  CsrGraph frozen_dag = dag.freeze();
+  assert(frozen_dag.vertex_count() == 3);
+  assert(frozen_dag.are_adjacent(&v2, &v3));
+}
+
+void test_interned_vertices() {
+  DirectedGraph dg;
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  dg.add_edge(&v1, &v3);
+  dg.add_edge(&v2, &v3);
+
+  // Both edges share the graph's single copy of v3.
+  vector<Vertex*> from_v1 = dg.get_neighbors(&v1);
+  vector<Vertex*> from_v2 = dg.get_neighbors(&v2);
+  assert(from_v1.size() == 1 && from_v2.size() == 1);
+  assert(from_v1[0] == from_v2[0]);
+  assert(*from_v1[0] == v3);
+
+  // Vertices are identified by ID; the first copy seen is kept.
+  Vertex renamed(make_pair("Z", 3));
+  dg.add_edge(&renamed, &v1);
+  assert(dg.vertex_count() == 3);
+  assert(dg.are_adjacent(&v3, &v1));
+  assert(*dg.get_neighbors(&v2)[0] == v3);
+
+  // Edge values are kept per edge.
+  Edge e(std::make_unique<Vertex>(v1), std::make_unique<Vertex>(v2), std::make_unique<Value>(make_pair("w", 5)));
+  dg.add_edge(&e);
+  vector<Edge> adj_list = dg.get_adjacency_list();
+  assert(adj_list.size() == 4);
+  assert(*adj_list[3].value() == make_pair(string("w"), 5));
+  dg.remove_edge(&e);
+  assert(dg.edge_count() == 3);
+}
+
+void test_incremental_cycle_check() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+
+  for (CycleCheck mode : {CycleCheck::kIncremental, CycleCheck::kFull}) {
+    DirectedAcyclicGraph dag(mode);
+    // Insert out of order so that 2 -> 3 has to move 1 and 2 ahead of
+    // 3 and 4.
+    assert(dag.add_edge(&v3, &v4));
+    assert(dag.add_edge(&v1, &v2));
+    assert(dag.add_edge(&v2, &v3));
+    assert(!dag.add_edge(&v4, &v1));
+    assert(!dag.add_edge(&v3, &v2));
+    assert(!dag.add_edge(&v4, &v4));
+    assert(dag.add_edge(&v1, &v4));
+    assert(dag.edge_count() == 4);
+
+    Edge e(std::make_unique<Vertex>(v4), std::make_unique<Vertex>(v2), std::make_unique<Value>(kDummyValue));
+    assert(!dag.add_edge(&e));
+    assert(dag.edge_count() == 4);
+
+    // Once 2's edges are gone, 4 -> 2 no longer closes a cycle.
+    dag.remove(&v2);
+    assert(dag.add_edge(&e));
+    assert(dag.edge_count() == 3);
+  }
+
+  TopologicalOrder order;
+  uint32_t n3 = order.node(3), n4 = order.node(4), n1 = order.node(1), n2 = order.node(2);
+  assert(order.add_edge(n3, n4));
+  assert(order.add_edge(n1, n2));
+  assert(order.add_edge(n2, n3));
+  assert(order.position(n1) < order.position(n2));
+  assert(order.position(n2) < order.position(n3));
+  assert(order.position(n3) < order.position(n4));
+}
+
+void test_adjacency_index() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+
+  DirectedGraph dg;
+  dg.add_edge(&v1, &v2);
+  dg.enable_index();
+  assert(dg.indexed());
+  assert(dg.are_adjacent(&v1, &v2));
+
+  dg.add(&v4);
+  dg.add_edge(&v1, &v3);
+  dg.add_edge(&v1, &v3);
+  dg.add_edge(&v2, &v3);
+  assert(dg.are_adjacent(&v1, &v3));
+  assert(!dg.are_adjacent(&v3, &v1));
+  assert(!dg.are_adjacent(&v1, &v4));
+  assert(dg.get_neighbors(&v1).size() == 3);
+
+  // remove_edge drops every matching edge, duplicates included.
+  Edge e(std::make_unique<Vertex>(v1), std::make_unique<Vertex>(v3), std::make_unique<Value>(kDummyValue));
+  dg.remove_edge(&e);
+  assert(!dg.are_adjacent(&v1, &v3));
+  assert(dg.get_neighbors(&v1).size() == 1);
+  assert(*dg.get_neighbors(&v1)[0] == v2);
+
+  dg.remove(&v2);
+  assert(!dg.are_adjacent(&v2, &v3));
+  assert(dg.get_neighbors(&v2).size() == 0);
+
+  // Many dests force the per-vertex tables to grow.
+  for (int i = 10; i < 200; i++) {
+    Vertex v(make_pair("X", i));
+    dg.add_edge(&v4, &v);
+  }
+  for (int i = 10; i < 200; i++) {
+    Vertex v(make_pair("X", i));
+    assert(dg.are_adjacent(&v4, &v));
+  }
+  assert(dg.get_neighbors(&v4).size() == 190);
+
+  // Indexed and unindexed graphs answer alike.
+  DirectedGraph copy(dg);
+  copy.disable_index();
+  assert(!copy.indexed());
+  assert(copy.are_adjacent(&v4, &v4) == dg.are_adjacent(&v4, &v4));
+  assert(copy.get_neighbors(&v4).size() == dg.get_neighbors(&v4).size());
+  assert(copy.get_neighbors(&v1).size() == dg.get_neighbors(&v1).size());
+}
+
+void test_views() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+
+  DirectedGraph dg;
+  dg.add(&v3);
+  dg.add_edge(&v1, &v2);
+  dg.add_edge(&v1, &v3);
+
+  DirectedGraph::EdgeRange edges = graph_lib::edges(dg);
+  assert(edges.size() == 3);
+  assert(*edges[0].get_source() == v3);
+  assert(edges[0].get_dest() == nullptr);
+  assert(*edges[2].get_source() == v1);
+  assert(*edges[2].get_dest() == v3);
+  assert(edges[2].value() == kDummyValue);
+  int num_edges = 0;
+  for (const DirectedGraph::EdgeRef& e : edges) {
+    if (e.get_dest()) {
+      num_edges++;
+    }
+  }
+  assert(num_edges == dg.edge_count());
+
+  for (bool indexed : {false, true}) {
+    if (indexed) {
+      dg.enable_index();
+    }
+    DirectedGraph::NeighborView view = graph_lib::neighbor_view(dg, &v1);
+    assert(view.size() == 2);
+    vector<Vertex*> listed = dg.get_neighbors(&v1);
+    size_t i = 0;
+    for (Vertex* neighbor : view) {
+      assert(neighbor == listed[i++]);
+    }
+    assert(graph_lib::neighbor_view(dg, &v3).empty());
+    assert(graph_lib::neighbor_view(dg, &v2).size() == 0);
+  }
+
+  DirectedAcyclicGraph dag;
+  dag.add_edge(&v1, &v2);
+  assert(graph_lib::edges(dag).size() == 1);
+  assert(*(*graph_lib::neighbor_view(dag, &v1).begin()) == v2);
+
+  Tree tree;
+  tree.add_edge(&v1, &v2);
+  tree.add_edge(&v1, &v3);
+  assert(graph_lib::edges(tree).size() == 2);
+  assert(graph_lib::neighbor_view(tree, &v1).size() == 2);
+
+  CsrGraph csr = dg.freeze();
+  CsrGraph::NeighborView row = graph_lib::neighbor_view(csr, &v1);
+  assert(row.size() == 2);
+  assert(**row.begin() == v2);
+}
+
+void test_maintained_counts() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+
+  DirectedGraph dg;
+  dg.enable_index();
+  dg.add(&v1);
+  dg.add(&v1);
+  assert(dg.vertex_count() == 1 && dg.edge_count() == 0);
+  dg.add_edge(&v1, &v2);
+  dg.add_edge(&v2, &v3);
+  dg.add_edge(&v2, &v3);
+  assert(dg.vertex_count() == 3 && dg.edge_count() == 3);
+
+  // v3 lives on as long as some edge still names it.
+  Edge e(std::make_unique<Vertex>(v2), std::make_unique<Vertex>(v3), std::make_unique<Value>(kDummyValue));
+  dg.remove_edge(&e);
+  assert(dg.vertex_count() == 2 && dg.edge_count() == 1);
+  assert(!dg.are_adjacent(&v2, &v3));
+
+  // A freed slot is reused by the next new vertex.
+  dg.add_edge(&v4, &v1);
+  assert(dg.vertex_count() == 3 && dg.edge_count() == 2);
+  assert(dg.are_adjacent(&v4, &v1));
+  assert(dg.get_neighbors(&v4).size() == 1);
+  assert(dg.get_neighbors(&v3).empty());
+
+  dg.remove(&v4);
+  assert(dg.vertex_count() == 2 && dg.edge_count() == 1);
+  dg.remove(&v1);
+  assert(dg.vertex_count() == 0 && dg.edge_count() == 0);
+  assert(dg.top() == nullptr);
+
+  DirectedAcyclicGraph dag;
+  dag.add_edge(&v1, &v2);
+  assert(!dag.add_edge(&v2, &v1));
+  assert(graph_lib::count_vertices(dag) == 2 && graph_lib::count_edges(dag) == 1);
+}
+
+void test_remove_vertices() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+
+  for (bool indexed : {false, true}) {
+    DirectedGraph dg;
+    if (indexed) {
+      dg.enable_index();
+    }
+    dg.add_edge(&v1, &v2);
+    dg.add_edge(&v2, &v3);
+    dg.add_edge(&v1, &v3);
+    dg.add_edge(&v3, &v4);
+    dg.add_edge(&v3, &v3);
+
+    // Both edges out of and into v3 go, even back to back.
+    dg.remove(&v3);
+    assert(dg.vertex_count() == 2 && dg.edge_count() == 1);
+    assert(!dg.are_adjacent(&v1, &v3));
+    assert(dg.get_neighbors(&v2).empty());
+    assert(dg.get_neighbors(&v1).size() == 1);
+
+    dg.add_edge(&v2, &v3);
+    dg.add_edge(&v3, &v4);
+    dg.add_edge(&v4, &v1);
+    vector<const Vertex*> stale = {&v2, &v4};
+    dg.remove_vertices(stale);
+    assert(dg.vertex_count() == 0 && dg.edge_count() == 0);
+
+    dg.add_edge(&v1, &v2);
+    dg.add_edge(&v1, &v2);
+    dg.add_edge(&v1, &v3);
+    dg.add_edge(&v2, &v3);
+    Edge e12(std::make_unique<Vertex>(v1), std::make_unique<Vertex>(v2), std::make_unique<Value>(kDummyValue));
+    Edge e23(std::make_unique<Vertex>(v2), std::make_unique<Vertex>(v3), std::make_unique<Value>(kDummyValue));
+    Edge e34(std::make_unique<Vertex>(v3), std::make_unique<Vertex>(v4), std::make_unique<Value>(kDummyValue));
+    vector<const Edge*> doomed = {&e12, &e23, &e34};
+    dg.remove_edges(doomed);
+    assert(dg.edge_count() == 1 && dg.vertex_count() == 2);
+    assert(dg.are_adjacent(&v1, &v3));
+    assert(!dg.are_adjacent(&v1, &v2));
+    assert(dg.get_neighbors(&v1).size() == 1);
+  }
+
+  DirectedAcyclicGraph dag;
+  dag.add_edge(&v1, &v2);
+  dag.add_edge(&v2, &v3);
+  assert(!dag.add_edge(&v3, &v1));
+  // Dropping v2's incoming edge lets v3 -> v1 in.
+  dag.remove(&v2);
+  assert(dag.edge_count() == 0);
+  assert(dag.add_edge(&v3, &v1));
+  dag.add_edge(&v1, &v4);
+  vector<const Vertex*> stale = {&v1};
+  dag.remove_vertices(stale);
+  assert(dag.edge_count() == 0);
+  assert(dag.add_edge(&v4, &v3));
+}
+
+void test_bulk_load() {
+  vector<Vertex> vertices = {Vertex(make_pair("A", 1)), Vertex(make_pair("B", 2)),
+			     Vertex(make_pair("C", 3)), Vertex(make_pair("D", 4))};
+  vector<EdgeSpec> edges = {{1, 2, kDummyValue}, {2, 3, make_pair("w", 7)}, {1, 5, kDummyValue}};
+
+  DirectedGraph dg;
+  dg.enable_index();
+  assert(dg.add_edges(edges, vertices));
+  // D has no edge, so it is added on its own; 5 was never named.
+  assert(dg.vertex_count() == 5 && dg.edge_count() == 3);
+  assert(dg.are_adjacent(&vertices[0], &vertices[1]));
+  assert(dg.get_neighbors(&vertices[0]).size() == 2);
+  assert(dg.get_neighbors(&vertices[0])[1]->value() == make_pair(string("DUMMY"), 5));
+  assert(dg.edges()[1].value() == make_pair(string("w"), 7));
+  assert(*dg.edges()[3].get_source() == vertices[3]);
+
+  DirectedAcyclicGraph dag;
+  assert(dag.add_edge(&vertices[2], &vertices[3]));
+  assert(dag.add_edges(edges, vertices));
+  assert(dag.edge_count() == 4);
+  // The bulk load leaves the incremental check in a consistent state.
+  assert(!dag.add_edge(&vertices[3], &vertices[0]));
+  assert(dag.add_edge(&vertices[0], &vertices[3]));
+
+  // 4 -> 1 closes 1 -> 2 -> 3 -> 4; 8 -> 9 and 9 -> 1 only feed into it.
+  vector<EdgeSpec> cyclic = {{8, 9, kDummyValue}, {9, 1, kDummyValue}, {4, 1, kDummyValue}, {3, 7, kDummyValue}};
+  vector<EdgeSpec> cycle_edges;
+  assert(!dag.add_edges(cyclic, Span<const Vertex>(), &cycle_edges));
+  assert(dag.edge_count() == 5);
+  assert(cycle_edges.size() == 1);
+  assert(cycle_edges[0].source == 4 && cycle_edges[0].dest == 1);
+
+  vector<EdgeSpec> self_loop = {{8, 8, kDummyValue}};
+  cycle_edges.clear();
+  assert(!dag.add_edges(self_loop, Span<const Vertex>(), &cycle_edges));
+  assert(cycle_edges.size() == 1);
+
+  DirectedAcyclicGraph full(CycleCheck::kFull);
+  assert(full.add_edge(&vertices[2], &vertices[3]));
+  assert(full.add_edges(edges, vertices));
+  assert(!full.add_edges(cyclic));
+  assert(full.edge_count() == 4);
+}
+
+void test_snapshot() {
+  DirectedGraph dg;
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("Bee", 2));
+  Vertex v3(make_pair("", 5));
+  Vertex v4(make_pair("D", 9));
+  dg.add(&v4);
+  dg.add_edge(&v1, &v3);
+  dg.add_edge(&v1, &v2);
+  dg.add_edge(&v2, &v3);
+  CsrGraph csr = graph_lib::freeze(dg);
+
+  const string path = "snapshot_test.bin";
+  assert(graph_lib::save_snapshot(csr, path));
+  CsrGraph loaded;
+  assert(graph_lib::load_snapshot(path, &loaded));
+  assert(loaded.vertex_count() == 4);
+  assert(loaded.edge_count() == 3);
+  assert(loaded.are_adjacent(&v1, &v2));
+  assert(loaded.are_adjacent(&v2, &v3));
+  assert(!loaded.are_adjacent(&v3, &v1));
+  assert(loaded.name(loaded.index_of(2)) == "Bee");
+  assert(*loaded.vertex(loaded.index_of(5)) == v3);
+  assert(loaded.neighbors(loaded.index_of(&v4)).empty());
+  assert(loaded.to_string() == csr.to_string());
+
+  // Copies share the mapping, which outlives the original.
+  CsrGraph copy(loaded);
+  loaded = CsrGraph();
+  assert(copy.get_neighbors(&v1).size() == 2);
+  assert(*copy.get_neighbors(&v1)[0] == v2);
+
+  // Empty graphs round-trip too.
+  assert(graph_lib::save_snapshot(CsrGraph(), path));
+  assert(graph_lib::load_snapshot(path, &loaded));
+  assert(loaded.vertex_count() == 0);
+
+  // Truncated or foreign files are refused and leave the graph alone.
+  assert(graph_lib::save_snapshot(csr, path));
+  std::ifstream in(path, std::ios::binary);
+  string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  in.close();
+  std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() - 1);
+  assert(!graph_lib::load_snapshot(path, &copy));
+  bytes[0] = 'X';
+  std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+  assert(!graph_lib::load_snapshot(path, &copy));
+  assert(copy.vertex_count() == 4);
+  std::remove(path.c_str());
+  assert(!graph_lib::load_snapshot(path, &copy));
+}
+
+// Counts what passes through to upstream, for checking where graphs
+// allocate.
+class CountingResource : public std::pmr::memory_resource {
+ public:
+  size_t allocations = 0;
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    allocations++;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+void test_arena() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  DirectedGraph copy;
+  {
+    CountingResource counter;
+    std::pmr::monotonic_buffer_resource arena(&counter);
+    // Anything falling back to the default resource would throw.
+    std::pmr::memory_resource* saved = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    DirectedGraph dg(&arena);
+    dg.enable_index();
+    for (int i = 10; i < 100; i++) {
+      Vertex v(make_pair("X", i));
+      dg.add_edge(&v1, &v);
+    }
+    dg.add_edge(&v2, &v3);
+    dg.remove(&v2);
+    dg.disable_index();
+
+    DirectedAcyclicGraph dag(&arena);
+    assert(dag.add_edge(&v1, &v2));
+    assert(dag.add_edge(&v2, &v3));
+    assert(!dag.add_edge(&v3, &v1));
+
+    Tree tree(&arena);
+    assert(tree.add_edge(&v1, &v2));
+    // So does the ancestor index.
+    assert(tree.depth(&v2) == 1 && tree.lca(&v1, &v2)->value() == v1.value());
+    std::pmr::set_default_resource(saved);
+
+    assert(dg.resource() == &arena);
+    assert(counter.allocations > 0);
+    assert(dg.vertex_count() == 91);
+    assert(dag.edge_count() == 2);
+    assert(tree.are_adjacent(&v1, &v2));
+
+    // Copies allocate from the default resource and outlive the arena.
+    copy = dg;
+    DirectedGraph copied(dg);
+    assert(copied.resource() == std::pmr::get_default_resource());
+  }
+  assert(copy.vertex_count() == 91);
+  assert(copy.are_adjacent(&v1, &v1) == false);
+  assert(copy.get_neighbors(&v1).size() == 90);
+}
+
+void test_traversal() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+  Vertex v5(make_pair("E", 5));
+  DirectedGraph dg;
+  dg.add_edge(&v1, &v2);
+  dg.add_edge(&v1, &v3);
+  dg.add_edge(&v2, &v4);
+  dg.add_edge(&v3, &v4);
+  dg.add_edge(&v4, &v1);
+  dg.add(&v5);
+
+  auto ids = [](const vector<Vertex*>& vertices) {
+    vector<int> ids;
+    for (const Vertex* v : vertices) {
+      ids.push_back(v->value().second);
+    }
+    return ids;
+  };
+  assert(ids(graph_lib::bfs(dg, &v1)) == vector<int>({1, 2, 3, 4}));
+  assert(ids(graph_lib::dfs(dg, &v1)) == vector<int>({1, 2, 4, 3}));
+  assert(ids(graph_lib::bfs(dg, &v5)) == vector<int>({5}));
+  vector<Vertex*> sources = {&v5, &v3};
+  assert(ids(graph_lib::bfs(dg, sources)) == vector<int>({5, 3, 4, 1, 2}));
+  assert(graph_lib::reachable(dg, sources, &v2));
+  assert(!graph_lib::reachable(dg, Span<Vertex* const>(&sources[0], 1), &v1));
+
+  CsrGraph csr = graph_lib::freeze(dg);
+  assert(ids(graph_lib::dfs(csr, &v1)) == vector<int>({1, 2, 4, 3}));
+  Tree tree;
+  tree.add_edge(&v1, &v2);
+  tree.add_edge(&v2, &v3);
+  assert(ids(graph_lib::bfs(tree, &v1)) == vector<int>({1, 2, 3}));
+
+  // The transpose lists each vertex's parents.
+  Span<const uint32_t> parents = csr.in_neighbors(csr.index_of(&v4));
+  assert(parents.size() == 2);
+  assert(csr.id(parents[0]) == 2 && csr.id(parents[1]) == 3);
+  assert(csr.in_neighbors(csr.index_of(&v5)).empty());
+
+  ThreadPool pool(4);
+  vector<uint32_t> start = {csr.index_of(&v2)};
+  vector<uint32_t> depth = graph_lib::parallel_bfs(csr, start, pool);
+  assert(depth[csr.index_of(&v2)] == 0);
+  assert(depth[csr.index_of(&v4)] == 1);
+  assert(depth[csr.index_of(&v1)] == 2);
+  assert(depth[csr.index_of(&v3)] == 3);
+  assert(depth[csr.index_of(&v5)] == kNoVertex);
+
+  // A random graph dense enough that some levels go bottom-up, checked
+  // against a plain sequential BFS.
+  const int n = 5000;
+  DirectedGraph random;
+  vector<EdgeSpec> specs;
+  uint32_t seed = 7;
+  auto next_random = [&seed]() {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+  };
+  for (int i = 0; i < 8 * n; i++) {
+    specs.push_back(EdgeSpec{int(next_random()), int(next_random()), kDummyValue});
+  }
+  random.add_edges(specs);
+  CsrGraph big = random.freeze();
+  start = {0, big.index_of(n / 2)};
+  vector<uint32_t> expected(big.vertex_count(), kNoVertex);
+  vector<uint32_t> queue;
+  for (uint32_t s : start) {
+    if (expected[s] == kNoVertex) {
+      expected[s] = 0;
+      queue.push_back(s);
+    }
+  }
+  for (size_t i = 0; i < queue.size(); i++) {
+    for (uint32_t dest : big.neighbors(queue[i])) {
+      if (expected[dest] == kNoVertex) {
+	expected[dest] = expected[queue[i]] + 1;
+	queue.push_back(dest);
+      }
+    }
+  }
+  assert(graph_lib::parallel_bfs(big, start, pool) == expected);
+  ThreadPool single(1);
+  assert(graph_lib::parallel_bfs(big, start, single) == expected);
+}
+
+void test_topological_order() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+  Vertex v5(make_pair("E", 5));
+
+  auto ids = [](const vector<const Vertex*>& vertices) {
+    vector<int> ids;
+    for (const Vertex* v : vertices) {
+      ids.push_back(v->value().second);
+    }
+    return ids;
+  };
+  for (CycleCheck mode : {CycleCheck::kIncremental, CycleCheck::kFull}) {
+    DirectedAcyclicGraph dag(mode);
+    assert(dag.topological_order().empty());
+    assert(dag.levels().empty());
+    dag.add_edge(&v3, &v4);
+    dag.add_edge(&v1, &v3);
+    dag.add_edge(&v1, &v2);
+    dag.add(&v5);
+    assert(ids(dag.topological_order()) == vector<int>({1, 5, 3, 2, 4}));
+    const vector<vector<const Vertex*>>& levels = dag.levels();
+    assert(levels.size() == 3);
+    assert(ids(levels[0]) == vector<int>({1, 5}));
+    assert(ids(levels[1]) == vector<int>({3, 2}));
+    assert(ids(levels[2]) == vector<int>({4}));
+
+    // An edge the caches already agree with keeps them.
+    const vector<const Vertex*>* cached = &dag.topological_order();
+    dag.add_edge(&v5, &v4);
+    assert(&dag.topological_order() == cached);
+    assert(ids(dag.topological_order()) == vector<int>({1, 5, 3, 2, 4}));
+    assert(dag.levels().size() == 3);
+
+    // 2 -> 3 puts 3 and 4 a level later.
+    dag.add_edge(&v2, &v3);
+    assert(ids(dag.topological_order()) == vector<int>({1, 5, 2, 3, 4}));
+    assert(dag.levels().size() == 4);
+    assert(ids(dag.levels()[1]) == vector<int>({2}));
+    assert(ids(dag.levels()[3]) == vector<int>({4}));
+
+    // A rejected edge changes nothing.
+    assert(!dag.add_edge(&v4, &v1));
+    assert(ids(dag.topological_order()) == vector<int>({1, 5, 2, 3, 4}));
+
+    // Removing 3 keeps the rest of the order; 5 -> 4 keeps 4 in the graph.
+    dag.remove(&v3);
+    assert(ids(dag.topological_order()) == vector<int>({1, 5, 2, 4}));
+    assert(dag.levels().size() == 2);
+    assert(ids(dag.levels()[0]) == vector<int>({1, 5}));
+    assert(ids(dag.levels()[1]) == vector<int>({2, 4}));
+    dag.remove(&v5);
+    assert(ids(dag.topological_order()) == vector<int>({1, 2}));
+
+    // Every edge runs forward in the order and across levels.
+    DirectedAcyclicGraph copy(dag);
+    vector<EdgeSpec> specs = {{2, 6, kDummyValue}, {6, 7, kDummyValue}, {1, 7, kDummyValue}};
+    assert(copy.add_edges(specs));
+    const vector<const Vertex*>& order = copy.topological_order();
+    assert(order.size() == 4);
+    std::unordered_map<int, size_t> position;
+    for (size_t i = 0; i < order.size(); i++) {
+      position[order[i]->value().second] = i;
+    }
+    std::unordered_map<int, size_t> level;
+    for (size_t i = 0; i < copy.levels().size(); i++) {
+      for (const Vertex* v : copy.levels()[i]) {
+	level[v->value().second] = i;
+      }
+    }
+    for (const DirectedGraph::EdgeRef& e : copy.edges()) {
+      if (e.get_source() && e.get_dest()) {
+	assert(position[e.get_source()->value().second] < position[e.get_dest()->value().second]);
+	assert(level[e.get_source()->value().second] < level[e.get_dest()->value().second]);
+      }
+    }
+    assert(level[7] == 3);
+  }
+}
+
+void test_executor() {
+  WorkStealingPool pool(4);
+
+  // Tasks submitted from tasks all run before the pool goes away.
+  {
+    std::atomic<int> ran(0);
+    WorkStealingPool nested(2);
+    for (int i = 0; i < 10; i++) {
+      nested.submit([&nested, &ran]() {
+	  for (int j = 0; j < 10; j++) {
+	    nested.submit([&ran]() {
+		ran++;
+	      });
+	  }
+	  ran++;
+	});
+    }
+    while (ran.load() < 110) {
+      std::this_thread::yield();
+    }
+  }
+
+  // A random DAG: every task must start after all its predecessors
+  // finished.
+  DirectedAcyclicGraph dag;
+  vector<EdgeSpec> specs;
+  const int n = 300;
+  uint32_t seed = 11;
+  for (int i = 0; i < 4 * n; i++) {
+    seed = seed * 1103515245 + 12345;
+    int a = (seed >> 8) % n;
+    seed = seed * 1103515245 + 12345;
+    int b = (seed >> 8) % n;
+    if (a != b) {
+      specs.push_back(EdgeSpec{std::min(a, b), std::max(a, b), kDummyValue});
+    }
+  }
+  assert(dag.add_edges(specs));
+  std::atomic<int> clock(0);
+  vector<std::atomic<int>> started(n);
+  vector<std::atomic<int>> finished(n);
+  DagExecutor executor(pool);
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < n; i++) {
+      started[i] = -1;
+      finished[i] = -1;
+    }
+    assert(executor.run(dag, [&](const Vertex* v) {
+	  started[v->value().second] = clock++;
+	  finished[v->value().second] = clock++;
+	}));
+    for (const DirectedGraph::EdgeRef& e : dag.edges()) {
+      if (e.get_source() && e.get_dest()) {
+	int source = e.get_source()->value().second;
+	int dest = e.get_dest()->value().second;
+	assert(finished[source] >= 0 && finished[source] < started[dest]);
+      }
+    }
+  }
+
+  // Cancelling from a task stops everything not yet started.
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  DirectedAcyclicGraph chain;
+  chain.add_edge(&v1, &v2);
+  chain.add_edge(&v2, &v3);
+  vector<int> ran;
+  assert(!executor.run(chain, [&](const Vertex* v) {
+	ran.push_back(v->value().second);
+	if (v->value().second == 2) {
+	  executor.cancel();
+	}
+      }));
+  assert(ran == vector<int>({1, 2}));
+
+  // A later run starts afresh.
+  ran.clear();
+  assert(executor.run(chain, [&](const Vertex* v) {
+	ran.push_back(v->value().second);
+      }));
+  assert(ran == vector<int>({1, 2, 3}));
+  DirectedAcyclicGraph empty;
+  assert(executor.run(empty, [](const Vertex*) {}));
+}
+
+void test_shortest_paths() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+  Vertex v5(make_pair("E", 5));
+  auto weighted = [](int source, int dest, int weight) {
+    return EdgeSpec{source, dest, Value("w", weight)};
+  };
+  DirectedAcyclicGraph dag;
+  vector<EdgeSpec> specs = {weighted(1, 2, 4), weighted(1, 3, 1), weighted(3, 2, 2), weighted(2, 4, 5),
+			    weighted(3, 4, 8)};
+  assert(dag.add_edges(specs, vector<Vertex>({v5})));
+  WeightedGraph g(graph_lib::edges(dag));
+  ThreadPool pool(3);
+
+  PathTree dijkstra;
+  PathTree stepping;
+  PathTree linear;
+  assert(graph_lib::shortest_paths(g, &v1, &dijkstra));
+  assert(graph_lib::shortest_paths(g, &v1, 2, pool, &stepping));
+  assert(graph_lib::dag_shortest_paths(g, &v1, &linear));
+  for (const PathTree* tree : {&dijkstra, &stepping, &linear}) {
+    assert(tree->distance(&v1) == 0);
+    assert(tree->distance(&v2) == 3);
+    assert(tree->distance(&v3) == 1);
+    assert(tree->distance(&v4) == 8);
+    assert(!tree->reached(&v5));
+    assert(tree->path(&v4) == vector<int>({1, 3, 2, 4}));
+    assert(tree->path(&v5).empty());
+  }
+
+  PathTree longest;
+  assert(graph_lib::dag_longest_paths(g, &v1, &longest));
+  assert(longest.distance(&v4) == 9);
+  assert(longest.path(&v4) == vector<int>({1, 3, 4}));
+  vector<int> path;
+  int64_t length = 0;
+  assert(graph_lib::critical_path(g, &path, &length));
+  assert(length == 9 && path == vector<int>({1, 3, 4}));
+
+  // A projection can weigh every edge alike.
+  WeightedGraph hops(graph_lib::edges(dag), [](const Value&) {
+      return int64_t(1);
+    });
+  assert(graph_lib::shortest_paths(hops, &v1, &dijkstra));
+  assert(dijkstra.distance(&v4) == 2);
+  assert(graph_lib::critical_path(hops, &path, &length));
+  assert(length == 3);
+
+  // Negative weights only suit the acyclic kernels, and those need no
+  // cycle.
+  DirectedGraph dg;
+  vector<EdgeSpec> negative = {weighted(1, 2, -3), weighted(2, 3, 1), weighted(1, 3, 0)};
+  dg.add_edges(negative);
+  WeightedGraph signed_graph(graph_lib::edges(dg));
+  assert(!graph_lib::shortest_paths(signed_graph, &v1, &dijkstra));
+  assert(!graph_lib::shortest_paths(signed_graph, &v1, 1, pool, &dijkstra));
+  assert(graph_lib::dag_shortest_paths(signed_graph, &v1, &linear));
+  assert(linear.distance(&v3) == -2);
+  vector<EdgeSpec> back = {weighted(3, 1, 1)};
+  dg.add_edges(back);
+  WeightedGraph cyclic(graph_lib::edges(dg));
+  assert(!graph_lib::dag_longest_paths(cyclic, &v1, &linear));
+  assert(!graph_lib::critical_path(cyclic, &path, &length));
+
+  // Delta-stepping agrees with Dijkstra on a random graph, for deltas
+  // both below and above the typical weight.
+  DirectedGraph random;
+  vector<EdgeSpec> edges;
+  const int n = 2000;
+  uint32_t seed = 3;
+  auto next_random = [&seed](uint32_t bound) {
+    seed = seed * 1103515245 + 12345;
+    return int((seed >> 8) % bound);
+  };
+  for (int i = 0; i < 6 * n; i++) {
+    edges.push_back(weighted(next_random(n), next_random(n), next_random(100)));
+  }
+  random.add_edges(edges);
+  WeightedGraph big(graph_lib::edges(random));
+  Vertex start(make_pair("X", edges[0].source));
+  assert(graph_lib::shortest_paths(big, &start, &dijkstra));
+  for (int64_t delta : {1, 30, 1000}) {
+    assert(graph_lib::shortest_paths(big, &start, delta, pool, &stepping));
+    for (int i = 0; i < n; i++) {
+      Vertex v(make_pair("X", i));
+      assert(stepping.distance(&v) == dijkstra.distance(&v));
+      vector<int> route = stepping.path(&v);
+      assert(route.empty() == !dijkstra.reached(&v));
+      assert(route.empty() || (route.front() == start.value().second && route.back() == i));
+    }
+  }
+}
+
+void test_concurrent_reads() {
+  ConcurrentGraph graph(8);
+  {
+    ConcurrentGraph::Reader reader(graph);
+    assert(reader.version() == 0);
+    assert(reader->vertex_count() == 0);
+  }
+
+  // Every batch adds an edge in both directions, so a reader that ever
+  // sees one without the other has seen half a batch.
+  const int kBatches = 200;
+  std::atomic<bool> done(false);
+  std::atomic<int> bad(0);
+  vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&]() {
+	uint64_t last = 0;
+	while (!done.load()) {
+	  ConcurrentGraph::Reader reader(graph);
+	  const CsrGraph& g = reader.graph();
+	  if (reader.version() < last || g.edge_count() != 2 * int(reader.version())) {
+	    bad++;
+	  }
+	  last = reader.version();
+	  for (int i = 0; i < g.vertex_count(); i++) {
+	    for (uint32_t j : g.neighbors(i)) {
+	      if (!g.are_adjacent(g.vertex(j), g.vertex(i))) {
+		bad++;
+	      }
+	    }
+	  }
+	}
+      });
+  }
+  for (int i = 0; i < kBatches; i++) {
+    uint64_t version = graph.update([i](DirectedGraph& dg) {
+	Vertex u(make_pair("U", 2 * i));
+	Vertex v(make_pair("V", 2 * i + 1));
+	dg.add_edge(&u, &v);
+	dg.add_edge(&v, &u);
+      });
+    assert(version == uint64_t(i + 1));
+  }
+  done = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  assert(bad.load() == 0);
+  assert(graph.version() == kBatches);
+
+  // With no reader pinned, the next update frees every old version.
+  graph.update([](DirectedGraph& dg) {
+      Vertex u(make_pair("U", 0));
+      dg.remove(&u);
+    });
+  assert(graph.retired() == 0);
+  ConcurrentGraph::Reader reader(graph);
+  assert(reader->edge_count() == 2 * kBatches - 2);
+  // A pinned reader keeps its version alive across updates.
+  graph.update([](DirectedGraph&) {});
+  graph.update([](DirectedGraph&) {});
+  assert(graph.retired() == 2);
+  assert(reader.version() == kBatches + 1);
+  assert(reader->edge_count() == 2 * kBatches - 2);
+}
+
+void test_overlay() {
+  DirectedGraph dg;
+  Vertex a(make_pair("A", 1));
+  Vertex b(make_pair("B", 2));
+  Vertex c(make_pair("C", 3));
+  Vertex d(make_pair("D", 4));
+  dg.add_edge(&a, &b);
+  dg.add_edge(&b, &c);
+  dg.add_edge(&c, &a);
+  OverlayGraph g(dg.freeze());
+  assert(g.vertex_count() == 3 && g.edge_count() == 3);
+  assert(g.delta_size() == 0);
+
+  // Changes land in the delta and queries see them merged.
+  g.add_edge(&a, &d);
+  g.remove_edge(&b, &c);
+  assert(g.vertex_count() == 4 && g.edge_count() == 3);
+  assert(g.are_adjacent(&a, &b) && g.are_adjacent(&a, &d));
+  assert(!g.are_adjacent(&b, &c));
+  vector<Vertex*> neighbors = g.get_neighbors(&a);
+  assert(neighbors.size() == 2);
+  assert(neighbors[0]->value() == b.value() && neighbors[1]->value() == d.value());
+  assert(g.get_neighbors(&b).empty());
+  assert(g.delta_size() == 3);
+  vector<Vertex*> order = graph_lib::bfs(g, &c);
+  assert(order.size() == 4);
+
+  // Removing a base vertex drops its edges both ways; adding it back
+  // brings none of them back.
+  g.remove(&a);
+  assert(g.vertex_count() == 3 && g.edge_count() == 0);
+  assert(g.top()->value() == b.value());
+  g.add_edge(&a, &c);
+  assert(g.vertex_count() == 4 && g.edge_count() == 1);
+  assert(!g.are_adjacent(&a, &b) && g.are_adjacent(&a, &c));
+  assert(g.top()->value() == a.value());
+
+  g.compact();
+  assert(g.delta_size() == 0);
+  assert(g.base().vertex_count() == 4 && g.base().edge_count() == 1);
+  assert(g.vertex_count() == 4 && g.edge_count() == 1);
+  assert(g.are_adjacent(&a, &c));
+
+  // Changes made while a compaction runs survive its install.
+  g.add_edge(&b, &d);
+  assert(g.start_compaction());
+  assert(!g.start_compaction());
+  g.add_edge(&d, &a);
+  g.remove_edge(&a, &c);
+  g.remove(&b);
+  assert(g.finish_compaction());
+  assert(!g.finish_compaction());
+  assert(g.base().edge_count() == 2);
+  assert(g.vertex_count() == 3 && g.edge_count() == 1);
+  assert(g.are_adjacent(&d, &a) && !g.are_adjacent(&a, &c) && !g.are_adjacent(&b, &d));
+  g.compact();
+  assert(g.base().vertex_count() == 3 && g.base().edge_count() == 1);
+}
+
+void test_tree() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+  Vertex v5(make_pair("E", 5));
+  Vertex v6(make_pair("F", 6));
+  Tree tree;
+  assert(tree.add_edge(&v2, &v3));
+  assert(tree.add_edge(&v2, &v4));
+  assert(tree.add_edge(&v3, &v5));
+  // A new vertex may go above the root...
+  assert(tree.add_edge(&v1, &v2));
+  assert(tree.top()->value() == v1.value());
+  // ...but no vertex gets a second parent, and neither end can be new
+  // to the tree at once.
+  assert(!tree.add_edge(&v4, &v5));
+  assert(!tree.add_edge(&v5, &v1));
+  assert(!tree.add_edge(&v6, &v3));
+  assert(!tree.add_edge(&v5, &v5));
+  assert(tree.vertex_count() == 5 && tree.edge_count() == 4);
+
+  assert(!tree.parent(&v1));
+  assert(tree.parent(&v2)->value() == v1.value());
+  assert(tree.parent(&v5)->value() == v3.value());
+  assert(!tree.parent(&v6));
+  assert(tree.children(&v2).size() == 2);
+  assert(tree.children(&v5).empty());
+
+  auto ids = [](const Tree::SubtreeView& view) {
+    vector<int> ids;
+    for (const Vertex* v : view) {
+      ids.push_back(v->value().second);
+    }
+    return ids;
+  };
+  assert(ids(tree.subtree(&v1)) == vector<int>({1, 2, 3, 5, 4}));
+  assert(ids(tree.subtree(&v3)) == vector<int>({3, 5}));
+  assert(ids(tree.subtree(&v4)) == vector<int>({4}));
+  assert(tree.subtree(&v6).empty());
+
+  CsrGraph csr = tree.freeze();
+  assert(csr.vertex_count() == 5 && csr.edge_count() == 4);
+  assert(csr.are_adjacent(&v3, &v5) && !csr.are_adjacent(&v5, &v3));
+
+  // Unlinking a middle child keeps its siblings in order.
+  assert(tree.add_edge(&v2, &v6));
+  tree.remove(&v4);
+  vector<Vertex*> children = tree.get_neighbors(&v2);
+  assert(children.size() == 2);
+  assert(children[0]->value() == v3.value() && children[1]->value() == v6.value());
+  Tree copy(tree);
+  tree.remove(&v3);
+  assert(ids(tree.subtree(&v1)) == vector<int>({1, 2, 6}));
+  assert(ids(copy.subtree(&v1)) == vector<int>({1, 2, 3, 5, 6}));
+  // Edges list in the order they were added, as DirectedGraph's do.
+  vector<int> dests;
+  for (const auto& e : copy.edges()) {
+    dests.push_back(e.get_dest()->value().second);
+  }
+  assert(dests == vector<int>({3, 5, 2, 6}));
+  assert(tree.to_string() == "Graph (# vertices = 3):\n(A, 1) -> (B, 2)\n\n(B, 2) -> (F, 6)\n\n");
+}
+
+void test_ancestors() {
+  // A random tree, checked against walking parent() up to the root.
+  const int n = 2000;
+  vector<Vertex> vertices;
+  for (int i = 0; i < n; i++) {
+    vertices.emplace_back(make_pair("V", i));
+  }
+  Tree tree;
+  uint32_t seed = 11;
+  for (int i = 1; i < n; i++) {
+    seed = seed * 1103515245 + 12345;
+    assert(tree.add_edge(&vertices[(seed >> 8) % i], &vertices[i]));
+  }
+  auto path_up = [&tree](const Vertex* v) {
+    vector<int> path;
+    for (const Vertex* x = tree.find(v); x; x = tree.parent(x)) {
+      path.push_back(x->value().second);
+    }
+    return path;
+  };
+  for (int t = 0; t < 500; t++) {
+    seed = seed * 1103515245 + 12345;
+    const Vertex* u = &vertices[(seed >> 8) % n];
+    seed = seed * 1103515245 + 12345;
+    const Vertex* v = &vertices[(seed >> 8) % n];
+    vector<int> up = path_up(u);
+    vector<int> vp = path_up(v);
+    assert(tree.depth(u) == int(up.size()) - 1);
+    assert(tree.is_ancestor(u, v) == (std::find(vp.begin(), vp.end(), u->value().second) != vp.end()));
+    int expected = -1;
+    std::set<int> on_u_path(up.begin(), up.end());
+    for (int id : vp) {
+      if (on_u_path.count(id)) {
+	expected = id;
+	break;
+      }
+    }
+    assert(tree.lca(u, v)->value().second == expected);
+  }
+
+  // Changes drop the index.
+  Vertex a(make_pair("A", -1));
+  Vertex b(make_pair("B", -2));
+  assert(tree.add_edge(&vertices[5], &a));
+  assert(tree.add_edge(&a, &b));
+  assert(tree.depth(&b) == tree.depth(&vertices[5]) + 2);
+  assert(tree.lca(&b, &vertices[5])->value() == vertices[5].value());
+  assert(tree.is_ancestor(&vertices[0], &b) && !tree.is_ancestor(&b, &a));
+  tree.remove(&a);
+  assert(tree.depth(&b) == -1 && !tree.lca(&a, &vertices[0]));
+  assert(tree.lca(&vertices[0], &vertices[n - 1])->value() == vertices[0].value());
+}
+
+void test_reachability_index() {
+  // Random DAGs on both sides of the closure limit, checked against the
+  // plain search.
+  for (int n : {300, int(ReachabilityIndex::kClosureLimit) + 500}) {
+    DirectedAcyclicGraph dag;
+    DirectedAcyclicGraph indexed;
+    indexed.enable_reachability_index();
+    vector<Vertex> vertices;
+    for (int i = 0; i < n; i++) {
+      vertices.emplace_back(make_pair("V", i));
+    }
+    uint32_t seed = 5;
+    auto next_random = [&seed, n]() {
+      seed = seed * 1103515245 + 12345;
+      return int((seed >> 8) % n);
+    };
+    vector<EdgeSpec> specs;
+    for (int i = 0; i < 2 * n; i++) {
+      int a = next_random();
+      int b = next_random();
+      if (a != b) {
+	specs.push_back(EdgeSpec{std::min(a, b), std::max(a, b), kDummyValue});
+      }
+    }
+    assert(dag.add_edges(specs, vertices));
+    assert(indexed.add_edges(specs, vertices));
+    for (int t = 0; t < 300; t++) {
+      const Vertex* u = &vertices[next_random()];
+      const Vertex* v = &vertices[next_random()];
+      assert(indexed.reaches(u, v) == dag.reaches(u, v));
+    }
+    // Inserts are checked against the index, and ones it absorbs keep it.
+    for (int t = 0; t < 200; t++) {
+      const Vertex* u = &vertices[next_random()];
+      const Vertex* v = &vertices[next_random()];
+      bool added = dag.add_edge(u, v);
+      assert(indexed.add_edge(u, v) == added);
+      assert(!added || !indexed.reaches(v, u));
+      assert(indexed.reaches(u, v) == dag.reaches(u, v));
+    }
+  }
+
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+  for (CycleCheck check : {CycleCheck::kIncremental, CycleCheck::kFull}) {
+    DirectedAcyclicGraph dag(check);
+    dag.enable_reachability_index();
+    assert(dag.add_edge(&v1, &v2));
+    assert(dag.add_edge(&v2, &v3));
+    assert(dag.reaches(&v1, &v3) && !dag.reaches(&v3, &v1));
+    assert(dag.reaches(&v2, &v2) && !dag.reaches(&v4, &v4));
+    // Rejected by the index alone.
+    assert(!dag.add_edge(&v3, &v1));
+    assert(!dag.add_edge(&v2, &v2));
+    // A new vertex joins the index in place.
+    assert(dag.add_edge(&v3, &v4));
+    assert(dag.reaches(&v1, &v4));
+    assert(!dag.add_edge(&v4, &v2));
+    assert(dag.edge_count() == 3);
+    dag.remove(&v3);
+    assert(!dag.reaches(&v1, &v4));
+    assert(dag.add_edge(&v4, &v1));
+    assert(dag.reaches(&v4, &v2));
+    dag.disable_reachability_index();
+    assert(dag.reaches(&v4, &v2) && !dag.reaches(&v2, &v4));
+  }
+}
+
+void test_generators() {
+  vector<EdgeSpec> random = graph_lib::random_graph(100, 400, 3);
+  assert(random.size() == 400);
+  for (const EdgeSpec& e : random) {
+    assert(e.source >= 0 && e.source < 100 && e.dest >= 0 && e.dest < 100);
+  }
+  assert(graph_lib::random_graph(100, 400, 3)[17].dest == random[17].dest);
+
+  // R-MAT skews toward low IDs.
+  vector<EdgeSpec> rmat = graph_lib::rmat_graph(10, 5000);
+  vector<int> degree(1 << 10, 0);
+  for (const EdgeSpec& e : rmat) {
+    assert(e.source < (1 << 10) && e.dest < (1 << 10));
+    degree[e.source]++;
+  }
+  assert(degree[0] > 10 * (5000 >> 10));
+
+  vector<EdgeSpec> layered = graph_lib::layered_dag(5, 10, 3);
+  assert(layered.size() == 4 * 10 * 3);
+  DirectedAcyclicGraph dag;
+  assert(dag.add_edges(layered));
+  assert(dag.levels().size() == 5);
+
+  Tree tree;
+  for (const EdgeSpec& e : graph_lib::deep_tree(1000, 3)) {
+    Vertex source(make_pair("V", e.source));
+    Vertex dest(make_pair("V", e.dest));
+    assert(tree.add_edge(&source, &dest));
+  }
+  Vertex last(make_pair("V", 999));
+  assert(tree.vertex_count() == 1000 && tree.depth(&last) >= 333);
+}
+
+void test_stats() {
+  graph_lib::reset_stats();
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  DirectedAcyclicGraph dag(CycleCheck::kFull);
+  assert(dag.add_edge(&v1, &v2));
+  assert(dag.add_edge(&v2, &v3));
+  assert(!dag.add_edge(&v3, &v1));
+  assert(dag.get_neighbors(&v1).size() == 1);
+  Tree tree;
+  tree.add_edge(&v1, &v2);
+  tree.parent(&v2);
+  tree.parent(&v1);
+
+  vector<graph_lib::OpStats> stats = graph_lib::stats();
+  assert(stats.size() == size_t(graph_lib::StatsOp::kCount));
+  auto of = [&stats](graph_lib::StatsOp op) {
+    return stats[int(op)];
+  };
+  assert(of(graph_lib::StatsOp::kDagCheckForCycles).name == "DirectedAcyclicGraph::check_for_cycles_");
+  if (!graph_lib::kStatsEnabled) {
+    for (const graph_lib::OpStats& s : stats) {
+      assert(s.calls == 0 && s.edges_scanned == 0 && s.allocations == 0);
+    }
+    return;
+  }
+  assert(of(graph_lib::StatsOp::kDagAddEdge).calls == 3);
+  // Each DAG insert runs one DirectedGraph insert under it.
+  assert(of(graph_lib::StatsOp::kGraphAddEdge).calls == 3);
+  assert(of(graph_lib::StatsOp::kDagCheckForCycles).calls == 3);
+  assert(of(graph_lib::StatsOp::kDagCheckForCycles).edges_scanned > 0);
+  // Three vertices interned, plus the Edge built to roll back the cycle.
+  assert(of(graph_lib::StatsOp::kDagAddEdge).allocations == 3 + 3);
+  assert(of(graph_lib::StatsOp::kGraphRemoveEdge).calls == 1);
+  assert(of(graph_lib::StatsOp::kGraphGetNeighbors).calls == 1);
+  assert(of(graph_lib::StatsOp::kTreeParent).calls == 2);
+  graph_lib::OpStats add = of(graph_lib::StatsOp::kDagAddEdge);
+  uint64_t histogram = 0;
+  for (uint64_t count : add.latency) {
+    histogram += count;
+  }
+  assert(histogram == add.calls && add.total_nanos > 0);
+  graph_lib::reset_stats();
+  assert(graph_lib::stats()[int(graph_lib::StatsOp::kDagAddEdge)].calls == 0);
+}
+
+void test_payload_types() {
+  using IdVertex = BasicVertex<NoPayload, int32_t>;
+  using IdEdge = BasicEdge<NoPayload, int32_t>;
+  using IdGraph = BasicDirectedGraph<NoPayload, int32_t>;
+  static_assert(sizeof(IdVertex) == sizeof(int32_t), "an ID-only vertex is its ID");
+  static_assert(std::is_trivially_copyable<IdVertex>::value, "an ID-only vertex copies as its ID");
+  static_assert(BasicGraph<IdGraph, NoPayload, int32_t>, "");
+  static_assert(BasicGraph<DirectedGraph, string, int>, "");
+
+  // IDs alone tell vertices apart.
+  assert(Vertex(Value("A", 1)) == Vertex(Value("B", 1)));
+  assert(Vertex(Value("A", 1)) != Vertex(Value("A", 2)));
+
+  IdVertex a(1);
+  IdVertex b(2);
+  IdVertex c(3);
+  IdGraph graph;
+  assert(graph.add_edge(&a, &b));
+  assert(graph.add_edge(&b, &c));
+  assert(graph.vertex_count() == 3 && graph.edge_count() == 2);
+  assert(graph.are_adjacent(&a, &b) && !graph.are_adjacent(&b, &a));
+  assert(graph.to_string().find("(1) -> (2)") != string::npos);
+  graph.enable_index();
+  vector<IdVertex*> neighbors = graph.get_neighbors(&b);
+  assert(neighbors.size() == 1 && *neighbors[0] == c);
+
+  IdEdge e(std::make_unique<IdVertex>(a), std::make_unique<IdVertex>(b), std::make_unique<int32_t>(-1));
+  assert(graph.remove_edge(&e));
+  assert(!graph.are_adjacent(&a, &b) && graph.vertex_count() == 2);
+
+  vector<BasicEdgeSpec<NoPayload, int32_t>> specs = {{3, 4, -1}, {4, 5, 7}};
+  assert(graph.add_edges(specs));
+  assert(graph.edge_count() == 3 && graph.vertex_count() == 4);
+  IdVertex d(4);
+  assert(graph.are_adjacent(&c, &d));
+  assert(graph_lib::value(graph.find(&d)) == 4);
+}
+
+void test_intersect() {
+  const graph_lib::IntersectKernel kernels[] = {
+    graph_lib::IntersectKernel::kScalar, graph_lib::IntersectKernel::kAvx2, graph_lib::IntersectKernel::kAvx512};
+  std::mt19937_64 random(5);
+  for (int round = 0; round < 300; round++) {
+    // Small value ranges force matches and repeats, including runs that
+    // cross vector blocks.
+    uint32_t range = 1 + random() % (round < 150 ? 40 : 400);
+    vector<uint32_t> a(random() % 80);
+    vector<uint32_t> b(random() % 80);
+    for (uint32_t& x : a) {
+      x = random() % range;
+    }
+    for (uint32_t& x : b) {
+      x = random() % range;
+    }
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    vector<uint32_t> expected;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    for (graph_lib::IntersectKernel kernel : kernels) {
+      vector<uint32_t> out(std::min(a.size(), b.size()));
+      size_t n = graph_lib::intersect(a, b, out.data(), kernel);
+      out.resize(n);
+      assert(out == expected);
+      assert(graph_lib::intersect(b, a, nullptr, kernel) == expected.size());
+    }
+  }
+
+  // K5 with edges both ways, a self-loop and a repeated edge: still ten
+  // triangles.
+  DirectedGraph complete;
+  vector<EdgeSpec> edges;
+  for (int u = 0; u < 5; u++) {
+    for (int v = 0; v < 5; v++) {
+      edges.push_back(EdgeSpec{u, v, kDummyValue});
+    }
+  }
+  edges.push_back(EdgeSpec{0, 1, kDummyValue});
+  assert(complete.add_edges(edges));
+  CsrGraph k5 = complete.freeze();
+  ThreadPool pool(3);
+  assert(graph_lib::count_triangles(k5, pool) == 10);
+  assert(graph_lib::common_neighbors(k5, 0, 1) == 5);
+  assert(graph_lib::jaccard(k5, 0, 1) == 1);
+
+  // Against every vertex triple of a random graph.
+  DirectedGraph dg;
+  assert(dg.add_edges(graph_lib::random_graph(60, 500, 7)));
+  CsrGraph csr = dg.freeze();
+  size_t n = csr.vertex_count();
+  vector<vector<bool>> linked(n, vector<bool>(n, false));
+  for (uint32_t u = 0; u < n; u++) {
+    for (uint32_t v : csr.neighbors(u)) {
+      linked[u][v] = linked[v][u] = u != v;
+    }
+  }
+  uint64_t triangles = 0;
+  for (uint32_t u = 0; u < n; u++) {
+    for (uint32_t v = u + 1; v < n; v++) {
+      for (uint32_t w = v + 1; w < n; w++) {
+	triangles += linked[u][v] && linked[v][w] && linked[u][w];
+      }
+    }
+  }
+  assert(triangles > 0 && graph_lib::count_triangles(csr, pool) == triangles);
+  uint32_t x = csr.index_of(3);
+  uint32_t y = csr.index_of(4);
+  size_t common = 0;
+  for (uint32_t w = 0; w < n; w++) {
+    bool from_x = std::binary_search(csr.neighbors(x).begin(), csr.neighbors(x).end(), w);
+    bool from_y = std::binary_search(csr.neighbors(y).begin(), csr.neighbors(y).end(), w);
+    common += from_x && from_y;
+  }
+  assert(graph_lib::common_neighbors(csr, x, y) == common);
+}
+
+void test_edge_list() {
+  ThreadPool pool(3);
+  DirectedGraph small;
+  string text = "# name id name id [weight]\n"
+    "A 1 B 2 5\n"
+    "\n"
+    "  B 2\tC 3\r\n"
+    "X 1 C 3 -4";
+  assert(graph_lib::parse_edge_list(text, &small, pool));
+  assert(small.vertex_count() == 3 && small.edge_count() == 3);
+  Vertex a(make_pair("?", 1));
+  Vertex c(make_pair("?", 3));
+  assert(small.find(&a)->value().first == "A");
+  assert(small.are_adjacent(&a, &c));
+  assert(small.edges()[0].value() == Value(kDummyValue.first, 5));
+  assert(small.edges()[1].value() == kDummyValue);
+  assert(small.edges()[2].value().second == -4);
+
+  size_t bad_line = 0;
+  for (const char* bad : {"A 1 B\n", "A 1 B 2 3 4\n", "A x B 2\n", "A 1 B 2 7z\n"}) {
+    assert(!graph_lib::parse_edge_list(string("A 1 B 2\n") + bad, &small, pool, &bad_line));
+    assert(bad_line == 2);
+  }
+  assert(small.edge_count() == 3);
+
+  // Large enough to be parsed in several chunks.
+  const int kLines = 30000;
+  ostringstream big;
+  for (int i = 0; i < kLines; i++) {
+    big << "V" << i << " " << i << " V" << i + 1 << " " << i + 1 << " " << i % 7 << "\n";
+  }
+  const string path = "edge_list_test.txt";
+  {
+    std::ofstream out(path);
+    out << big.str();
+  }
+  DirectedGraph loaded;
+  assert(graph_lib::load_edge_list(path, &loaded, pool));
+  assert(loaded.edge_count() == kLines && loaded.vertex_count() == kLines + 1);
+  for (int i : {0, 12345, kLines - 1}) {
+    assert(loaded.edges()[i].get_source()->value() == Value("V" + std::to_string(i), i));
+    assert(loaded.edges()[i].value().second == i % 7);
+  }
+  {
+    std::ofstream out(path);
+    out << big.str() << "V0 0 V1\n" << big.str();
+  }
+  DirectedGraph rejected;
+  assert(!graph_lib::load_edge_list(path, &rejected, pool, &bad_line));
+  assert(bad_line == kLines + 1 && rejected.vertex_count() == 0);
+  std::remove(path.c_str());
+  assert(!graph_lib::load_edge_list(path, &rejected, pool, &bad_line));
+  assert(bad_line == 0);
+}
+
+void test_writer() {
+  Vertex a(make_pair("A", 1));
+  Vertex b(make_pair("B\"", 2));
+  Vertex c(make_pair("C", 3));
+  DirectedGraph dg;
+  Edge weighted(std::make_unique<Vertex>(a), std::make_unique<Vertex>(b), std::make_unique<Value>("W", 5));
+  dg.add_edge(&weighted);
+  dg.add(&c);
+  dg.add_edge(&b, &c);
+  assert(dg.to_string() == "Graph (# vertices = 3):\n(A, 1) -> (B\", 2)\n\n(C, 3) -> NULL\n\n(B\", 2) -> (C, 3)\n\n");
+  assert(graph_lib::graph_to_string(dg, graph_lib::GraphFormat::kDot)
+	 == "digraph {\n  1 [label=\"A\"];\n  2 [label=\"B\\\"\"];\n  3 [label=\"C\"];\n"
+	 "  1 -> 2 [label=5];\n  2 -> 3;\n}\n");
+  assert(graph_lib::graph_to_string(dg, graph_lib::GraphFormat::kJson)
+	 == "{\"vertices\": [\n  {\"id\": 1, \"name\": \"A\"},\n  {\"id\": 2, \"name\": \"B\\\"\"},"
+	 "\n  {\"id\": 3, \"name\": \"C\"}\n ],\n \"edges\": [\n  {\"source\": 1, \"dest\": 2, \"value\": [\"W\", 5]},"
+	 "\n  {\"source\": 2, \"dest\": 3, \"value\": [\"DUMMY\", -1]}\n ]}\n");
+  assert(graph_lib::graph_to_string(DirectedGraph(), graph_lib::GraphFormat::kJson)
+	 == "{\"vertices\": [],\n \"edges\": []}\n");
+  CsrGraph csr = dg.freeze();
+  assert(csr.to_string() == "Graph (# vertices = 3):\n(A, 1) -> (B\", 2)\n\n(B\", 2) -> (C, 3)\n\n(C, 3) -> NULL\n\n");
+
+  // Edge lists read back as the same edges.
+  string list = graph_lib::graph_to_string(dg, graph_lib::GraphFormat::kEdgeList);
+  assert(list == "A 1 B\" 2 5\nB\" 2 C 3\n");
+  ThreadPool pool(2);
+  DirectedGraph reread;
+  assert(graph_lib::parse_edge_list(list, &reread, pool));
+  assert(reread.edge_count() == 2 && reread.are_adjacent(&a, &b) && reread.are_adjacent(&b, &c));
+  assert(reread.edges()[0].value().second == 5);
+
+  // Through a file descriptor and a stream, past one buffer's worth.
+  DirectedGraph big;
+  big.add_edges(graph_lib::random_graph(1000, 20000));
+  string expected = graph_lib::graph_to_string(big, graph_lib::GraphFormat::kJson);
+  assert(expected.size() > graph_lib::GraphWriter::kBufferSize);
+  const string path = "writer_test.json";
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+  {
+    graph_lib::GraphWriter out(fd);
+    assert(graph_lib::write_graph(big, out, graph_lib::GraphFormat::kJson));
+  }
+  close(fd);
+  std::ifstream in(path);
+  std::stringstream read;
+  read << in.rdbuf();
+  assert(read.str() == expected);
+  std::remove(path.c_str());
+  ostringstream stream;
+  {
+    graph_lib::GraphWriter out(stream);
+    assert(graph_lib::write_graph(big, out, graph_lib::GraphFormat::kJson));
+  }
+  assert(stream.str() == expected);
+  graph_lib::GraphWriter closed(-1);
+  assert(!graph_lib::write_graph(dg, closed));
+}
+
+void test_batch() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+  for (CycleCheck check : {CycleCheck::kIncremental, CycleCheck::kFull}) {
+    DirectedAcyclicGraph dag(check);
+    dag.enable_reachability_index();
+    assert(dag.add_edge(&v1, &v2));
+    assert(dag.add_edge(&v2, &v3));
+    assert(dag.reaches(&v1, &v3));
+
+    DagBatch batch;
+    batch.add_edge(&v3, &v4);
+    batch.add_edge(&v1, &v4, make_pair("w", 5));
+    assert(batch.size() == 2);
+    assert(dag.apply(batch));
+    assert(dag.edge_count() == 4 && dag.vertex_count() == 4);
+    assert(dag.reaches(&v1, &v4));
+
+    // 4 -> 1 closes a cycle, so 2 -> 4 does not go in either.
+    batch.clear();
+    assert(batch.empty());
+    batch.add_edge(&v2, &v4);
+    batch.add_edge(&v4, &v1);
+    assert(!dag.apply(batch));
+    assert(dag.edge_count() == 4);
+    assert(!dag.are_adjacent(&v2, &v4) && !dag.are_adjacent(&v4, &v1));
+    assert(!dag.add_edge(&v4, &v1));
+
+    // Removals go first, so a batch can reverse an edge.
+    batch.clear();
+    batch.remove_edge(&v1, &v2);
+    batch.add_edge(&v2, &v1);
+    assert(dag.apply(batch));
+    assert(dag.are_adjacent(&v2, &v1) && !dag.are_adjacent(&v1, &v2));
+    assert(dag.edge_count() == 4);
+    assert(!dag.reaches(&v1, &v2));
+
+    // A removal whose value matches nothing keeps the edge, and with it
+    // the cycle; a failed batch removes nothing either.
+    batch.clear();
+    batch.remove_edge(&v1, &v4, kDummyValue);
+    batch.remove_edge(&v3, &v4);
+    batch.add_edge(&v4, &v2);
+    assert(!dag.apply(batch));
+    assert(dag.edge_count() == 4 && dag.are_adjacent(&v3, &v4));
+    batch.clear();
+    batch.remove_edge(&v1, &v4, make_pair("w", 5));
+    batch.remove_edge(&v3, &v4);
+    batch.add_edge(&v4, &v2);
+    assert(dag.apply(batch));
+    assert(dag.edge_count() == 3 && dag.are_adjacent(&v4, &v2));
+    assert(!dag.add_edge(&v3, &v4));
+    assert(dag.add_edge(&v3, &v1));
+    DagBatch self_loop;
+    self_loop.add_edge(&v3, &v3);
+    assert(!dag.apply(self_loop));
+
+    std::unordered_map<int, size_t> position;
+    for (const Vertex* v : dag.topological_order()) {
+      position[v->value().second] = position.size();
+    }
+    assert(position.size() == 4);
+    for (const auto& e : dag.edges()) {
+      assert(position[e.get_source()->value().second] < position[e.get_dest()->value().second]);
+    }
+  }
+}
+
+void test_scc() {
+  // {1, 2, 3} and {4, 5} are cycles, 6 stands alone and 7 loops on
+  // itself.
+  DirectedGraph dg;
+  Vertex v[8] = {Vertex(make_pair("_", 0)), Vertex(make_pair("A", 1)), Vertex(make_pair("B", 2)),
+		 Vertex(make_pair("C", 3)), Vertex(make_pair("D", 4)), Vertex(make_pair("E", 5)),
+		 Vertex(make_pair("F", 6)), Vertex(make_pair("G", 7))};
+  for (auto edge : {make_pair(1, 2), make_pair(2, 3), make_pair(3, 1), make_pair(3, 4), make_pair(4, 5),
+		    make_pair(5, 4), make_pair(5, 7), make_pair(7, 7), make_pair(2, 5)}) {
+    dg.add_edge(&v[edge.first], &v[edge.second]);
+  }
+  dg.add(&v[6]);
+  CsrGraph csr = dg.freeze();
+  ThreadPool pool(3);
+  for (bool parallel : {false, true}) {
+    uint32_t count = 0;
+    vector<uint32_t> component = parallel ? graph_lib::parallel_strongly_connected_components(csr, pool, &count)
+      : graph_lib::strongly_connected_components(csr, &count);
+    auto of = [&](int id) {
+      return component[csr.index_of(id)];
+    };
+    assert(count == 4);
+    assert(of(1) == of(2) && of(2) == of(3));
+    assert(of(4) == of(5));
+    assert(of(1) < of(4) && of(4) < of(7));
+    assert(of(6) != of(1) && of(6) != of(4) && of(6) != of(7));
+  }
+
+  DirectedAcyclicGraph dag = graph_lib::condense(dg);
+  assert(dag.vertex_count() == 4 && dag.edge_count() == 2);
+  assert(dag.are_adjacent(&v[1], &v[4]) && dag.are_adjacent(&v[4], &v[7]));
+  assert(!dag.add_edge(&v[7], &v[1]));
+  assert(dag.add_edge(&v[6], &v[1]));
+
+  // A cycle far deeper than the call stack would allow the recursive
+  // check.
+  const int kLength = 200000;
+  vector<EdgeSpec> ring;
+  for (int i = 0; i < kLength; i++) {
+    ring.push_back(EdgeSpec{i, (i + 1) % kLength, kDummyValue});
+  }
+  DirectedGraph deep;
+  deep.add_edges(ring);
+  CsrGraph deep_csr = deep.freeze();
+  uint32_t count = 0;
+  graph_lib::strongly_connected_components(deep_csr, &count);
+  assert(count == 1);
+  graph_lib::parallel_strongly_connected_components(deep_csr, pool, &count);
+  assert(count == 1);
+  assert(graph_lib::condense(deep_csr).vertex_count() == 1);
+
+  // Large enough for the parallel search to split parts before handing
+  // them to Tarjan's; both must cut the graph the same way.
+  DirectedGraph random;
+  random.add_edges(graph_lib::random_graph(20000, 40000, 5));
+  CsrGraph random_csr = random.freeze();
+  uint32_t serial_count = 0;
+  uint32_t parallel_count = 0;
+  vector<uint32_t> serial = graph_lib::strongly_connected_components(random_csr, &serial_count);
+  vector<uint32_t> parallel = graph_lib::parallel_strongly_connected_components(random_csr, pool, &parallel_count);
+  assert(serial_count == parallel_count && serial_count > 1 && serial_count < 20000);
+  vector<uint32_t> match(serial_count, kNoVertex);
+  for (uint32_t i = 0; i < serial.size(); i++) {
+    if (match[serial[i]] == kNoVertex) {
+      match[serial[i]] = parallel[i];
+    }
+    assert(match[serial[i]] == parallel[i]);
+  }
+  for (uint32_t i = 0; i < serial.size(); i++) {
+    for (uint32_t j : random_csr.neighbors(i)) {
+      assert(serial[i] <= serial[j] && parallel[i] <= parallel[j]);
+    }
+  }
+  DirectedAcyclicGraph condensed = graph_lib::condense(random_csr, pool);
+  assert(condensed.vertex_count() == int(serial_count));
+}
+
+void test_predecessors() {
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+  auto ids = [](const vector<Vertex*>& vertices) {
+    vector<int> result;
+    for (const Vertex* v : vertices) {
+      result.push_back(v->value().second);
+    }
+    return result;
+  };
+
+  for (bool indexed : {false, true}) {
+    DirectedGraph dg;
+    if (indexed) {
+      dg.enable_reverse_index();
+    }
+    dg.add_edge(&v1, &v3);
+    dg.add_edge(&v2, &v3);
+    dg.add_edge(&v1, &v3);
+    dg.add_edge(&v3, &v4);
+    dg.add(&v4);
+    assert(ids(graph_lib::predecessors(dg, &v3)) == vector<int>({1, 2, 1}));
+    assert(graph_lib::in_degree(dg, &v3) == 3 && graph_lib::out_degree(dg, &v3) == 1);
+    assert(graph_lib::out_degree(dg, &v1) == 2 && graph_lib::in_degree(dg, &v1) == 0);
+    assert(graph_lib::in_degree(dg, &v4) == 1 && graph_lib::out_degree(dg, &v4) == 0);
+
+    dg.remove(&v2);
+    assert(ids(dg.get_predecessors(&v3)) == vector<int>({1, 1}));
+    assert(dg.in_degree(&v3) == 2 && dg.in_degree(&v2) == 0 && dg.out_degree(&v2) == 0);
+    Edge e(std::make_unique<Vertex>(v1), std::make_unique<Vertex>(v3), std::make_unique<Value>(kDummyValue));
+    dg.remove_edge(&e);
+    assert(dg.get_predecessors(&v3).empty() && dg.in_degree(&v3) == 0 && dg.out_degree(&v1) == 0);
+    // A freed slot starts its new vertex at zero.
+    dg.add_edge(&v2, &v4);
+    assert(ids(dg.get_predecessors(&v4)) == vector<int>({3, 2}));
+    assert(dg.out_degree(&v2) == 1 && dg.in_degree(&v2) == 0);
+  }
+
+  // Index, scan and counts agree with a frozen graph's transpose.
+  DirectedGraph random;
+  random.add_edges(graph_lib::random_graph(200, 2000, 3));
+  DirectedGraph indexed = random;
+  indexed.enable_reverse_index();
+  vector<const Vertex*> doomed(6);
+  Vertex doomed_vertices[6] = {Vertex(make_pair("", 0)), Vertex(make_pair("", 7)), Vertex(make_pair("", 50)),
+			       Vertex(make_pair("", 51)), Vertex(make_pair("", 120)), Vertex(make_pair("", 199))};
+  for (int i = 0; i < 6; i++) {
+    doomed[i] = &doomed_vertices[i];
+  }
+  random.remove_vertices(doomed);
+  indexed.remove_vertices(doomed);
+  CsrGraph csr = random.freeze();
+  for (uint32_t i = 0; i < csr.ids().size(); i++) {
+    Vertex* v = csr.vertex(i);
+    vector<int> expected;
+    for (uint32_t source : csr.in_neighbors(i)) {
+      expected.push_back(csr.id(source));
+    }
+    vector<int> scanned = ids(random.get_predecessors(v));
+    vector<int> looked_up = ids(indexed.get_predecessors(v));
+    std::sort(scanned.begin(), scanned.end());
+    std::sort(looked_up.begin(), looked_up.end());
+    assert(scanned == expected && looked_up == expected);
+    assert(random.in_degree(v) == int(expected.size()) && indexed.in_degree(v) == int(expected.size()));
+    assert(csr.in_degree(v) == int(expected.size()));
+    assert(random.out_degree(v) == int(csr.out_degree(i)));
+  }
+
+  Tree tree;
+  tree.add_edge(&v1, &v2);
+  tree.add_edge(&v1, &v3);
+  assert(ids(graph_lib::predecessors(tree, &v3)) == vector<int>({1}));
+  assert(graph_lib::predecessors(tree, &v1).empty());
+  assert(graph_lib::in_degree(tree, &v2) == 1 && graph_lib::in_degree(tree, &v1) == 0);
+  assert(graph_lib::out_degree(tree, &v1) == 2 && graph_lib::out_degree(tree, &v4) == 0);
+
+  DirectedAcyclicGraph dag;
+  dag.add_edge(&v1, &v3);
+  dag.add_edge(&v2, &v3);
+  assert(ids(graph_lib::predecessors(dag, &v3)) == vector<int>({1, 2}));
+  assert(graph_lib::in_degree(dag, &v3) == 2 && graph_lib::out_degree(dag, &v1) == 1);
+
+  DirectedGraph base;
+  base.add_edge(&v1, &v3);
+  base.add_edge(&v2, &v3);
+  OverlayGraph overlay(base.freeze());
+  overlay.remove_edge(&v1, &v3);
+  overlay.add_edge(&v4, &v3);
+  assert(ids(graph_lib::predecessors(overlay, &v3)) == vector<int>({2, 4}));
+  assert(graph_lib::in_degree(overlay, &v3) == 2 && graph_lib::out_degree(overlay, &v4) == 1);
+}
+
+void test_compressed() {
+  DirectedGraph dg;
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v9(make_pair("I", 9));
+  dg.add_edge(&v3, &v1);
+  dg.add_edge(&v1, &v2);
+  dg.add_edge(&v1, &v9);
+  dg.add_edge(&v1, &v2);
+  dg.add(&v9);
+  CsrGraph csr = dg.freeze();
+  CompressedGraph g(csr);
+  assert(g.vertex_count() == 4 && g.edge_count() == 4);
+  assert(graph_lib::adjacent(g, &v1, &v9) && graph_lib::adjacent(g, &v3, &v1));
+  assert(!graph_lib::adjacent(g, &v9, &v1) && !graph_lib::adjacent(g, &v1, &v3));
+  vector<Vertex*> neighbors = graph_lib::neighbors(g, &v1);
+  assert(neighbors.size() == 3);
+  assert(*neighbors[0] == v2 && *neighbors[1] == v2 && *neighbors[2] == v9);
+  assert(neighbors[2]->value() == make_pair(string("I"), 9));
+  assert(graph_lib::predecessors(g, &v2).size() == 2 && graph_lib::in_degree(g, &v1) == 1);
+  assert(graph_lib::out_degree(g, &v1) == 3 && graph_lib::out_degree(g, &v9) == 0);
+  assert(!graph_lib::add_edge(g, &v9, &v1) && g.edge_count() == 4);
+  assert(g.to_string() == csr.to_string());
+  assert(graph_lib::count_vertices(g) == 4 && graph_lib::top(g)->value().second == 1);
+
+  // Rows with long gaps, backward first entries, repeats and runs of
+  // one-byte gaps all decode to the CSR's rows, both ways round.
+  for (auto specs : {graph_lib::random_graph(3000, 40000, 11), graph_lib::rmat_graph(12, 40000, 11)}) {
+    specs.push_back(EdgeSpec{5, 1 << 30, kDummyValue});
+    for (int i = 0; i < 40; i++) {
+      specs.push_back(EdgeSpec{7, 100 + i, kDummyValue});
+      specs.push_back(EdgeSpec{7, 100 + i, kDummyValue});
+    }
+    DirectedGraph big;
+    big.add_edges(specs);
+    CsrGraph big_csr = big.freeze();
+    CompressedGraph compressed(big_csr);
+    assert(compressed.edge_count() == big_csr.edge_count());
+    vector<uint32_t> row;
+    for (uint32_t i = 0; i < big_csr.ids().size(); i++) {
+      Span<const uint32_t> expected = big_csr.neighbors(i);
+      compressed.neighbors(i, &row);
+      assert(row.size() == expected.size() && std::equal(row.begin(), row.end(), expected.begin()));
+      assert(compressed.out_degree(i) == big_csr.out_degree(i));
+      Span<const uint32_t> sources = big_csr.in_neighbors(i);
+      compressed.in_neighbors(i, &row);
+      assert(row.size() == sources.size() && std::equal(row.begin(), row.end(), sources.begin()));
+    }
+    // A transpose built in small blocks matches one built whole.
+    CompressedRows whole = compressed.rows().transpose(big_csr.ids().size());
+    CompressedRows blocked = compressed.rows().transpose(big_csr.ids().size(), 100);
+    assert(whole.count() == blocked.count() && whole.bytes() == blocked.bytes());
+    for (uint32_t j = 0; j < whole.size(); j++) {
+      vector<uint32_t> a;
+      vector<uint32_t> b;
+      whole.decode(j, [&a](uint32_t i) {
+	  a.push_back(i);
+	  return true;
+	});
+      blocked.decode(j, [&b](uint32_t i) {
+	  b.push_back(i);
+	  return true;
+	});
+      assert(a == b);
+    }
+    Vertex* source = big_csr.vertex(0);
+    assert(graph_lib::bfs(compressed, source).size() == graph_lib::bfs(big_csr, source).size());
+  }
+
+  // Neighbors close in ID order cost about a byte per edge.
+  DirectedGraph local;
+  local.add_edges(graph_lib::layered_dag(100, 100, 8, 3));
+  CsrGraph local_csr = local.freeze();
+  CompressedGraph local_compressed(local_csr);
+  size_t csr_bytes = local_csr.offsets().size() * sizeof(uint64_t) + local_csr.targets().size() * sizeof(uint32_t);
+  assert(local_compressed.edge_bytes() * 2 < csr_bytes);
+}
+
+void test_sharded() {
+  ShardedGraph g(4);
+  Vertex v1(make_pair("A", 1));
+  Vertex v2(make_pair("B", 2));
+  Vertex v3(make_pair("C", 3));
+  Vertex v4(make_pair("D", 4));
+  assert(g.shard_count() == 4 && g.vertex_count() == 0 && !g.top());
+  assert(graph_lib::add_edge(g, &v1, &v2));
+  assert(graph_lib::add_edge(g, &v1, &v3));
+  assert(graph_lib::add_edge(g, &v3, &v2));
+  assert(graph_lib::add(g, &v4));
+  assert(g.vertex_count() == 4 && g.edge_count() == 3);
+  assert(graph_lib::adjacent(g, &v1, &v3) && !graph_lib::adjacent(g, &v2, &v1));
+  vector<Vertex*> neighbors = graph_lib::neighbors(g, &v1);
+  assert(neighbors.size() == 2 && *neighbors[0] == v2 && *neighbors[1] == v3);
+  assert(neighbors[1]->value() == make_pair(string("C"), 3));
+  assert(graph_lib::predecessors(g, &v2).size() == 2 && graph_lib::in_degree(g, &v2) == 2);
+  assert(graph_lib::out_degree(g, &v1) == 2 && graph_lib::out_degree(g, &v4) == 0);
+  assert(g.find(&v2) && g.find(&v2)->value().first == "B");
+  assert(graph_lib::bfs(g, &v1).size() == 3);
+  // A vertex outlives its edges, as in OverlayGraph.
+  Edge e(std::make_unique<Vertex>(v3), std::make_unique<Vertex>(v2), std::make_unique<Value>(kDummyValue));
+  assert(g.remove_edge(&e) && g.edge_count() == 2 && g.vertex_count() == 4);
+  graph_lib::remove(g, &v1);
+  assert(g.vertex_count() == 3 && g.edge_count() == 0 && graph_lib::in_degree(g, &v3) == 0);
+  assert(g.freeze().vertex_count() == 3);
+
+  // Ranges put IDs below 100 in shard 0 and the rest in shard 1.
+  ShardedGraph ranged(vector<int>{100});
+  assert(ranged.shard_count() == 2 && ranged.shard_of(99) == 0 && ranged.shard_of(100) == 1);
+  assert(ranged.shard_of(-5) == 0 && ranged.shard_of(1 << 30) == 1);
+
+  // A bulk load, serial or parallel, matches a DirectedGraph's, and so
+  // do a parallel BFS and a freeze across shards.
+  vector<EdgeSpec> specs = graph_lib::random_graph(5000, 30000, 17);
+  vector<Vertex> vertices;
+  for (int i = 0; i < 5000; i += 3) {
+    vertices.emplace_back(make_pair("v" + std::to_string(i), i));
+  }
+  DirectedGraph dg;
+  dg.enable_index();
+  dg.add_edges(specs, vertices);
+  CsrGraph expected = dg.freeze();
+  ThreadPool pool(4);
+  ShardedGraph big(8);
+  big.add_edges(specs, vertices, pool);
+  ShardedGraph serial(vector<int>{1000, 2000, 4000});
+  serial.add_edges(specs, vertices);
+  for (ShardedGraph* sharded : {&big, &serial}) {
+    assert(sharded->edge_count() == dg.edge_count() && sharded->vertex_count() == dg.vertex_count());
+    CsrGraph frozen = sharded->freeze();
+    assert(frozen.to_string() == expected.to_string());
+    for (uint32_t i = 0; i < expected.ids().size(); i += 7) {
+      Vertex* v = expected.vertex(i);
+      assert(sharded->out_degree(v) == dg.out_degree(v) && sharded->in_degree(v) == dg.in_degree(v));
+      assert(sharded->find(v)->value() == v->value());
+      Vertex* source = dg.find(v);
+      vector<Vertex*> order = sharded->parallel_bfs(source, pool);
+      vector<Vertex*> reference = graph_lib::bfs(dg, source);
+      assert(order.size() == reference.size() && order[0] == source);
+      std::set<int> a;
+      std::set<int> b;
+      for (size_t k = 0; k < order.size(); k++) {
+	a.insert(order[k]->value().second);
+	b.insert(reference[k]->value().second);
+	assert(k == 0 || sharded->find(order[k]) == order[k]);
+      }
+      assert(a == b);
+    }
+    uint64_t cross = 0;
+    for (uint32_t i = 0; i < frozen.ids().size(); i++) {
+      for (uint32_t j : frozen.neighbors(i)) {
+	cross += sharded->shard_of(frozen.id(i)) != sharded->shard_of(frozen.id(j));
+      }
+    }
+    assert(sharded->cross_shard_edges(pool) == cross);
+  }
+  // Parallel BFS levels match sequential ones.
+  Vertex* source = dg.find(expected.vertex(0));
+  vector<uint32_t> depth = graph_lib::parallel_bfs(expected, vector<uint32_t>{0}, pool);
+  vector<Vertex*> order = big.parallel_bfs(source, pool);
+  for (size_t k = 1; k < order.size(); k++) {
+    assert(depth[expected.index_of(order[k - 1])] <= depth[expected.index_of(order[k])]);
+  }
+
+  // Writers on different threads share no lock unless their sources'
+  // shards meet.
+  ShardedGraph concurrent(4);
+  vector<std::thread> writers;
+  for (int t = 0; t < 4; t++) {
+    writers.emplace_back([&concurrent, t]() {
+	for (int i = 0; i < 500; i++) {
+	  Vertex u(make_pair("u", t * 1000 + i));
+	  Vertex v(make_pair("v", (t * 1000 + i * 7) % 4000));
+	  concurrent.add_edge(&u, &v);
+	  concurrent.get_neighbors(&u);
+	}
+      });
+  }
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  assert(concurrent.edge_count() == 2000);
+  assert(concurrent.freeze().edge_count() == 2000);
+
+  // Removing a vertex while edges to it go in leaves no edge whose end
+  // no shard owns.
+  ShardedGraph racing(4);
+  Vertex hub(make_pair("hub", 0));
+  std::thread remover([&racing, &hub]() {
+      for (int i = 0; i < 500; i++) {
+	racing.remove(&hub);
+      }
+    });
+  for (int i = 1; i <= 500; i++) {
+    Vertex u(make_pair("u", i));
+    racing.add_edge(&u, &hub);
+  }
+  remover.join();
+  assert(racing.freeze().edge_count() == racing.edge_count());
+  assert(racing.edge_count() == 0 || racing.find(&hub));
+}
+
 int main() {
   assert(__cpp_concepts >= 201500); // check compiled with -fconcepts
   assert(__cplusplus >= 201500);    // check compiled with --std=c++1z
@@ -456,5 +2400,65 @@ int main() {
   test_set_edge_value();
   cout << "Testing top().\n";
   test_top();
+  cout << "Testing freeze().\n";
+  test_freeze();
+  cout << "Testing interned vertices.\n";
+  test_interned_vertices();
+  cout << "Testing incremental cycle checks.\n";
+  test_incremental_cycle_check();
+  cout << "Testing adjacency index.\n";
+  test_adjacency_index();
+  cout << "Testing edge and neighbor views.\n";
+  test_views();
+  cout << "Testing maintained counts.\n";
+  test_maintained_counts();
+  cout << "Testing remove_vertices() and remove_edges().\n";
+  test_remove_vertices();
+  cout << "Testing bulk loading.\n";
+  test_bulk_load();
+  cout << "Testing snapshots.\n";
+  test_snapshot();
+  cout << "Testing arena allocation.\n";
+  test_arena();
+  cout << "Testing traversals.\n";
+  test_traversal();
+  cout << "Testing topological_order() and levels().\n";
+  test_topological_order();
+  cout << "Testing DAG executor.\n";
+  test_executor();
+  cout << "Testing shortest paths.\n";
+  test_shortest_paths();
+  cout << "Testing concurrent readers.\n";
+  test_concurrent_reads();
+  cout << "Testing overlay graph.\n";
+  test_overlay();
+  cout << "Testing Tree storage.\n";
+  test_tree();
+  cout << "Testing ancestor queries.\n";
+  test_ancestors();
+  cout << "Testing reachability index.\n";
+  test_reachability_index();
+  cout << "Testing generators.\n";
+  test_generators();
+  cout << "Testing stats().\n";
+  test_stats();
+  cout << "Testing payload and ID types.\n";
+  test_payload_types();
+  cout << "Testing intersect() and triangle counts.\n";
+  test_intersect();
+  cout << "Testing edge list loading.\n";
+  test_edge_list();
+  cout << "Testing the graph writer.\n";
+  test_writer();
+  cout << "Testing batched DAG changes.\n";
+  test_batch();
+  cout << "Testing strongly connected components.\n";
+  test_scc();
+  cout << "Testing predecessors and degrees.\n";
+  test_predecessors();
+  cout << "Testing compressed graphs.\n";
+  test_compressed();
+  cout << "Testing sharded graphs.\n";
+  test_sharded();
   cout << "All tests passed.\n";
 }
@@ -0,0 +1,396 @@
+// A frozen CsrGraph base plus a small mutable delta: vertices and edges
+// added since the base was built, and tombstones for base vertices and
+// edges removed since. Queries merge the two, so a trickle of changes
+// costs no rebuild. compact() folds the delta into a new base, on a
+// background thread if started with start_compaction().
+//
+// Unlike DirectedGraph, a vertex stays until it is removed, with or
+// without edges. Edges may repeat; removing one removes every copy.
+class OverlayGraph {
+ public:
+  OverlayGraph() : OverlayGraph(CsrGraph()) {}
+  explicit OverlayGraph(CsrGraph base) : base_(std::move(base)) {
+    num_vertices_ = base_.vertex_count();
+    num_edges_ = base_.edge_count();
+  }
+
+  OverlayGraph(const OverlayGraph&) = delete;
+  OverlayGraph& operator=(const OverlayGraph&) = delete;
+
+  ~OverlayGraph() {
+    if (compactor_.joinable()) {
+      compactor_.join();
+    }
+  }
+
+  bool add(const Vertex* v) {
+    log_(Op{Op::kAdd, *v, *v});
+    add_vertex_(*v);
+    return true;
+  }
+
+  bool add_edge(const Vertex* u, const Vertex* v) {
+    log_(Op{Op::kAddEdge, *u, *v});
+    add_vertex_(*u);
+    add_vertex_(*v);
+    delta_.added_edges[u->value().second].push_back(v->value().second);
+    num_edges_++;
+    return true;
+  }
+
+  bool add_edge(const Edge* e) {
+    if (e->get_source() && e->get_dest()) {
+      return add_edge(e->get_source().get(), e->get_dest().get());
+    }
+    // A dangling edge only brings in the end it has.
+    if (e->get_source()) {
+      add(e->get_source().get());
+    }
+    if (e->get_dest()) {
+      add(e->get_dest().get());
+    }
+    return true;
+  }
+
+  // Removes every edge from u to v.
+  void remove_edge(const Vertex* u, const Vertex* v) {
+    log_(Op{Op::kRemoveEdge, *u, *v});
+    int source = u->value().second;
+    int dest = v->value().second;
+    auto added = delta_.added_edges.find(source);
+    if (added != delta_.added_edges.end()) {
+      vector<int>& dests = added->second;
+      size_t before = dests.size();
+      dests.erase(std::remove(dests.begin(), dests.end(), dest), dests.end());
+      num_edges_ -= before - dests.size();
+    }
+    uint32_t i = base_index_(source);
+    uint32_t j = base_index_(dest);
+    if (i != kNoVertex && j != kNoVertex && delta_.tombstones.insert(edge_key_(source, dest)).second) {
+      Span<const uint32_t> row = base_.neighbors(i);
+      num_edges_ -= std::upper_bound(row.begin(), row.end(), j) - std::lower_bound(row.begin(), row.end(), j);
+    }
+  }
+
+  // Removes v with every edge into or out of it.
+  void remove(const Vertex* v) {
+    log_(Op{Op::kRemove, *v, *v});
+    int id = v->value().second;
+    uint32_t i = base_index_(id);
+    if (i != kNoVertex) {
+      // Count its base edges that are still live before marking it.
+      for (uint32_t j : base_.neighbors(i)) {
+	if (base_edge_live_(i, j)) {
+	  num_edges_--;
+	}
+      }
+      for (uint32_t j : base_.in_neighbors(i)) {
+	// A self-loop was counted above.
+	if (j != i && base_edge_live_(j, i)) {
+	  num_edges_--;
+	}
+      }
+      delta_.removed.insert(id);
+    } else if (!delta_.added_vertices.erase(id)) {
+      return;
+    }
+    num_vertices_--;
+    auto out = delta_.added_edges.find(id);
+    if (out != delta_.added_edges.end()) {
+      num_edges_ -= out->second.size();
+      delta_.added_edges.erase(out);
+    }
+    for (auto& entry : delta_.added_edges) {
+      vector<int>& dests = entry.second;
+      size_t before = dests.size();
+      dests.erase(std::remove(dests.begin(), dests.end(), id), dests.end());
+      num_edges_ -= before - dests.size();
+    }
+  }
+
+  bool are_adjacent(const Vertex* u, const Vertex* v) const {
+    int source = u->value().second;
+    int dest = v->value().second;
+    auto added = delta_.added_edges.find(source);
+    if (added != delta_.added_edges.end()
+	&& std::find(added->second.begin(), added->second.end(), dest) != added->second.end()) {
+      return true;
+    }
+    uint32_t i = base_index_(source);
+    uint32_t j = base_index_(dest);
+    if (i == kNoVertex || j == kNoVertex || delta_.tombstones.count(edge_key_(source, dest))) {
+      return false;
+    }
+    Span<const uint32_t> row = base_.neighbors(i);
+    return std::binary_search(row.begin(), row.end(), j);
+  }
+
+  int edge_count() const {
+    return num_edges_;
+  }
+
+  // Live base neighbors in ID order, then neighbors added since.
+  vector<Vertex*> get_neighbors(Vertex* vertex) const {
+    vector<Vertex*> neighbors;
+    int source = vertex->value().second;
+    uint32_t i = base_index_(source);
+    if (i != kNoVertex) {
+      for (uint32_t j : base_.neighbors(i)) {
+	if (base_edge_live_(i, j)) {
+	  neighbors.push_back(base_.vertex(j));
+	}
+      }
+    }
+    auto added = delta_.added_edges.find(source);
+    if (added != delta_.added_edges.end()) {
+      for (int dest : added->second) {
+	neighbors.push_back(vertex_(dest));
+      }
+    }
+    return neighbors;
+  }
+
+  // Live base predecessors in ID order, then those added since. The
+  // added edges are kept by source, so finding them reads every one.
+  vector<Vertex*> get_predecessors(Vertex* vertex) const {
+    vector<Vertex*> predecessors;
+    int dest = vertex->value().second;
+    uint32_t j = base_index_(dest);
+    if (j != kNoVertex) {
+      for (uint32_t i : base_.in_neighbors(j)) {
+	if (base_edge_live_(i, j)) {
+	  predecessors.push_back(base_.vertex(i));
+	}
+      }
+    }
+    for (const auto& entry : delta_.added_edges) {
+      for (int added : entry.second) {
+	if (added == dest) {
+	  predecessors.push_back(vertex_(entry.first));
+	}
+      }
+    }
+    return predecessors;
+  }
+
+  int in_degree(const Vertex* v) const {
+    return get_predecessors(const_cast<Vertex*>(v)).size();
+  }
+
+  int out_degree(const Vertex* v) const {
+    return get_neighbors(const_cast<Vertex*>(v)).size();
+  }
+
+  // Merging leaves nothing to view in place, so this is get_neighbors();
+  // it lets the graph_lib traversals run on an overlay.
+  vector<Vertex*> neighbor_view(const Vertex* vertex) const {
+    return get_neighbors(const_cast<Vertex*>(vertex));
+  }
+
+  string to_string() const {
+    return merge_(base_, delta_).to_string();
+  }
+
+  // The live vertex with the smallest ID.
+  Vertex* top() const {
+    Vertex* top = nullptr;
+    for (uint32_t i = 0; i < base_.ids().size(); i++) {
+      if (!delta_.removed.count(base_.id(i))) {
+	top = base_.vertex(i);
+	break;
+      }
+    }
+    if (!delta_.added_vertices.empty()) {
+      Vertex* added = const_cast<Vertex*>(&delta_.added_vertices.begin()->second);
+      if (!top || added->value().second < top->value().second) {
+	top = added;
+      }
+    }
+    return top;
+  }
+
+  int vertex_count() const {
+    return num_vertices_;
+  }
+
+  const CsrGraph& base() const {
+    return base_;
+  }
+
+  // Number of changes held in the delta.
+  size_t delta_size() const {
+    size_t added_edges = 0;
+    for (const auto& entry : delta_.added_edges) {
+      added_edges += entry.second.size();
+    }
+    return delta_.added_vertices.size() + delta_.removed.size() + added_edges + delta_.tombstones.size();
+  }
+
+  // Folds the delta into a new base now.
+  void compact() {
+    finish_compaction(true);
+    install_(merge_(base_, delta_));
+  }
+
+  // Starts folding a copy of the delta into a new base on a background
+  // thread. The graph stays usable meanwhile: changes made before the
+  // new base is installed are replayed onto it. Returns false if a
+  // compaction is already running.
+  bool start_compaction() {
+    if (compacting_) {
+      return false;
+    }
+    compacting_ = true;
+    compacted_ready_.store(false);
+    compactor_ = std::thread([this, base = base_, delta = delta_]() {
+	compacted_ = merge_(base, delta);
+	compacted_ready_.store(true, std::memory_order_release);
+      });
+    return true;
+  }
+
+  // Installs the base built by start_compaction() if it is ready or, with
+  // wait, once it is. Returns whether a new base was installed.
+  bool finish_compaction(bool wait = true) {
+    if (!compacting_ || (!wait && !compacted_ready_.load(std::memory_order_acquire))) {
+      return false;
+    }
+    compactor_.join();
+    compacting_ = false;
+    CsrGraph compacted = std::move(compacted_);
+    vector<Op> log = std::move(log_ops_);
+    log_ops_.clear();
+    install_(std::move(compacted));
+    for (const Op& op : log) {
+      replay_(op);
+    }
+    return true;
+  }
+
+ private:
+  struct Delta {
+    // Vertices outside the base, or removed from it and added back. A map
+    // keeps Vertex* stable and orders them by ID.
+    std::map<int, Vertex> added_vertices;
+    // IDs of base vertices removed; their base edges are gone too.
+    std::unordered_set<int> removed;
+    // Source ID -> dest IDs, one entry per added edge.
+    std::unordered_map<int, vector<int>> added_edges;
+    // (Source ID, dest ID) of base edges removed.
+    std::unordered_set<uint64_t> tombstones;
+  };
+
+  // A change recorded while a compaction runs.
+  struct Op {
+    enum Kind { kAdd, kAddEdge, kRemoveEdge, kRemove } kind;
+    Vertex u;
+    Vertex v;
+  };
+
+  CsrGraph base_;
+  Delta delta_;
+  int num_vertices_;
+  int num_edges_;
+  std::thread compactor_;
+  bool compacting_ = false;
+  std::atomic<bool> compacted_ready_{false};
+  CsrGraph compacted_;
+  vector<Op> log_ops_;
+
+  static uint64_t edge_key_(int source, int dest) {
+    return uint64_t(uint32_t(source)) << 32 | uint32_t(dest);
+  }
+
+  // Index in the base of the live vertex id, or kNoVertex.
+  uint32_t base_index_(int id) const {
+    uint32_t i = base_.index_of(id);
+    return i != kNoVertex && !delta_.removed.count(id) ? i : kNoVertex;
+  }
+
+  bool base_edge_live_(uint32_t i, uint32_t j) const {
+    int source = base_.id(i);
+    int dest = base_.id(j);
+    return !delta_.removed.count(source) && !delta_.removed.count(dest)
+      && !delta_.tombstones.count(edge_key_(source, dest));
+  }
+
+  Vertex* vertex_(int id) const {
+    auto added = delta_.added_vertices.find(id);
+    if (added != delta_.added_vertices.end()) {
+      return const_cast<Vertex*>(&added->second);
+    }
+    return base_.vertex(base_.index_of(id));
+  }
+
+  void add_vertex_(const Vertex& v) {
+    int id = v.value().second;
+    if (base_index_(id) == kNoVertex && delta_.added_vertices.emplace(id, v).second) {
+      num_vertices_++;
+    }
+  }
+
+  void log_(const Op& op) {
+    if (compacting_) {
+      log_ops_.push_back(op);
+    }
+  }
+
+  void replay_(const Op& op) {
+    switch (op.kind) {
+    case Op::kAdd:
+      add(&op.u);
+      break;
+    case Op::kAddEdge:
+      add_edge(&op.u, &op.v);
+      break;
+    case Op::kRemoveEdge:
+      remove_edge(&op.u, &op.v);
+      break;
+    case Op::kRemove:
+      remove(&op.u);
+      break;
+    }
+  }
+
+  void install_(CsrGraph base) {
+    base_ = std::move(base);
+    delta_ = Delta();
+    num_vertices_ = base_.vertex_count();
+    num_edges_ = base_.edge_count();
+  }
+
+  // The live graph as a new base.
+  static CsrGraph merge_(const CsrGraph& base, const Delta& delta) {
+    vector<const Vertex*> vertices;
+    std::unordered_map<int, uint32_t> position;
+    vector<uint32_t> base_position(base.vertex_count(), kNoVertex);
+    for (uint32_t i = 0; i < base.ids().size(); i++) {
+      if (!delta.removed.count(base.id(i))) {
+	base_position[i] = vertices.size();
+	position.emplace(base.id(i), vertices.size());
+	vertices.push_back(base.vertex(i));
+      }
+    }
+    for (const auto& entry : delta.added_vertices) {
+      position.emplace(entry.first, vertices.size());
+      vertices.push_back(&entry.second);
+    }
+    vector<std::pair<uint32_t, uint32_t>> edges;
+    for (uint32_t i = 0; i < base.ids().size(); i++) {
+      if (base_position[i] == kNoVertex) {
+	continue;
+      }
+      for (uint32_t j : base.neighbors(i)) {
+	if (base_position[j] != kNoVertex && !delta.tombstones.count(edge_key_(base.id(i), base.id(j)))) {
+	  edges.emplace_back(base_position[i], base_position[j]);
+	}
+      }
+    }
+    for (const auto& entry : delta.added_edges) {
+      for (int dest : entry.second) {
+	edges.emplace_back(position[entry.first], position[dest]);
+      }
+    }
+    return CsrGraph(vertices, edges);
+  }
+};
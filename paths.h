@@ -0,0 +1,471 @@
+// Weighted path searches. They run on a WeightedGraph, a compact copy of
+// a graph's edges with their weights, built once and reusable across
+// searches. Weights are the second part of each edge's Value unless a
+// projection says otherwise.
+
+const int64_t kUnreachable = INT64_MAX;
+
+// Out-edges grouped by source with their weights: the edges of vertex i
+// are targets()[offsets()[i], offsets()[i + 1]), weighed by the matching
+// entries of weights(). Vertices are numbered in order of first
+// appearance and known to callers by ID.
+class WeightedGraph {
+ public:
+  struct Numbering {
+    vector<int> ids;
+    std::unordered_map<int, uint32_t> index;
+  };
+
+  // Reads the edges of any graph with edges(), such as
+  // graph_lib::edges(g). weight maps an edge's Value to its weight.
+  template<typename Edges, typename Weight>
+  WeightedGraph(const Edges& edges, const Weight& weight) : numbering_(std::make_shared<Numbering>()) {
+    Numbering& numbering = *numbering_;
+    auto number = [&numbering](const Vertex* v) {
+      auto inserted = numbering.index.emplace(v->value().second, numbering.ids.size());
+      if (inserted.second) {
+	numbering.ids.push_back(v->value().second);
+      }
+      return inserted.first->second;
+    };
+    for (const auto& e : edges) {
+      if (e.get_source()) {
+	number(e.get_source());
+      }
+      if (e.get_dest()) {
+	number(e.get_dest());
+      }
+    }
+    offsets_.assign(numbering.ids.size() + 1, 0);
+    for (const auto& e : edges) {
+      if (e.get_source() && e.get_dest()) {
+	offsets_[numbering.index[e.get_source()->value().second] + 1]++;
+      }
+    }
+    for (size_t i = 1; i < offsets_.size(); i++) {
+      offsets_[i] += offsets_[i - 1];
+    }
+    targets_.resize(offsets_.back());
+    weights_.resize(offsets_.back());
+    vector<uint64_t> cursor(offsets_.begin(), offsets_.end() - 1);
+    for (const auto& e : edges) {
+      if (e.get_source() && e.get_dest()) {
+	uint64_t i = cursor[numbering.index[e.get_source()->value().second]]++;
+	targets_[i] = numbering.index[e.get_dest()->value().second];
+	weights_[i] = weight(e.value());
+      }
+    }
+  }
+
+  template<typename Edges>
+  explicit WeightedGraph(const Edges& edges) : WeightedGraph(edges, [](const Value& value) {
+      return int64_t(value.second);
+    }) {}
+
+  uint32_t vertex_count() const {
+    return numbering_->ids.size();
+  }
+
+  // Dense index of the vertex with v's ID, or kNoVertex if absent.
+  uint32_t index_of(const Vertex* v) const {
+    auto it = numbering_->index.find(v->value().second);
+    return it != numbering_->index.end() ? it->second : kNoVertex;
+  }
+
+  std::shared_ptr<const Numbering> numbering() const {
+    return numbering_;
+  }
+
+  Span<const uint64_t> offsets() const {
+    return offsets_;
+  }
+
+  Span<const uint32_t> targets() const {
+    return targets_;
+  }
+
+  Span<const int64_t> weights() const {
+    return weights_;
+  }
+
+ private:
+  std::shared_ptr<Numbering> numbering_;
+  vector<uint64_t> offsets_;
+  vector<uint32_t> targets_;
+  vector<int64_t> weights_;
+};
+
+// The result of a search: a distance per vertex and a tree of the paths
+// achieving them. Queries are by vertex and outlive the WeightedGraph.
+class PathTree {
+ public:
+  PathTree() : numbering_(std::make_shared<WeightedGraph::Numbering>()) {}
+  PathTree(std::shared_ptr<const WeightedGraph::Numbering> numbering, vector<int64_t> distances,
+	   vector<uint32_t> parents)
+    : numbering_(std::move(numbering)), distances_(std::move(distances)), parents_(std::move(parents)) {}
+
+  bool reached(const Vertex* v) const {
+    return distance(v) != kUnreachable;
+  }
+
+  // Length of the best path to v, or kUnreachable.
+  int64_t distance(const Vertex* v) const {
+    uint32_t i = index_of_(v);
+    return i != kNoVertex ? distances_[i] : kUnreachable;
+  }
+
+  // IDs of the vertices along the best path to v, from the start of the
+  // path to v itself; empty if v was not reached.
+  vector<int> path(const Vertex* v) const {
+    vector<int> ids;
+    uint32_t i = index_of_(v);
+    if (i == kNoVertex || distances_[i] == kUnreachable) {
+      return ids;
+    }
+    for (; i != kNoVertex; i = parents_[i]) {
+      ids.push_back(numbering_->ids[i]);
+    }
+    std::reverse(ids.begin(), ids.end());
+    return ids;
+  }
+
+ private:
+  std::shared_ptr<const WeightedGraph::Numbering> numbering_;
+  vector<int64_t> distances_;
+  // Previous vertex on the best path, kNoVertex at its start.
+  vector<uint32_t> parents_;
+
+  uint32_t index_of_(const Vertex* v) const {
+    auto it = numbering_->index.find(v->value().second);
+    return it != numbering_->index.end() ? it->second : kNoVertex;
+  }
+};
+
+// A 4-ary min-heap of (key, vertex). Four children per node share a
+// cache line or two, and the tree is half as deep as a binary heap's.
+// There is no decrease-key: callers push again and skip stale entries.
+class MinHeap {
+ public:
+  typedef std::pair<int64_t, uint32_t> Entry;
+
+  bool empty() const {
+    return entries_.empty();
+  }
+
+  void push(int64_t key, uint32_t vertex) {
+    entries_.emplace_back(key, vertex);
+    size_t i = entries_.size() - 1;
+    while (i > 0 && entries_[i] < entries_[parent_(i)]) {
+      std::swap(entries_[i], entries_[parent_(i)]);
+      i = parent_(i);
+    }
+  }
+
+  Entry pop() {
+    Entry top = entries_[0];
+    entries_[0] = entries_.back();
+    entries_.pop_back();
+    for (size_t i = 0; ; ) {
+      size_t first = kArity * i + 1;
+      if (first >= entries_.size()) {
+	break;
+      }
+      size_t least = first;
+      for (size_t c = first + 1; c < std::min(first + kArity, entries_.size()); c++) {
+	if (entries_[c] < entries_[least]) {
+	  least = c;
+	}
+      }
+      if (!(entries_[least] < entries_[i])) {
+	break;
+      }
+      std::swap(entries_[i], entries_[least]);
+      i = least;
+    }
+    return top;
+  }
+
+ private:
+  static const size_t kArity = 4;
+  vector<Entry> entries_;
+
+  static size_t parent_(size_t i) {
+    return (i - 1) / kArity;
+  }
+};
+
+namespace graph_lib {
+  // Shortest paths from source by Dijkstra's algorithm. Returns false,
+  // leaving tree untouched, if some edge has a negative weight.
+  bool shortest_paths(const WeightedGraph& g, const Vertex* source, PathTree* tree) {
+    for (int64_t w : g.weights()) {
+      if (w < 0) {
+	return false;
+      }
+    }
+    vector<int64_t> distances(g.vertex_count(), kUnreachable);
+    vector<uint32_t> parents(g.vertex_count(), kNoVertex);
+    uint32_t start = g.index_of(source);
+    if (start != kNoVertex) {
+      Span<const uint64_t> offsets = g.offsets();
+      Span<const uint32_t> targets = g.targets();
+      Span<const int64_t> weights = g.weights();
+      MinHeap heap;
+      distances[start] = 0;
+      heap.push(0, start);
+      while (!heap.empty()) {
+	MinHeap::Entry entry = heap.pop();
+	uint32_t u = entry.second;
+	if (entry.first > distances[u]) {
+	  continue;
+	}
+	for (uint64_t i = offsets[u]; i < offsets[u + 1]; i++) {
+	  int64_t candidate = entry.first + weights[i];
+	  if (candidate < distances[targets[i]]) {
+	    distances[targets[i]] = candidate;
+	    parents[targets[i]] = u;
+	    heap.push(candidate, targets[i]);
+	  }
+	}
+      }
+    }
+    *tree = PathTree(g.numbering(), std::move(distances), std::move(parents));
+    return true;
+  }
+
+  // Shortest paths from source by delta-stepping (Meyer & Sanders,
+  // "Delta-stepping: a parallelizable shortest path algorithm", 2003),
+  // relaxing each bucket's edges on pool. Vertices are bucketed by
+  // distance in steps of delta; the light edges (weight at most delta) of
+  // a bucket are relaxed until it stops refilling, then its heavy edges
+  // once. A delta near the typical edge weight works well. Returns false,
+  // leaving tree untouched, if delta is not positive or some edge has a
+  // negative weight.
+  bool shortest_paths(const WeightedGraph& g, const Vertex* source, int64_t delta, ThreadPool& pool,
+		      PathTree* tree) {
+    if (delta <= 0) {
+      return false;
+    }
+    for (int64_t w : g.weights()) {
+      if (w < 0) {
+	return false;
+      }
+    }
+    const uint32_t n = g.vertex_count();
+    Span<const uint64_t> offsets = g.offsets();
+    Span<const uint32_t> targets = g.targets();
+    Span<const int64_t> weights = g.weights();
+    unique_ptr<std::atomic<int64_t>[]> distance(new std::atomic<int64_t>[n]);
+    for (uint32_t i = 0; i < n; i++) {
+      distance[i].store(kUnreachable, std::memory_order_relaxed);
+    }
+    uint32_t start = g.index_of(source);
+    vector<vector<uint32_t>> buckets;
+    auto place = [&buckets, delta](uint32_t v, int64_t d) {
+      size_t b = d / delta;
+      if (b >= buckets.size()) {
+	buckets.resize(b + 1);
+      }
+      buckets[b].push_back(v);
+    };
+    if (start != kNoVertex) {
+      distance[start].store(0, std::memory_order_relaxed);
+      place(start, 0);
+    }
+
+    // Relaxes the light or heavy edges out of vertices in parallel and
+    // buckets every vertex whose distance dropped.
+    auto relax = [&](const vector<uint32_t>& vertices, bool light) {
+      vector<std::pair<uint32_t, int64_t>> improved;
+      std::mutex improved_mutex;
+      pool.parallel_for(vertices.size(), [&](size_t begin, size_t end) {
+	  vector<std::pair<uint32_t, int64_t>> found;
+	  for (size_t k = begin; k < end; k++) {
+	    uint32_t u = vertices[k];
+	    int64_t du = distance[u].load(std::memory_order_relaxed);
+	    for (uint64_t i = offsets[u]; i < offsets[u + 1]; i++) {
+	      if ((weights[i] <= delta) != light) {
+		continue;
+	      }
+	      int64_t candidate = du + weights[i];
+	      std::atomic<int64_t>& dv = distance[targets[i]];
+	      int64_t current = dv.load(std::memory_order_relaxed);
+	      while (candidate < current && !dv.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+	      }
+	      if (candidate < current) {
+		found.emplace_back(targets[i], candidate);
+	      }
+	    }
+	  }
+	  std::lock_guard<std::mutex> lock(improved_mutex);
+	  improved.insert(improved.end(), found.begin(), found.end());
+	});
+      for (const auto& entry : improved) {
+	// Later improvements leave stale entries behind; the bucket scan
+	// skips them.
+	if (distance[entry.first].load(std::memory_order_relaxed) == entry.second) {
+	  place(entry.first, entry.second);
+	}
+      }
+    };
+
+    vector<bool> queued(n, false);
+    for (size_t b = 0; b < buckets.size(); b++) {
+      vector<uint32_t> settled;
+      while (!buckets[b].empty()) {
+	vector<uint32_t> frontier;
+	for (uint32_t v : buckets[b]) {
+	  // Keep each vertex once, and only if it still belongs here.
+	  if (!queued[v] && size_t(distance[v].load(std::memory_order_relaxed) / delta) == b) {
+	    queued[v] = true;
+	    frontier.push_back(v);
+	  }
+	}
+	buckets[b].clear();
+	for (uint32_t v : frontier) {
+	  queued[v] = false;
+	}
+	settled.insert(settled.end(), frontier.begin(), frontier.end());
+	relax(frontier, true);
+      }
+      std::sort(settled.begin(), settled.end());
+      settled.erase(std::unique(settled.begin(), settled.end()), settled.end());
+      relax(settled, false);
+    }
+
+    vector<int64_t> distances(n);
+    for (uint32_t i = 0; i < n; i++) {
+      distances[i] = distance[i].load(std::memory_order_relaxed);
+    }
+    // Racing relaxations leave no consistent parents behind, so build the
+    // tree afterwards by a search along the edges that are tight, where
+    // the dest's distance is the source's plus the weight.
+    vector<uint32_t> parents(n, kNoVertex);
+    if (start != kNoVertex) {
+      vector<bool> seen(n, false);
+      vector<uint32_t> queue = {start};
+      seen[start] = true;
+      for (size_t head = 0; head < queue.size(); head++) {
+	uint32_t u = queue[head];
+	for (uint64_t i = offsets[u]; i < offsets[u + 1]; i++) {
+	  uint32_t v = targets[i];
+	  if (!seen[v] && distances[u] + weights[i] == distances[v]) {
+	    seen[v] = true;
+	    parents[v] = u;
+	    queue.push_back(v);
+	  }
+	}
+      }
+    }
+    *tree = PathTree(g.numbering(), std::move(distances), std::move(parents));
+    return true;
+  }
+
+  // Shortest or longest distances from sources in an acyclic graph,
+  // relaxing every edge once in topological order; negative weights are
+  // fine. Returns false if g has a cycle.
+  bool dag_paths_(const WeightedGraph& g, Span<const uint32_t> sources, bool longest, vector<int64_t>* distances,
+		  vector<uint32_t>* parents) {
+    const uint32_t n = g.vertex_count();
+    Span<const uint64_t> offsets = g.offsets();
+    Span<const uint32_t> targets = g.targets();
+    Span<const int64_t> weights = g.weights();
+    vector<uint32_t> in_degree(n, 0);
+    for (uint32_t v : targets) {
+      in_degree[v]++;
+    }
+    vector<uint32_t> order;
+    order.reserve(n);
+    for (uint32_t v = 0; v < n; v++) {
+      if (in_degree[v] == 0) {
+	order.push_back(v);
+      }
+    }
+    for (size_t head = 0; head < order.size(); head++) {
+      uint32_t u = order[head];
+      for (uint64_t i = offsets[u]; i < offsets[u + 1]; i++) {
+	if (--in_degree[targets[i]] == 0) {
+	  order.push_back(targets[i]);
+	}
+      }
+    }
+    if (order.size() < n) {
+      return false;
+    }
+
+    distances->assign(n, kUnreachable);
+    parents->assign(n, kNoVertex);
+    for (uint32_t s : sources) {
+      (*distances)[s] = 0;
+    }
+    for (uint32_t u : order) {
+      int64_t du = (*distances)[u];
+      if (du == kUnreachable) {
+	continue;
+      }
+      for (uint64_t i = offsets[u]; i < offsets[u + 1]; i++) {
+	int64_t candidate = du + weights[i];
+	int64_t& current = (*distances)[targets[i]];
+	if (current == kUnreachable || (longest ? candidate > current : candidate < current)) {
+	  current = candidate;
+	  (*parents)[targets[i]] = u;
+	}
+      }
+    }
+    return true;
+  }
+
+  // Shortest paths from source in an acyclic graph, in linear time.
+  // Returns false, leaving tree untouched, if g has a cycle.
+  bool dag_shortest_paths(const WeightedGraph& g, const Vertex* source, PathTree* tree) {
+    uint32_t start = g.index_of(source);
+    vector<int64_t> distances;
+    vector<uint32_t> parents;
+    if (!dag_paths_(g, start != kNoVertex ? Span<const uint32_t>(&start, 1) : Span<const uint32_t>(), false,
+		    &distances, &parents)) {
+      return false;
+    }
+    *tree = PathTree(g.numbering(), std::move(distances), std::move(parents));
+    return true;
+  }
+
+  // Like dag_shortest_paths(), but the longest paths.
+  bool dag_longest_paths(const WeightedGraph& g, const Vertex* source, PathTree* tree) {
+    uint32_t start = g.index_of(source);
+    vector<int64_t> distances;
+    vector<uint32_t> parents;
+    if (!dag_paths_(g, start != kNoVertex ? Span<const uint32_t>(&start, 1) : Span<const uint32_t>(), true,
+		    &distances, &parents)) {
+      return false;
+    }
+    *tree = PathTree(g.numbering(), std::move(distances), std::move(parents));
+    return true;
+  }
+
+  // The longest path anywhere in an acyclic graph, such as the critical
+  // path of a job graph weighted by duration: the IDs along it go to path
+  // and its length to length. Returns false, with neither touched, if g
+  // has a cycle.
+  bool critical_path(const WeightedGraph& g, vector<int>* path, int64_t* length) {
+    // Every vertex may start the path.
+    vector<uint32_t> everyone(g.vertex_count());
+    std::iota(everyone.begin(), everyone.end(), 0);
+    vector<int64_t> distances;
+    vector<uint32_t> parents;
+    if (!dag_paths_(g, everyone, true, &distances, &parents)) {
+      return false;
+    }
+    path->clear();
+    *length = 0;
+    if (distances.empty()) {
+      return true;
+    }
+    uint32_t end = std::max_element(distances.begin(), distances.end()) - distances.begin();
+    for (uint32_t i = end; i != kNoVertex; i = parents[i]) {
+      path->push_back(g.numbering()->ids[i]);
+    }
+    std::reverse(path->begin(), path->end());
+    *length = distances[end];
+    return true;
+  }
+}
@@ -0,0 +1,220 @@
+// A fixed set of worker threads that run submitted tasks in the order
+// they arrive. The destructor finishes every queued task, then joins.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<size_t>(threads, 1);
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+      workers_.emplace_back([this]() {
+	  run_();
+	});
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    ready_.notify_one();
+  }
+
+  // Calls body(begin, end) over chunks of [0, n) on the workers and the
+  // calling thread, returning once every chunk is done. Chunks are handed
+  // out on demand, so uneven work still spreads across the pool.
+  template<typename Body>
+  void parallel_for(size_t n, const Body& body) {
+    if (n == 0) {
+      return;
+    }
+    size_t chunk = std::max<size_t>(1, n / (8 * (size() + 1)));
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+      for (size_t begin; (begin = next.fetch_add(chunk)) < n; ) {
+	body(begin, std::min(n, begin + chunk));
+      }
+    };
+    size_t helpers = std::min(size(), (n - 1) / chunk);
+    size_t finished = 0;
+    std::mutex done_mutex;
+    std::condition_variable done;
+    for (size_t i = 0; i < helpers; i++) {
+      submit([&]() {
+	  work();
+	  std::lock_guard<std::mutex> lock(done_mutex);
+	  if (++finished == helpers) {
+	    done.notify_one();
+	  }
+	});
+    }
+    work();
+    // The helpers refer to this frame, so wait for all of them even once
+    // the chunks have run out.
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done.wait(lock, [&]() {
+	return finished == helpers;
+      });
+  }
+
+ private:
+  vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_ = false;
+
+  void run_() {
+    for (;;) {
+      std::function<void()> task;
+      {
+	std::unique_lock<std::mutex> lock(mutex_);
+	ready_.wait(lock, [this]() {
+	    return stopping_ || !tasks_.empty();
+	  });
+	if (tasks_.empty()) {
+	  return;
+	}
+	task = std::move(tasks_.front());
+	tasks_.pop_front();
+      }
+      task();
+    }
+  }
+};
+
+// Worker threads that each keep their own deque of tasks. A task
+// submitted from a worker goes on that worker's deque, which it works
+// from the back, so dependent work stays on a warm core; idle workers
+// steal from the front of the others'. The destructor finishes every
+// queued task, including any those tasks submit, then joins.
+class WorkStealingPool {
+ public:
+  explicit WorkStealingPool(size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; i++) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+      workers_.emplace_back([this, i]() {
+	  run_(i);
+	});
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+      stopping_ = true;
+    }
+    idle_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  // Queues task on the calling worker's deque or, from any other thread,
+  // on each worker's deque in turn.
+  void submit(std::function<void()> task) {
+    const std::pair<const WorkStealingPool*, size_t>& current = current_();
+    size_t target = current.first == this ? current.second : next_queue_.fetch_add(1) % queues_.size();
+    {
+      std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+      queues_[target]->tasks.push_back(std::move(task));
+      queued_.fetch_add(1);
+    }
+    // Taking the lock orders this against a worker about to sleep, so the
+    // wakeup cannot fall between its check and its wait.
+    {
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+    }
+    idle_.notify_one();
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  vector<unique_ptr<Queue>> queues_;
+  vector<std::thread> workers_;
+  // Tasks sitting in some deque.
+  std::atomic<size_t> queued_{0};
+  std::atomic<size_t> next_queue_{0};
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+  bool stopping_ = false;
+
+  // The pool and worker index the calling thread belongs to, if any.
+  static std::pair<const WorkStealingPool*, size_t>& current_() {
+    static thread_local std::pair<const WorkStealingPool*, size_t> current(nullptr, 0);
+    return current;
+  }
+
+  void run_(size_t self) {
+    current_() = std::make_pair(this, self);
+    for (;;) {
+      std::function<void()> task;
+      if (take_(self, &task)) {
+	task();
+	continue;
+      }
+      std::unique_lock<std::mutex> lock(idle_mutex_);
+      idle_.wait(lock, [this]() {
+	  return stopping_ || queued_.load() > 0;
+	});
+      if (stopping_ && queued_.load() == 0) {
+	return;
+      }
+    }
+  }
+
+  // Pops the newest task of worker self or else steals the oldest of
+  // another worker's.
+  bool take_(size_t self, std::function<void()>* task) {
+    for (size_t i = 0; i < queues_.size(); i++) {
+      Queue& queue = *queues_[(self + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+	continue;
+      }
+      if (i == 0) {
+	*task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+      } else {
+	*task = std::move(queue.tasks.front());
+	queue.tasks.pop_front();
+      }
+      queued_.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+};
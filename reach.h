@@ -0,0 +1,214 @@
+// Answers "is there a path from u to v" over a DAG of dense nodes, picking
+// the representation by size:
+//
+// - Up to kClosureLimit nodes it keeps the transitive closure as one
+//   bitset row per node, so a query is one bit test. Edges and nodes can
+//   be added in place, since an edge u -> v only ORs v's row into the
+//   rows that already hold u.
+// - Past that it keeps GRAIL labels, after Yildirim, Chaoji & Zaki,
+//   "GRAIL: Scalable Reachability Index for Large Graphs" (2010): each
+//   node gets kLabels intervals from depth-first traversals in different
+//   child orders, and u can reach v only if each of u's intervals contains
+//   v's. Most negative queries stop there or at the topological ranks;
+//   the rest run a search that skips every node whose labels rule it out.
+//   Labels cannot absorb a new edge, so add_edge() then asks for a
+//   rebuild.
+class ReachabilityIndex {
+ public:
+  static const uint32_t kClosureLimit = 4096;
+  static const int kLabels = 2;
+
+  // Builds over nodes 0..n-1. order lists them topologically, and edges
+  // are (source, dest) pairs.
+  void build(size_t n, const vector<uint32_t>& order, const vector<std::pair<uint32_t, uint32_t>>& edges) {
+    n_ = n;
+    closure_ = n <= kClosureLimit;
+    offsets_.assign(n + 1, 0);
+    for (const auto& edge : edges) {
+      offsets_[edge.first + 1]++;
+    }
+    for (size_t i = 1; i <= n; i++) {
+      offsets_[i] += offsets_[i - 1];
+    }
+    targets_.resize(edges.size());
+    vector<uint32_t> cursor(offsets_.begin(), offsets_.end() - 1);
+    for (const auto& edge : edges) {
+      targets_[cursor[edge.first]++] = edge.second;
+    }
+    if (closure_) {
+      build_closure_(order);
+    } else {
+      build_labels_(order);
+    }
+  }
+
+  // Every node reaches itself.
+  bool reaches(uint32_t u, uint32_t v) {
+    if (u == v) {
+      return true;
+    }
+    if (closure_) {
+      return test_(u, v);
+    }
+    if (rank_[u] > rank_[v] || !labels_contain_(u, v)) {
+      return false;
+    }
+    // Search, entering only nodes that can still lead to v.
+    stamp_++;
+    vector<uint32_t> stack = {u};
+    visited_[u] = stamp_;
+    while (!stack.empty()) {
+      uint32_t x = stack.back();
+      stack.pop_back();
+      for (uint32_t i = offsets_[x]; i < offsets_[x + 1]; i++) {
+	uint32_t w = targets_[i];
+	if (w == v) {
+	  return true;
+	}
+	if (visited_[w] != stamp_ && rank_[w] < rank_[v] && labels_contain_(w, v)) {
+	  visited_[w] = stamp_;
+	  stack.push_back(w);
+	}
+      }
+    }
+    return false;
+  }
+
+  // Appends a node without edges and returns it, or kNoVertex if the
+  // index cannot take it and must be rebuilt.
+  uint32_t add_node() {
+    if (!closure_ || n_ == kClosureLimit) {
+      return kNoVertex;
+    }
+    rows_.resize((n_ + 1) * kWords, 0);
+    return n_++;
+  }
+
+  // Records an edge that closes no cycle. Returns false if the index
+  // cannot take it and must be rebuilt.
+  bool add_edge(uint32_t u, uint32_t v) {
+    if (!closure_) {
+      return false;
+    }
+    // Whatever reaches u now reaches v and all v reaches.
+    for (uint32_t x = 0; x < n_; x++) {
+      if (x == u || test_(x, u)) {
+	uint64_t* row = &rows_[size_t(x) * kWords];
+	const uint64_t* from = &rows_[size_t(v) * kWords];
+	for (uint32_t i = 0; i < kWords; i++) {
+	  row[i] |= from[i];
+	}
+	row[v / 64] |= uint64_t(1) << (v % 64);
+      }
+    }
+    return true;
+  }
+
+  size_t size() const {
+    return n_;
+  }
+
+  // Whether the index is a closure rather than labels.
+  bool closure() const {
+    return closure_;
+  }
+
+ private:
+  // Rows are sized for kClosureLimit nodes, so that nodes can be added
+  // without moving them.
+  static const uint32_t kWords = kClosureLimit / 64;
+
+  size_t n_ = 0;
+  bool closure_ = true;
+  vector<uint32_t> offsets_;
+  vector<uint32_t> targets_;
+  // Closure: bit v of row u is set when u reaches v.
+  vector<uint64_t> rows_;
+  // Labels: per node, its position in the order and per traversal its
+  // interval [low, post].
+  vector<uint32_t> rank_;
+  vector<uint32_t> low_[kLabels];
+  vector<uint32_t> post_[kLabels];
+  vector<uint32_t> visited_;
+  uint32_t stamp_ = 0;
+
+  bool test_(uint32_t u, uint32_t v) const {
+    return rows_[size_t(u) * kWords + v / 64] >> (v % 64) & 1;
+  }
+
+  // Walking the order backwards settles every successor first.
+  void build_closure_(const vector<uint32_t>& order) {
+    rows_.assign(n_ * kWords, 0);
+    for (size_t i = order.size(); i-- > 0;) {
+      uint32_t u = order[i];
+      uint64_t* row = &rows_[size_t(u) * kWords];
+      for (uint32_t j = offsets_[u]; j < offsets_[u + 1]; j++) {
+	uint32_t w = targets_[j];
+	const uint64_t* from = &rows_[size_t(w) * kWords];
+	for (uint32_t k = 0; k < kWords; k++) {
+	  row[k] |= from[k];
+	}
+	row[w / 64] |= uint64_t(1) << (w % 64);
+      }
+    }
+  }
+
+  void build_labels_(const vector<uint32_t>& order) {
+    rank_.assign(n_, 0);
+    for (uint32_t i = 0; i < order.size(); i++) {
+      rank_[order[i]] = i;
+    }
+    visited_.assign(n_, 0);
+    stamp_ = 0;
+    for (int label = 0; label < kLabels; label++) {
+      vector<uint32_t>& low = low_[label];
+      vector<uint32_t>& post = post_[label];
+      low.assign(n_, UINT32_MAX);
+      post.assign(n_, kNoVertex);
+      // Traversal 0 takes roots and children first to last, traversal 1
+      // last to first, so that the intervals overlap differently.
+      bool reversed = label % 2 == 1;
+      uint32_t next_post = 0;
+      // Each frame is a node and how many of its children it has tried.
+      vector<std::pair<uint32_t, uint32_t>> stack;
+      for (size_t r = 0; r < order.size(); r++) {
+	uint32_t root = order[reversed ? order.size() - 1 - r : r];
+	if (post[root] != kNoVertex) {
+	  continue;
+	}
+	// low doubles as the "entered" mark until post is set.
+	low[root] = UINT32_MAX - 1;
+	stack.emplace_back(root, 0);
+	while (!stack.empty()) {
+	  uint32_t x = stack.back().first;
+	  uint32_t degree = offsets_[x + 1] - offsets_[x];
+	  if (stack.back().second < degree) {
+	    uint32_t k = stack.back().second++;
+	    uint32_t w = targets_[offsets_[x] + (reversed ? degree - 1 - k : k)];
+	    if (post[w] == kNoVertex && low[w] == UINT32_MAX) {
+	      low[w] = UINT32_MAX - 1;
+	      stack.emplace_back(w, 0);
+	    }
+	    continue;
+	  }
+	  stack.pop_back();
+	  post[x] = next_post++;
+	  uint32_t lowest = post[x];
+	  for (uint32_t j = offsets_[x]; j < offsets_[x + 1]; j++) {
+	    lowest = std::min(lowest, low[targets_[j]]);
+	  }
+	  low[x] = lowest;
+	}
+      }
+    }
+  }
+
+  bool labels_contain_(uint32_t u, uint32_t v) const {
+    for (int label = 0; label < kLabels; label++) {
+      if (low_[label][v] < low_[label][u] || post_[label][v] > post_[label][u]) {
+	return false;
+      }
+    }
+    return true;
+  }
+};
@@ -0,0 +1,359 @@
+// Strongly connected components of a frozen graph, and the condensation
+// that collapses each into one vertex so the rest can be scheduled as a
+// DAG.
+//
+// Components come back as one number per dense index, counted from 0 in
+// a topological order of the condensation: every edge between two
+// components leads from the lower number to the higher. The serial
+// search is Tarjan's with an explicit stack, so path length is bounded
+// by memory rather than by the call stack. The parallel one peels off
+// vertices without predecessors or successors, then splits what is left
+// by forward and backward reach from a pivot, after Fleischer, Hendrickson
+// & Pinar, "On Identifying Strongly Connected Components in Parallel"
+// (2000), and hands parts too small to share out to Tarjan's.
+namespace graph_lib {
+  // Tarjan's search from each of roots not yet visited, over the
+  // vertices inside() admits. Components are numbered from *found up,
+  // sinks first. index and low are scratch of one entry per vertex,
+  // kNoVertex where unvisited.
+  template<typename Inside>
+  void tarjan_(const CsrGraph& g, Span<const uint32_t> roots, const Inside& inside, vector<uint32_t>* component,
+	       uint32_t* found, vector<uint32_t>* index, vector<uint32_t>* low) {
+    vector<uint32_t> stack;
+    // Each open vertex with the position of its next edge.
+    vector<std::pair<uint32_t, uint32_t>> frames;
+    uint32_t next_index = 0;
+    auto open = [&](uint32_t v) {
+      (*index)[v] = (*low)[v] = next_index++;
+      stack.push_back(v);
+      frames.emplace_back(v, 0);
+    };
+    for (uint32_t root : roots) {
+      if ((*index)[root] != kNoVertex) {
+	continue;
+      }
+      open(root);
+      while (!frames.empty()) {
+	uint32_t v = frames.back().first;
+	Span<const uint32_t> row = g.neighbors(v);
+	if (frames.back().second < row.size()) {
+	  uint32_t w = row[frames.back().second++];
+	  if (!inside(w)) {
+	    continue;
+	  }
+	  if ((*index)[w] == kNoVertex) {
+	    open(w);
+	  } else if ((*component)[w] == kNoVertex) {
+	    // Visited without a component yet: w is still on the stack.
+	    (*low)[v] = std::min((*low)[v], (*index)[w]);
+	  }
+	  continue;
+	}
+	frames.pop_back();
+	if (!frames.empty()) {
+	  uint32_t parent = frames.back().first;
+	  (*low)[parent] = std::min((*low)[parent], (*low)[v]);
+	}
+	if ((*low)[v] == (*index)[v]) {
+	  uint32_t w;
+	  do {
+	    w = stack.back();
+	    stack.pop_back();
+	    (*component)[w] = *found;
+	  } while (w != v);
+	  (*found)++;
+	}
+      }
+    }
+  }
+
+  // The strongly connected component of each vertex of g; count, if
+  // given, gets how many there are.
+  vector<uint32_t> strongly_connected_components(const CsrGraph& g, uint32_t* count = nullptr) {
+    const uint32_t n = g.vertex_count();
+    vector<uint32_t> component(n, kNoVertex);
+    vector<uint32_t> index(n, kNoVertex);
+    vector<uint32_t> low(n);
+    vector<uint32_t> roots(n);
+    std::iota(roots.begin(), roots.end(), 0);
+    uint32_t found = 0;
+    tarjan_(g, roots, [](uint32_t) {
+	return true;
+      }, &component, &found, &index, &low);
+    // Tarjan's finishes sinks first; flip that into a topological order.
+    for (uint32_t& c : component) {
+      c = found - 1 - c;
+    }
+    if (count) {
+      *count = found;
+    }
+    return component;
+  }
+
+  // Renumbers the count components of g in a topological order of the
+  // condensation, by Kahn's algorithm over the edges between them.
+  void sort_components_(const CsrGraph& g, uint32_t count, vector<uint32_t>* component) {
+    vector<std::pair<uint32_t, uint32_t>> edges;
+    for (uint32_t v = 0; v < component->size(); v++) {
+      for (uint32_t w : g.neighbors(v)) {
+	if ((*component)[v] != (*component)[w]) {
+	  edges.emplace_back((*component)[v], (*component)[w]);
+	}
+      }
+    }
+    vector<uint32_t> offsets(count + 1, 0);
+    vector<uint32_t> in_degree(count, 0);
+    for (const auto& edge : edges) {
+      offsets[edge.first + 1]++;
+      in_degree[edge.second]++;
+    }
+    for (uint32_t i = 1; i <= count; i++) {
+      offsets[i] += offsets[i - 1];
+    }
+    vector<uint32_t> targets(edges.size());
+    vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (const auto& edge : edges) {
+      targets[cursor[edge.first]++] = edge.second;
+    }
+    vector<uint32_t> order;
+    order.reserve(count);
+    for (uint32_t c = 0; c < count; c++) {
+      if (in_degree[c] == 0) {
+	order.push_back(c);
+      }
+    }
+    for (size_t head = 0; head < order.size(); head++) {
+      uint32_t c = order[head];
+      for (uint32_t i = offsets[c]; i < offsets[c + 1]; i++) {
+	if (--in_degree[targets[i]] == 0) {
+	  order.push_back(targets[i]);
+	}
+      }
+    }
+    vector<uint32_t> rank(count);
+    for (uint32_t i = 0; i < count; i++) {
+      rank[order[i]] = i;
+    }
+    for (uint32_t& c : *component) {
+      c = rank[c];
+    }
+  }
+
+  // As strongly_connected_components(), with the work spread over pool.
+  vector<uint32_t> parallel_strongly_connected_components(const CsrGraph& g, ThreadPool& pool,
+							    uint32_t* count = nullptr) {
+    // Parts of at most this many vertices go to Tarjan's whole.
+    const size_t kSerialCutoff = 1 << 12;
+    // Frontiers smaller than this are expanded on the calling thread; a
+    // deep graph has many thin levels, and a pool round-trip for each of
+    // them costs more than the edges it spreads.
+    const size_t kSerialFrontier = 1 << 10;
+    const uint32_t n = g.vertex_count();
+    vector<uint32_t> component(n, kNoVertex);
+    std::atomic<uint32_t> found(0);
+
+    // Peels every vertex left with no remaining predecessor (when
+    // forward) or successor, each one a component of its own. Counting
+    // down degrees as vertices go makes this Kahn's algorithm, level by
+    // level.
+    unique_ptr<std::atomic<uint32_t>[]> degree(new std::atomic<uint32_t>[n]);
+    auto trim = [&](bool forward) {
+      vector<uint32_t> frontier;
+      std::mutex frontier_mutex;
+      pool.parallel_for(n, [&](size_t begin, size_t end) {
+	  vector<uint32_t> zero;
+	  for (uint32_t v = begin; v < end; v++) {
+	    uint32_t d = 0;
+	    if (component[v] == kNoVertex) {
+	      for (uint32_t w : forward ? g.in_neighbors(v) : g.neighbors(v)) {
+		d += component[w] == kNoVertex;
+	      }
+	      if (d == 0) {
+		zero.push_back(v);
+	      }
+	    }
+	    degree[v].store(d, std::memory_order_relaxed);
+	  }
+	  std::lock_guard<std::mutex> lock(frontier_mutex);
+	  frontier.insert(frontier.end(), zero.begin(), zero.end());
+	});
+      vector<uint32_t> next;
+      while (!frontier.empty()) {
+	uint32_t first = found.fetch_add(frontier.size(), std::memory_order_relaxed);
+	for (size_t i = 0; i < frontier.size(); i++) {
+	  component[frontier[i]] = first + i;
+	}
+	auto expand = [&](size_t begin, size_t end) {
+	  vector<uint32_t> zero;
+	  for (size_t i = begin; i < end; i++) {
+	    for (uint32_t w : forward ? g.neighbors(frontier[i]) : g.in_neighbors(frontier[i])) {
+	      // Only the last predecessor to go lists w.
+	      if (component[w] == kNoVertex && degree[w].fetch_sub(1, std::memory_order_relaxed) == 1) {
+		zero.push_back(w);
+	      }
+	    }
+	  }
+	  std::lock_guard<std::mutex> lock(frontier_mutex);
+	  next.insert(next.end(), zero.begin(), zero.end());
+	};
+	if (frontier.size() < kSerialFrontier) {
+	  expand(0, frontier.size());
+	} else {
+	  pool.parallel_for(frontier.size(), expand);
+	}
+	frontier.swap(next);
+	next.clear();
+      }
+    };
+    trim(true);
+    trim(false);
+
+    // Forward-backward splitting. Every part still to solve has a color
+    // of its own; reach never leaves the pivot's color.
+    vector<uint32_t> color(n, 0);
+    unique_ptr<std::atomic<uint8_t>[]> reached(new std::atomic<uint8_t>[n]);
+    vector<vector<uint32_t>> parts(1);
+    for (uint32_t v = 0; v < n; v++) {
+      reached[v].store(0, std::memory_order_relaxed);
+      if (component[v] == kNoVertex) {
+	parts[0].push_back(v);
+      }
+    }
+    if (parts[0].empty()) {
+      parts.clear();
+    }
+    auto reach = [&](uint32_t pivot, uint8_t bit) {
+      uint32_t c = color[pivot];
+      reached[pivot].fetch_or(bit, std::memory_order_relaxed);
+      vector<uint32_t> frontier = {pivot};
+      vector<uint32_t> next;
+      std::mutex next_mutex;
+      while (!frontier.empty()) {
+	auto expand = [&](size_t begin, size_t end) {
+	  vector<uint32_t> found_here;
+	  for (size_t i = begin; i < end; i++) {
+	    for (uint32_t w : bit == 1 ? g.neighbors(frontier[i]) : g.in_neighbors(frontier[i])) {
+	      if (color[w] == c && component[w] == kNoVertex
+		  && !(reached[w].fetch_or(bit, std::memory_order_relaxed) & bit)) {
+		found_here.push_back(w);
+	      }
+	    }
+	  }
+	  std::lock_guard<std::mutex> lock(next_mutex);
+	  next.insert(next.end(), found_here.begin(), found_here.end());
+	};
+	if (frontier.size() < kSerialFrontier) {
+	  expand(0, frontier.size());
+	} else {
+	  pool.parallel_for(frontier.size(), expand);
+	}
+	frontier.swap(next);
+	next.clear();
+      }
+    };
+    vector<uint32_t> index(n, kNoVertex);
+    vector<uint32_t> low(n);
+    uint32_t next_color = 1;
+    while (!parts.empty()) {
+      vector<uint32_t> part = std::move(parts.back());
+      parts.pop_back();
+      if (part.size() <= kSerialCutoff) {
+	uint32_t c = color[part[0]];
+	uint32_t first = found.load(std::memory_order_relaxed);
+	uint32_t last = first;
+	tarjan_(g, part, [&](uint32_t w) {
+	    return color[w] == c && component[w] == kNoVertex;
+	  }, &component, &last, &index, &low);
+	found.store(last, std::memory_order_relaxed);
+	continue;
+      }
+      uint32_t pivot = part[0];
+      reach(pivot, 1);
+      reach(pivot, 2);
+      // Both reaches meet in the pivot's component; the rest splits into
+      // what only one of them found and what neither did, and no
+      // component crosses between those.
+      uint32_t scc = found.fetch_add(1, std::memory_order_relaxed);
+      vector<uint32_t> split[3];
+      for (uint32_t v : part) {
+	uint8_t bits = reached[v].exchange(0, std::memory_order_relaxed);
+	if (bits == 3) {
+	  component[v] = scc;
+	} else {
+	  split[bits].push_back(v);
+	}
+      }
+      for (vector<uint32_t>& rest : split) {
+	if (!rest.empty()) {
+	  for (uint32_t v : rest) {
+	    color[v] = next_color;
+	  }
+	  next_color++;
+	  parts.push_back(std::move(rest));
+	}
+      }
+    }
+
+    uint32_t total = found.load();
+    sort_components_(g, total, &component);
+    if (count) {
+      *count = total;
+    }
+    return component;
+  }
+
+  // The condensation of g under component, as numbered by either search
+  // above: one vertex per component, standing in for it as its member of
+  // lowest ID, and one edge per pair of components some edge of g joins.
+  // The numbering already orders the components, so the DAG is loaded
+  // with add_edges() and its single pass, never checked edge by edge.
+  DirectedAcyclicGraph condense(const CsrGraph& g, const vector<uint32_t>& component, uint32_t count,
+				CycleCheck cycle_check = CycleCheck::kIncremental) {
+    // Dense indices follow IDs, so the first member seen is the lowest.
+    vector<uint32_t> representative(count, kNoVertex);
+    for (uint32_t v = 0; v < component.size(); v++) {
+      if (representative[component[v]] == kNoVertex) {
+	representative[component[v]] = v;
+      }
+    }
+    vector<uint64_t> keys;
+    for (uint32_t v = 0; v < component.size(); v++) {
+      for (uint32_t w : g.neighbors(v)) {
+	if (component[v] != component[w]) {
+	  keys.push_back(uint64_t(component[v]) << 32 | component[w]);
+	}
+      }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    vector<EdgeSpec> edges;
+    edges.reserve(keys.size());
+    for (uint64_t key : keys) {
+      edges.push_back(EdgeSpec{g.id(representative[key >> 32]), g.id(representative[uint32_t(key)]), kDummyValue});
+    }
+    vector<Vertex> vertices;
+    vertices.reserve(count);
+    for (uint32_t v : representative) {
+      vertices.emplace_back(Value(string(g.name(v)), g.id(v)));
+    }
+    DirectedAcyclicGraph dag(cycle_check);
+    dag.add_edges(edges, vertices);
+    return dag;
+  }
+
+  DirectedAcyclicGraph condense(const CsrGraph& g) {
+    uint32_t count;
+    vector<uint32_t> component = strongly_connected_components(g, &count);
+    return condense(g, component, count);
+  }
+
+  DirectedAcyclicGraph condense(const CsrGraph& g, ThreadPool& pool) {
+    uint32_t count;
+    vector<uint32_t> component = parallel_strongly_connected_components(g, pool, &count);
+    return condense(g, component, count);
+  }
+
+  DirectedAcyclicGraph condense(const DirectedGraph& g) {
+    return condense(g.freeze());
+  }
+}
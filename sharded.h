@@ -0,0 +1,428 @@
+// A graph split by vertex ID across shards, each a DirectedGraph with a
+// lock and a memory arena of its own. An edge is stored in the shard
+// that owns its source, so get_neighbors(), are_adjacent() and
+// out_degree() ask that one shard. Every vertex also keeps a record in
+// the shard that owns it, which makes vertex counts a sum over shards and
+// gives BFS one copy per vertex to hand out. Queries about the edges into
+// a vertex ask every shard.
+//
+// Vertices go to shards by a hash of their ID, or by ID range for callers
+// that can keep neighbors together. Calls that touch different shards
+// run concurrently. Each holds the locks of the shards it touches for the
+// whole call, taken in shard order; remove(), add_edges(),
+// parallel_bfs() and freeze() take every lock.
+//
+// Unlike DirectedGraph, a vertex stays until it is removed, with or
+// without edges. Vertex* handed out last as long as they would in the
+// shard they came from.
+class ShardedGraph {
+ public:
+  // shards shards, picked by a hash of the ID.
+  explicit ShardedGraph(size_t shards = 1) {
+    init_(std::max<size_t>(shards, 1));
+  }
+
+  // splits.size() + 1 shards by ID range: shard i holds the IDs from
+  // splits[i - 1] up to but excluding splits[i]. splits must ascend.
+  explicit ShardedGraph(vector<int> splits) : splits_(std::move(splits)), ranged_(true) {
+    init_(splits_.size() + 1);
+  }
+
+  ShardedGraph(const ShardedGraph&) = delete;
+  ShardedGraph& operator=(const ShardedGraph&) = delete;
+
+  size_t shard_count() const {
+    return shards_.size();
+  }
+
+  // The shard that owns the vertex with this ID.
+  size_t shard_of(int id) const {
+    if (ranged_) {
+      return std::upper_bound(splits_.begin(), splits_.end(), id) - splits_.begin();
+    }
+    // Fibonacci hashing, so that runs of IDs spread out.
+    return (uint64_t(uint32_t(id)) * 0x9e3779b97f4a7c15ULL >> 32) % shards_.size();
+  }
+
+  bool add(const Vertex* v) {
+    Shard& shard = *shards_[shard_of(v->value().second)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    own_(shard, v);
+    return true;
+  }
+
+  bool add_edge(const Vertex* u, const Vertex* v) {
+    size_t i = shard_of(u->value().second);
+    size_t j = shard_of(v->value().second);
+    vector<std::unique_lock<std::mutex>> locks = lock_pair_(i, j);
+    own_(*shards_[j], v);
+    own_(*shards_[i], u);
+    return shards_[i]->graph.add_edge(u, v);
+  }
+
+  bool add_edge(const Edge* e) {
+    if (!e->get_source() || !e->get_dest()) {
+      // A dangling edge only brings in the end it has.
+      if (e->get_source()) {
+	add(e->get_source().get());
+      }
+      if (e->get_dest()) {
+	add(e->get_dest().get());
+      }
+      return true;
+    }
+    const Vertex* u = e->get_source().get();
+    const Vertex* v = e->get_dest().get();
+    size_t i = shard_of(u->value().second);
+    size_t j = shard_of(v->value().second);
+    vector<std::unique_lock<std::mutex>> locks = lock_pair_(i, j);
+    own_(*shards_[j], v);
+    own_(*shards_[i], u);
+    return shards_[i]->graph.add_edge(e);
+  }
+
+  // Adds edges in bulk, as DirectedGraph::add_edges() would, loading
+  // each shard's part on its own. vertices supplies names; a vertex
+  // named by neither gets "DUMMY".
+  bool add_edges(Span<const EdgeSpec> edges, Span<const Vertex> vertices = Span<const Vertex>()) {
+    Load load = split_(edges, vertices);
+    vector<std::unique_lock<std::mutex>> locks = lock_all_();
+    for (size_t i = 0; i < shards_.size(); i++) {
+      load_shard_(i, load);
+    }
+    return true;
+  }
+
+  // The same with the shards loaded in parallel on pool.
+  bool add_edges(Span<const EdgeSpec> edges, Span<const Vertex> vertices, ThreadPool& pool) {
+    Load load = split_(edges, vertices);
+    // Held here for the workers, so that the load lands all at once.
+    vector<std::unique_lock<std::mutex>> locks = lock_all_();
+    pool.parallel_for(shards_.size(), [&](size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) {
+	  load_shard_(i, load);
+	}
+      });
+    return true;
+  }
+
+  bool remove_edge(const Edge* e) {
+    if (!e->get_source()) {
+      return true;
+    }
+    Shard& shard = *shards_[shard_of(e->get_source()->value().second)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.graph.remove_edge(e);
+  }
+
+  // Removes v with every edge into or out of it. Holds every lock, so
+  // that no add_edge() can lead to v from a shard already cleared.
+  void remove(const Vertex* v) {
+    vector<std::unique_lock<std::mutex>> locks = lock_all_();
+    for (const auto& shard : shards_) {
+      shard->owned.erase(v->value().second);
+      shard->graph.remove(v);
+    }
+  }
+
+  bool are_adjacent(const Vertex* u, const Vertex* v) const {
+    Shard& shard = *shards_[shard_of(u->value().second)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.graph.are_adjacent(u, v);
+  }
+
+  int edge_count() const {
+    int count = 0;
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      count += shard->graph.edge_count();
+    }
+    return count;
+  }
+
+  int vertex_count() const {
+    int count = 0;
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      count += shard->owned.size();
+    }
+    return count;
+  }
+
+  vector<Vertex*> get_neighbors(Vertex* vertex) const {
+    Shard& shard = *shards_[shard_of(vertex->value().second)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.graph.get_neighbors(vertex);
+  }
+
+  // get_neighbors() for the traversals in traverse.h. A shard's edges may
+  // change once its lock is let go, so this copies too.
+  vector<Vertex*> neighbor_view(const Vertex* vertex) const {
+    return get_neighbors(const_cast<Vertex*>(vertex));
+  }
+
+  // The sources of the edges into vertex, gathered shard by shard.
+  vector<Vertex*> get_predecessors(Vertex* vertex) const {
+    vector<Vertex*> predecessors;
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      vector<Vertex*> part = shard->graph.get_predecessors(vertex);
+      predecessors.insert(predecessors.end(), part.begin(), part.end());
+    }
+    return predecessors;
+  }
+
+  int in_degree(const Vertex* v) const {
+    int degree = 0;
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      degree += shard->graph.in_degree(v);
+    }
+    return degree;
+  }
+
+  int out_degree(const Vertex* v) const {
+    Shard& shard = *shards_[shard_of(v->value().second)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.graph.out_degree(v);
+  }
+
+  string to_string() const {
+    return freeze().to_string();
+  }
+
+  Vertex* top() const {
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      if (Vertex* v = shard->graph.top()) {
+	return v;
+      }
+    }
+    return nullptr;
+  }
+
+  // The owning shard's copy of the vertex with v's ID, or nullptr if
+  // absent.
+  Vertex* find(const Vertex* v) const {
+    Shard& shard = *shards_[shard_of(v->value().second)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.graph.find(v);
+  }
+
+  // Calls body(i, graph) with each shard's index and graph on pool, under
+  // that shard's lock. body must only read the graph.
+  template<typename Body>
+  void for_each_shard(ThreadPool& pool, const Body& body) const {
+    pool.parallel_for(shards_.size(), [&](size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) {
+	  std::lock_guard<std::mutex> lock(shards_[i]->mutex);
+	  body(i, static_cast<const DirectedGraph&>(shards_[i]->graph));
+	}
+      });
+  }
+
+  // Number of edges whose ends live in different shards, counted on pool.
+  // The fewer there are, the less a traversal passes between shards.
+  uint64_t cross_shard_edges(ThreadPool& pool) const {
+    std::atomic<uint64_t> count(0);
+    for_each_shard(pool, [&](size_t i, const DirectedGraph& graph) {
+	uint64_t cross = 0;
+	for (const auto& e : graph.edges()) {
+	  cross += e.get_dest() && shard_of(e.get_dest()->value().second) != i;
+	}
+	count.fetch_add(cross, std::memory_order_relaxed);
+      });
+    return count.load();
+  }
+
+  // The vertices reachable from sources, sources first, each listed once,
+  // level by level. Every level is expanded on pool one shard per task:
+  // each shard follows the out-edges of its part of the frontier and
+  // sorts what it finds by owner, then each owner keeps the vertices it
+  // has not seen. Within a level, vertices come in shard order. Holds
+  // every shard's lock throughout.
+  vector<Vertex*> parallel_bfs(Span<Vertex* const> sources, ThreadPool& pool) const {
+    const size_t n = shards_.size();
+    vector<std::unique_lock<std::mutex>> locks = lock_all_();
+    vector<std::unordered_set<int>> seen(n);
+    vector<vector<Vertex*>> frontier(n);
+    vector<Vertex*> order;
+    for (Vertex* source : sources) {
+      size_t owner = shard_of(source->value().second);
+      if (seen[owner].insert(source->value().second).second) {
+	order.push_back(source);
+	frontier[owner].push_back(source);
+      }
+    }
+    // found[i][j] holds the vertices shard i reached that shard j owns.
+    vector<vector<vector<const Vertex*>>> found(n, vector<vector<const Vertex*>>(n));
+    for (;;) {
+      pool.parallel_for(n, [&](size_t begin, size_t end) {
+	  for (size_t i = begin; i < end; i++) {
+	    for (Vertex* v : frontier[i]) {
+	      for (Vertex* next : shards_[i]->graph.neighbor_view(v)) {
+		found[i][shard_of(next->value().second)].push_back(next);
+	      }
+	    }
+	    frontier[i].clear();
+	  }
+	});
+      pool.parallel_for(n, [&](size_t begin, size_t end) {
+	  for (size_t j = begin; j < end; j++) {
+	    for (size_t i = 0; i < n; i++) {
+	      for (const Vertex* next : found[i][j]) {
+		if (seen[j].insert(next->value().second).second) {
+		  frontier[j].push_back(shards_[j]->graph.find(next));
+		}
+	      }
+	      found[i][j].clear();
+	    }
+	  }
+	});
+      size_t before = order.size();
+      for (const vector<Vertex*>& level : frontier) {
+	order.insert(order.end(), level.begin(), level.end());
+      }
+      if (order.size() == before) {
+	break;
+      }
+    }
+    return order;
+  }
+
+  vector<Vertex*> parallel_bfs(Vertex* source, ThreadPool& pool) const {
+    return parallel_bfs(Span<Vertex* const>(&source, 1), pool);
+  }
+
+  // All shards as one frozen graph.
+  CsrGraph freeze() const {
+    vector<std::unique_lock<std::mutex>> locks = lock_all_();
+    vector<const Vertex*> vertices;
+    std::unordered_map<int, uint32_t> position;
+    for (const auto& shard : shards_) {
+      for (int id : shard->owned) {
+	Vertex probe(Value("", id));
+	position.emplace(id, vertices.size());
+	vertices.push_back(shard->graph.find(&probe));
+      }
+    }
+    vector<std::pair<uint32_t, uint32_t>> edges;
+    for (const auto& shard : shards_) {
+      for (const auto& e : shard->graph.edges()) {
+	if (!e.get_source() || !e.get_dest()) {
+	  continue;
+	}
+	// Every end is owned somewhere; skip rather than misplace one that
+	// is not.
+	auto source = position.find(e.get_source()->value().second);
+	auto dest = position.find(e.get_dest()->value().second);
+	if (source != position.end() && dest != position.end()) {
+	  edges.emplace_back(source->second, dest->second);
+	}
+      }
+    }
+    return CsrGraph(vertices, edges);
+  }
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    // Declared before the graph, so that it outlives it.
+    std::pmr::unsynchronized_pool_resource arena;
+    DirectedGraph graph{&arena};
+    // IDs this shard owns, each held in graph by a record of its own.
+    std::pmr::unordered_set<int> owned{&arena};
+  };
+
+  // Edges and vertices to add, sorted by the shard that takes them.
+  struct Load {
+    vector<vector<EdgeSpec>> edges;
+    vector<vector<int>> owned;
+    std::unordered_map<int, const Vertex*> names;
+  };
+
+  vector<unique_ptr<Shard>> shards_;
+  vector<int> splits_;
+  bool ranged_ = false;
+
+  void init_(size_t shards) {
+    for (size_t i = 0; i < shards; i++) {
+      shards_.push_back(std::make_unique<Shard>());
+      // Neighbor queries are what shards are for.
+      shards_.back()->graph.enable_index();
+    }
+  }
+
+  // Gives v a record in shard, which must own it, unless it has one.
+  // Called with the shard's lock held.
+  void own_(Shard& shard, const Vertex* v) {
+    if (shard.owned.insert(v->value().second).second) {
+      shard.graph.add(v);
+    }
+  }
+
+  vector<std::unique_lock<std::mutex>> lock_all_() const {
+    vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(shards_.size());
+    for (const auto& shard : shards_) {
+      locks.emplace_back(shard->mutex);
+    }
+    return locks;
+  }
+
+  // Locks shards i and j, lower index first, or just i if they are the
+  // same.
+  vector<std::unique_lock<std::mutex>> lock_pair_(size_t i, size_t j) const {
+    vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(2);
+    locks.emplace_back(shards_[std::min(i, j)]->mutex);
+    if (i != j) {
+      locks.emplace_back(shards_[std::max(i, j)]->mutex);
+    }
+    return locks;
+  }
+
+  Load split_(Span<const EdgeSpec> edges, Span<const Vertex> vertices) const {
+    Load load;
+    load.edges.resize(shards_.size());
+    load.owned.resize(shards_.size());
+    load.names.reserve(vertices.size());
+    for (const Vertex& v : vertices) {
+      load.names.emplace(v.value().second, &v);
+      load.owned[shard_of(v.value().second)].push_back(v.value().second);
+    }
+    for (const EdgeSpec& e : edges) {
+      size_t source = shard_of(e.source);
+      load.edges[source].push_back(e);
+      load.owned[source].push_back(e.source);
+      load.owned[shard_of(e.dest)].push_back(e.dest);
+    }
+    return load;
+  }
+
+  // Adds shard i's part of load: a record for each vertex it owns, then
+  // its edges, naming the dests owned elsewhere. Called with every lock
+  // held.
+  void load_shard_(size_t i, const Load& load) {
+    Shard& shard = *shards_[i];
+    auto vertex = [&load](int id) {
+      auto it = load.names.find(id);
+      return it != load.names.end() ? *it->second : Vertex(Value(kDummyValue.first, id));
+    };
+    shard.owned.reserve(shard.owned.size() + load.owned[i].size());
+    for (int id : load.owned[i]) {
+      if (shard.owned.insert(id).second) {
+	Vertex v = vertex(id);
+	shard.graph.add(&v);
+      }
+    }
+    vector<Vertex> foreign;
+    std::unordered_set<int> named;
+    for (const EdgeSpec& e : load.edges[i]) {
+      if (shard_of(e.dest) != i && named.insert(e.dest).second) {
+	foreign.push_back(vertex(e.dest));
+      }
+    }
+    shard.graph.add_edges(load.edges[i], foreign);
+  }
+};
@@ -0,0 +1,134 @@
+// Binary snapshot of a CsrGraph. The file is a SnapshotHeader followed
+// by the graph's arrays, each starting on an 8-byte boundary, in native
+// byte order:
+//
+//   ids           int32  x num_vertices
+//   name_offsets  uint64 x (num_vertices + 1)
+//   offsets       uint64 x (num_vertices + 1)
+//   targets       uint32 x num_edges
+//   names         char   x names_size
+//
+// load_snapshot() maps the file read-only and serves the graph straight
+// from the mapping, so loading costs a few checks however large the
+// graph, and processes mapping the same file share its page cache.
+
+const char kSnapshotMagic[8] = {'G', 'R', 'A', 'P', 'H', 'C', 'S', 'R'};
+const uint32_t kSnapshotVersion = 1;
+// Written into every header so that a file from a machine of the other
+// byte order is refused rather than misread.
+const uint32_t kSnapshotByteOrder = 0x01020304;
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t num_vertices;
+  uint64_t num_edges;
+  uint64_t names_size;
+  // Byte offsets of the arrays from the start of the file.
+  uint64_t ids_at;
+  uint64_t name_offsets_at;
+  uint64_t offsets_at;
+  uint64_t targets_at;
+  uint64_t names_at;
+  uint64_t file_size;
+};
+
+static_assert(sizeof(int) == 4, "snapshots store vertex IDs as int32");
+
+namespace graph_lib {
+  // Writes g to path, replacing any file there. Returns false if the
+  // file could not be written.
+  bool save_snapshot(const CsrGraph& g, const string& path) {
+    auto aligned = [](uint64_t at) {
+      return (at + 7) & ~uint64_t(7);
+    };
+    SnapshotHeader header = {};
+    std::copy(kSnapshotMagic, kSnapshotMagic + 8, header.magic);
+    header.version = kSnapshotVersion;
+    header.byte_order = kSnapshotByteOrder;
+    header.num_vertices = g.ids().size();
+    header.num_edges = g.targets().size();
+    header.names_size = g.names().size();
+    header.ids_at = aligned(sizeof(SnapshotHeader));
+    header.name_offsets_at = aligned(header.ids_at + header.num_vertices * sizeof(int));
+    header.offsets_at = aligned(header.name_offsets_at + (header.num_vertices + 1) * sizeof(uint64_t));
+    header.targets_at = aligned(header.offsets_at + (header.num_vertices + 1) * sizeof(uint64_t));
+    header.names_at = aligned(header.targets_at + header.num_edges * sizeof(uint32_t));
+    header.file_size = header.names_at + header.names_size;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint64_t written = 0;
+    auto put = [&out, &written](uint64_t at, const void* data, uint64_t size) {
+      static const char kPadding[8] = {};
+      out.write(kPadding, at - written);
+      out.write(static_cast<const char*>(data), size);
+      written = at + size;
+    };
+    put(0, &header, sizeof(header));
+    put(header.ids_at, g.ids().begin(), header.num_vertices * sizeof(int));
+    put(header.name_offsets_at, g.name_offsets().begin(), (header.num_vertices + 1) * sizeof(uint64_t));
+    put(header.offsets_at, g.offsets().begin(), (header.num_vertices + 1) * sizeof(uint64_t));
+    put(header.targets_at, g.targets().begin(), header.num_edges * sizeof(uint32_t));
+    put(header.names_at, g.names().begin(), header.names_size);
+    out.close();
+    return !out.fail();
+  }
+
+  // Maps the snapshot at path and points graph at it. Returns false,
+  // leaving graph untouched, if the file is missing, of another version
+  // or byte order, or inconsistent in its header or array bounds. The
+  // arrays' contents are trusted: checking them would read every page.
+  bool load_snapshot(const string& path, CsrGraph* graph) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || uint64_t(st.st_size) < sizeof(SnapshotHeader)) {
+      close(fd);
+      return false;
+    }
+    size_t size = st.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      return false;
+    }
+    std::shared_ptr<const void> backing(mapping, [size](const void* p) {
+	munmap(const_cast<void*>(p), size);
+      });
+
+    const char* base = static_cast<const char*>(mapping);
+    const SnapshotHeader& header = *reinterpret_cast<const SnapshotHeader*>(base);
+    uint64_t v = header.num_vertices;
+    uint64_t e = header.num_edges;
+    // An array of count elements of width bytes must sit inside the
+    // file, aligned for its type.
+    auto fits = [size](uint64_t at, uint64_t count, uint64_t width) {
+      return at % width == 0 && at <= size && count <= (size - at) / width;
+    };
+    if (!std::equal(kSnapshotMagic, kSnapshotMagic + 8, header.magic) || header.version != kSnapshotVersion
+	|| header.byte_order != kSnapshotByteOrder || header.file_size != size
+	|| v >= kNoVertex || e >= kNoVertex
+	|| !fits(header.ids_at, v, sizeof(int))
+	|| !fits(header.name_offsets_at, v + 1, sizeof(uint64_t))
+	|| !fits(header.offsets_at, v + 1, sizeof(uint64_t))
+	|| !fits(header.targets_at, e, sizeof(uint32_t))
+	|| !fits(header.names_at, header.names_size, 1)) {
+      return false;
+    }
+    const uint64_t* name_offsets = reinterpret_cast<const uint64_t*>(base + header.name_offsets_at);
+    const uint64_t* offsets = reinterpret_cast<const uint64_t*>(base + header.offsets_at);
+    if (name_offsets[0] != 0 || name_offsets[v] != header.names_size || offsets[0] != 0 || offsets[v] != e) {
+      return false;
+    }
+    *graph = CsrGraph(backing,
+		      Span<const int>(reinterpret_cast<const int*>(base + header.ids_at), v),
+		      Span<const uint64_t>(name_offsets, v + 1),
+		      Span<const char>(base + header.names_at, header.names_size),
+		      Span<const uint64_t>(offsets, v + 1),
+		      Span<const uint32_t>(reinterpret_cast<const uint32_t*>(base + header.targets_at), e));
+    return true;
+  }
+}
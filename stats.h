@@ -0,0 +1,183 @@
+// Opt-in counters for the graph operations on hot paths. Compiled in
+// only with -DGRAPHS_STATS; otherwise the GRAPHS_STATS_* hooks below
+// expand to nothing and their arguments are never evaluated.
+//
+// Per operation a hook records calls, edges scanned, allocations (Vertex
+// slots and Edge parts created) and a latency histogram. Work done inside
+// a nested operation, such as the DirectedGraph::add_edge under a
+// DirectedAcyclicGraph::add_edge, counts toward both. graph_lib::stats()
+// takes a snapshot for export; counters are relaxed atomics, so it is
+// safe from any thread but not a consistent cut across operations.
+namespace graph_lib {
+  enum class StatsOp {
+    kGraphAdd,
+    kGraphAddEdge,
+    kGraphAddEdges,
+    kGraphAreAdjacent,
+    kGraphGetNeighbors,
+    kGraphGetPredecessors,
+    kGraphGetAdjacencyList,
+    kGraphRemove,
+    kGraphRemoveEdge,
+    kGraphFreeze,
+    kDagAddEdge,
+    kDagAddEdges,
+    kDagApply,
+    kDagCheckForCycles,
+    kDagSort,
+    kDagReaches,
+    kDagRemove,
+    kTreeAddEdge,
+    kTreeRemove,
+    kTreeParent,
+    kTreeLca,
+    kTreeGetNeighbors,
+    kCount,
+  };
+
+  const char* const kStatsOpNames[] = {
+    "DirectedGraph::add",
+    "DirectedGraph::add_edge",
+    "DirectedGraph::add_edges",
+    "DirectedGraph::are_adjacent",
+    "DirectedGraph::get_neighbors",
+    "DirectedGraph::get_predecessors",
+    "DirectedGraph::get_adjacency_list",
+    "DirectedGraph::remove",
+    "DirectedGraph::remove_edge",
+    "DirectedGraph::freeze",
+    "DirectedAcyclicGraph::add_edge",
+    "DirectedAcyclicGraph::add_edges",
+    "DirectedAcyclicGraph::apply",
+    "DirectedAcyclicGraph::check_for_cycles_",
+    "DirectedAcyclicGraph::sort_",
+    "DirectedAcyclicGraph::reaches",
+    "DirectedAcyclicGraph::remove",
+    "Tree::add_edge",
+    "Tree::remove",
+    "Tree::parent",
+    "Tree::lca",
+    "Tree::get_neighbors",
+  };
+
+  // Bucket i of a latency histogram counts calls that took [2^i, 2^(i+1))
+  // nanoseconds; the last also takes everything slower.
+  const int kLatencyBuckets = 32;
+
+  struct OpStats {
+    string name;
+    uint64_t calls = 0;
+    uint64_t edges_scanned = 0;
+    uint64_t allocations = 0;
+    uint64_t total_nanos = 0;
+    uint64_t latency[kLatencyBuckets] = {};
+  };
+
+  // Whether this build records anything.
+#ifdef GRAPHS_STATS
+  const bool kStatsEnabled = true;
+#else
+  const bool kStatsEnabled = false;
+#endif
+
+  struct StatsCounters {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> edges_scanned{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> total_nanos{0};
+    std::atomic<uint64_t> latency[kLatencyBuckets] = {};
+  };
+
+  StatsCounters* stats_counters_() {
+    static StatsCounters counters[int(StatsOp::kCount)];
+    return counters;
+  }
+
+  // Times one operation from construction to destruction. While it is
+  // open, scanned() and allocated() on the same thread charge to it.
+  class StatsScope {
+   public:
+    explicit StatsScope(StatsOp op)
+      : counters_(stats_counters_()[int(op)]), outer_(current_()), start_(std::chrono::steady_clock::now()) {
+      current_() = this;
+    }
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+    ~StatsScope() {
+      uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+	std::chrono::steady_clock::now() - start_).count();
+      int bucket = 0;
+      while (bucket + 1 < kLatencyBuckets && nanos >> (bucket + 1)) {
+	bucket++;
+      }
+      counters_.calls.fetch_add(1, std::memory_order_relaxed);
+      counters_.total_nanos.fetch_add(nanos, std::memory_order_relaxed);
+      counters_.latency[bucket].fetch_add(1, std::memory_order_relaxed);
+      current_() = outer_;
+    }
+
+    // Charges to every open scope, innermost to outermost.
+    static void scanned(uint64_t edges) {
+      for (StatsScope* scope = current_(); scope; scope = scope->outer_) {
+	scope->counters_.edges_scanned.fetch_add(edges, std::memory_order_relaxed);
+      }
+    }
+    static void allocated(uint64_t objects) {
+      for (StatsScope* scope = current_(); scope; scope = scope->outer_) {
+	scope->counters_.allocations.fetch_add(objects, std::memory_order_relaxed);
+      }
+    }
+
+   private:
+    StatsCounters& counters_;
+    StatsScope* outer_;
+    std::chrono::steady_clock::time_point start_;
+
+    static StatsScope*& current_() {
+      static thread_local StatsScope* current = nullptr;
+      return current;
+    }
+  };
+
+  // A snapshot of every operation's counters, in StatsOp order. All zero
+  // unless built with GRAPHS_STATS.
+  vector<OpStats> stats() {
+    vector<OpStats> snapshot(int(StatsOp::kCount));
+    for (int op = 0; op < int(StatsOp::kCount); op++) {
+      const StatsCounters& counters = stats_counters_()[op];
+      OpStats& s = snapshot[op];
+      s.name = kStatsOpNames[op];
+      s.calls = counters.calls.load(std::memory_order_relaxed);
+      s.edges_scanned = counters.edges_scanned.load(std::memory_order_relaxed);
+      s.allocations = counters.allocations.load(std::memory_order_relaxed);
+      s.total_nanos = counters.total_nanos.load(std::memory_order_relaxed);
+      for (int i = 0; i < kLatencyBuckets; i++) {
+	s.latency[i] = counters.latency[i].load(std::memory_order_relaxed);
+      }
+    }
+    return snapshot;
+  }
+
+  void reset_stats() {
+    for (int op = 0; op < int(StatsOp::kCount); op++) {
+      StatsCounters& counters = stats_counters_()[op];
+      counters.calls.store(0, std::memory_order_relaxed);
+      counters.edges_scanned.store(0, std::memory_order_relaxed);
+      counters.allocations.store(0, std::memory_order_relaxed);
+      counters.total_nanos.store(0, std::memory_order_relaxed);
+      for (int i = 0; i < kLatencyBuckets; i++) {
+	counters.latency[i].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+#ifdef GRAPHS_STATS
+#define GRAPHS_STATS_OP(op) graph_lib::StatsScope graphs_stats_scope_(graph_lib::StatsOp::op)
+#define GRAPHS_STATS_SCANNED(edges) graph_lib::StatsScope::scanned(edges)
+#define GRAPHS_STATS_ALLOCATED(objects) graph_lib::StatsScope::allocated(objects)
+#else
+#define GRAPHS_STATS_OP(op)
+#define GRAPHS_STATS_SCANNED(edges)
+#define GRAPHS_STATS_ALLOCATED(objects)
+#endif
@@ -0,0 +1,194 @@
+// Keeps a topological order of a DAG up to date as edges are inserted,
+// after Pearce & Kelly, "A Dynamic Topological Sort Algorithm for
+// Directed Acyclic Graphs" (2006). Inserting x -> y costs nothing when x
+// already precedes y. Otherwise only the vertices ordered between y and
+// x are searched: x -> y closes a cycle exactly when x is reachable from
+// y, and if it is not, the two searched regions swap positions.
+//
+// Nodes are addressed by dense index; node(id) maps a vertex ID to one.
+// Storage comes from the memory resource given at construction.
+class TopologicalOrder {
+ public:
+  explicit TopologicalOrder(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    : nodes_(resource), ord_(resource), out_(resource), in_(resource), marked_(resource), forward_(resource),
+      backward_(resource), stack_(resource) {}
+
+  // Index of the node for id, appending it to the order if new.
+  uint32_t node(int id) {
+    auto inserted = nodes_.emplace(id, ord_.size());
+    if (inserted.second) {
+      ord_.push_back(ord_.size());
+      out_.emplace_back();
+      in_.emplace_back();
+      marked_.push_back(false);
+    }
+    return inserted.first->second;
+  }
+
+  // Replaces the whole state. ids lists every node in a valid
+  // topological order, and edges are (source, dest) positions in ids.
+  void assign(const vector<int>& ids, const vector<std::pair<uint32_t, uint32_t>>& edges) {
+    nodes_.clear();
+    nodes_.reserve(ids.size());
+    ord_.clear();
+    out_.assign(ids.size(), std::pmr::vector<uint32_t>());
+    in_.assign(ids.size(), std::pmr::vector<uint32_t>());
+    marked_.assign(ids.size(), false);
+    for (uint32_t i = 0; i < ids.size(); i++) {
+      nodes_.emplace(ids[i], i);
+      ord_.push_back(i);
+    }
+    for (const auto& edge : edges) {
+      out_[edge.first].push_back(edge.second);
+      in_[edge.second].push_back(edge.first);
+    }
+  }
+
+  uint32_t find(int id) const {
+    auto it = nodes_.find(id);
+    return it != nodes_.end() ? it->second : kNoVertex;
+  }
+
+  // Records x -> y and returns true, or returns false and changes
+  // nothing if the edge would close a cycle.
+  bool add_edge(uint32_t x, uint32_t y) {
+    if (x == y) {
+      return false;
+    }
+    uint32_t lower = ord_[y];
+    uint32_t upper = ord_[x];
+    if (lower < upper) {
+      if (!search_forward_(y, x, upper)) {
+	unmark_();
+	return false;
+      }
+      search_backward_(x, lower);
+      reorder_();
+    }
+    out_[x].push_back(y);
+    in_[y].push_back(x);
+    return true;
+  }
+
+  // Drops one x -> y edge. Returns false if there was none.
+  bool remove_edge(uint32_t x, uint32_t y) {
+    auto out = std::find(out_[x].begin(), out_[x].end(), y);
+    if (out == out_[x].end()) {
+      return false;
+    }
+    out_[x].erase(out);
+    auto in = std::find(in_[y].begin(), in_[y].end(), x);
+    if (in != in_[y].end()) {
+      in_[y].erase(in);
+    }
+    return true;
+  }
+
+  // Drops every edge into or out of x.
+  void remove_edges_of(uint32_t x) {
+    for (uint32_t y : out_[x]) {
+      auto it = std::find(in_[y].begin(), in_[y].end(), x);
+      if (it != in_[y].end()) {
+	in_[y].erase(it);
+      }
+    }
+    for (uint32_t w : in_[x]) {
+      auto it = std::find(out_[w].begin(), out_[w].end(), x);
+      if (it != out_[w].end()) {
+	out_[w].erase(it);
+      }
+    }
+    out_[x].clear();
+    in_[x].clear();
+  }
+
+  // Position of a node in the order: every edge x -> y has
+  // position(x) < position(y).
+  uint32_t position(uint32_t x) const {
+    return ord_[x];
+  }
+
+ private:
+  std::pmr::unordered_map<int, uint32_t> nodes_;
+  std::pmr::vector<uint32_t> ord_;
+  std::pmr::vector<std::pmr::vector<uint32_t>> out_;
+  std::pmr::vector<std::pmr::vector<uint32_t>> in_;
+  // Scratch state for the searches, cleared after each insert.
+  std::pmr::vector<bool> marked_;
+  std::pmr::vector<uint32_t> forward_;
+  std::pmr::vector<uint32_t> backward_;
+  std::pmr::vector<uint32_t> stack_;
+
+  // Collects the nodes reachable from y that are ordered before x.
+  // Returns false if x itself is reachable.
+  bool search_forward_(uint32_t y, uint32_t x, uint32_t upper) {
+    mark_(y, forward_);
+    while (!stack_.empty()) {
+      uint32_t w = stack_.back();
+      stack_.pop_back();
+      for (uint32_t s : out_[w]) {
+	if (s == x) {
+	  stack_.clear();
+	  return false;
+	}
+	if (!marked_[s] && ord_[s] < upper) {
+	  mark_(s, forward_);
+	}
+      }
+    }
+    return true;
+  }
+
+  // Collects the nodes that reach x and are ordered after y.
+  void search_backward_(uint32_t x, uint32_t lower) {
+    mark_(x, backward_);
+    while (!stack_.empty()) {
+      uint32_t w = stack_.back();
+      stack_.pop_back();
+      for (uint32_t p : in_[w]) {
+	if (!marked_[p] && ord_[p] > lower) {
+	  mark_(p, backward_);
+	}
+      }
+    }
+  }
+
+  void mark_(uint32_t w, std::pmr::vector<uint32_t>& region) {
+    marked_[w] = true;
+    region.push_back(w);
+    stack_.push_back(w);
+  }
+
+  // Reuses the positions held by both regions, placing everything that
+  // reaches x before everything reachable from y.
+  void reorder_() {
+    auto by_position = [this](uint32_t a, uint32_t b) {
+      return ord_[a] < ord_[b];
+    };
+    std::sort(backward_.begin(), backward_.end(), by_position);
+    std::sort(forward_.begin(), forward_.end(), by_position);
+    vector<uint32_t> nodes(backward_.begin(), backward_.end());
+    nodes.insert(nodes.end(), forward_.begin(), forward_.end());
+    vector<uint32_t> positions;
+    positions.reserve(nodes.size());
+    for (uint32_t w : nodes) {
+      positions.push_back(ord_[w]);
+    }
+    std::sort(positions.begin(), positions.end());
+    for (size_t i = 0; i < nodes.size(); i++) {
+      ord_[nodes[i]] = positions[i];
+    }
+    unmark_();
+  }
+
+  void unmark_() {
+    for (uint32_t w : forward_) {
+      marked_[w] = false;
+    }
+    for (uint32_t w : backward_) {
+      marked_[w] = false;
+    }
+    forward_.clear();
+    backward_.clear();
+  }
+};
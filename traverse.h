@@ -0,0 +1,192 @@
+// Traversals over any Graph. They walk neighbor_view(), so no neighbor
+// list is copied, and tell vertices apart by ID (the second part of
+// their Value). A source is listed as given; every other vertex is the
+// graph's own.
+namespace graph_lib {
+  // The vertices reachable from sources, sources first, each listed once
+  // in breadth-first order.
+  vector<Vertex*> bfs(Graph<Vertex*, Edge*>& g, Span<Vertex* const> sources) {
+    std::unordered_set<int> seen;
+    vector<Vertex*> order;
+    for (Vertex* source : sources) {
+      if (seen.insert(source->value().second).second) {
+	order.push_back(source);
+      }
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+      for (Vertex* next : g.neighbor_view(order[i])) {
+	if (seen.insert(next->value().second).second) {
+	  order.push_back(next);
+	}
+      }
+    }
+    return order;
+  }
+
+  vector<Vertex*> bfs(Graph<Vertex*, Edge*>& g, Vertex* source) {
+    return bfs(g, Span<Vertex* const>(&source, 1));
+  }
+
+  // The vertices reachable from source in depth-first preorder, taking
+  // neighbors in the order the graph lists them.
+  vector<Vertex*> dfs(Graph<Vertex*, Edge*>& g, Vertex* source) {
+    using Iterator = decltype(g.neighbor_view(source).begin());
+    std::unordered_set<int> seen = {source->value().second};
+    vector<Vertex*> order = {source};
+    // The unvisited rest of each open vertex's neighbors.
+    vector<std::pair<Iterator, Iterator>> stack;
+    auto view = g.neighbor_view(source);
+    stack.emplace_back(view.begin(), view.end());
+    while (!stack.empty()) {
+      std::pair<Iterator, Iterator>& frame = stack.back();
+      if (frame.first == frame.second) {
+	stack.pop_back();
+	continue;
+      }
+      Vertex* next = *frame.first;
+      ++frame.first;
+      if (seen.insert(next->value().second).second) {
+	order.push_back(next);
+	auto next_view = g.neighbor_view(next);
+	stack.emplace_back(next_view.begin(), next_view.end());
+      }
+    }
+    return order;
+  }
+
+  // Whether a path leads from one of sources to target. The search stops
+  // as soon as target turns up.
+  bool reachable(Graph<Vertex*, Edge*>& g, Span<Vertex* const> sources, const Vertex* target) {
+    int target_id = target->value().second;
+    std::unordered_set<int> seen;
+    vector<Vertex*> queue;
+    for (Vertex* source : sources) {
+      if (source->value().second == target_id) {
+	return true;
+      }
+      if (seen.insert(source->value().second).second) {
+	queue.push_back(source);
+      }
+    }
+    for (size_t i = 0; i < queue.size(); i++) {
+      for (Vertex* next : g.neighbor_view(queue[i])) {
+	if (next->value().second == target_id) {
+	  return true;
+	}
+	if (seen.insert(next->value().second).second) {
+	  queue.push_back(next);
+	}
+      }
+    }
+    return false;
+  }
+
+  // Breadth-first distances over a frozen graph: entry i is the number
+  // of edges from the nearest of sources (dense indices) to the vertex at
+  // index i, or kNoVertex if it is unreachable.
+  //
+  // Every level is expanded on pool in whichever direction is cheaper,
+  // after Beamer, Asanovic & Patterson, "Direction-Optimizing
+  // Breadth-First Search" (2012). Top-down steps follow the frontier's
+  // out-edges. Once those outnumber a fraction of the edges left
+  // unexplored, bottom-up steps instead have every unreached vertex scan
+  // its in-edges for a parent in the frontier, stopping at the first;
+  // this wins while the frontier is a large part of the graph.
+  vector<uint32_t> parallel_bfs(const CsrGraph& g, Span<const uint32_t> sources, ThreadPool& pool) {
+    // Switch to bottom-up when the frontier has more than 1/kAlpha of the
+    // unexplored edges, and back when it has under 1/kBeta of the vertices.
+    const uint64_t kAlpha = 14;
+    const uint64_t kBeta = 24;
+    const size_t n = g.vertex_count();
+    unique_ptr<std::atomic<uint32_t>[]> depth(new std::atomic<uint32_t>[n]);
+    pool.parallel_for(n, [&depth](size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) {
+	  depth[i].store(kNoVertex, std::memory_order_relaxed);
+	}
+      });
+
+    vector<uint32_t> frontier;
+    uint64_t unexplored_edges = g.targets().size();
+    for (uint32_t source : sources) {
+      if (depth[source].load(std::memory_order_relaxed) == kNoVertex) {
+	depth[source].store(0, std::memory_order_relaxed);
+	frontier.push_back(source);
+	unexplored_edges -= g.out_degree(source);
+      }
+    }
+
+    // Chunks merge what they find into next under the lock.
+    vector<uint32_t> next;
+    std::mutex next_mutex;
+    auto merge = [&](const vector<uint32_t>& found, uint64_t found_edges) {
+      std::lock_guard<std::mutex> lock(next_mutex);
+      next.insert(next.end(), found.begin(), found.end());
+      unexplored_edges -= found_edges;
+    };
+    vector<uint8_t> in_frontier;
+    bool bottom_up = false;
+    for (uint32_t level = 1; !frontier.empty(); level++) {
+      uint64_t frontier_edges = 0;
+      for (uint32_t v : frontier) {
+	frontier_edges += g.out_degree(v);
+      }
+      if (!bottom_up && frontier_edges > unexplored_edges / kAlpha) {
+	bottom_up = true;
+      } else if (bottom_up && frontier.size() < n / kBeta) {
+	bottom_up = false;
+      }
+
+      if (bottom_up) {
+	in_frontier.assign(n, 0);
+	for (uint32_t v : frontier) {
+	  in_frontier[v] = 1;
+	}
+	pool.parallel_for(n, [&](size_t begin, size_t end) {
+	    vector<uint32_t> found;
+	    uint64_t found_edges = 0;
+	    for (uint32_t v = begin; v < end; v++) {
+	      if (depth[v].load(std::memory_order_relaxed) != kNoVertex) {
+		continue;
+	      }
+	      for (uint32_t parent : g.in_neighbors(v)) {
+		if (in_frontier[parent]) {
+		  // Each vertex belongs to one chunk, so no other thread
+		  // writes it.
+		  depth[v].store(level, std::memory_order_relaxed);
+		  found.push_back(v);
+		  found_edges += g.out_degree(v);
+		  break;
+		}
+	      }
+	    }
+	    merge(found, found_edges);
+	  });
+      } else {
+	pool.parallel_for(frontier.size(), [&](size_t begin, size_t end) {
+	    vector<uint32_t> found;
+	    uint64_t found_edges = 0;
+	    for (size_t i = begin; i < end; i++) {
+	      for (uint32_t dest : g.neighbors(frontier[i])) {
+		// Claim dest; only the thread that wins lists it.
+		uint32_t unreached = kNoVertex;
+		if (depth[dest].load(std::memory_order_relaxed) == kNoVertex
+		    && depth[dest].compare_exchange_strong(unreached, level, std::memory_order_relaxed)) {
+		  found.push_back(dest);
+		  found_edges += g.out_degree(dest);
+		}
+	      }
+	    }
+	    merge(found, found_edges);
+	  });
+      }
+      frontier.swap(next);
+      next.clear();
+    }
+
+    vector<uint32_t> result(n);
+    for (size_t i = 0; i < n; i++) {
+      result[i] = depth[i].load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+}
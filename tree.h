@@ -1,51 +1,596 @@
+// A rooted tree with its own storage. Each vertex gets a dense handle,
+// and the shape lives in arrays indexed by it: the parent, the first and
+// last child, and the previous and next sibling. parent() is one lookup,
+// and add_edge() only walks from source up to the root to rule out a
+// cycle, rather than running a DAG cycle check.
+//
+// Vertices are interned by ID as in DirectedGraph, and all storage comes
+// from the memory resource given at construction. Copies use the
+// default resource.
+//
+// lca(), is_ancestor() and depth() answer in O(1) from an index built on
+// the first query after a change. Edges also sit on a list in the order
+// they were added, which edges() and to_string() follow.
 class Tree {
  public:
-  Tree() {
-    dag_ = std::make_unique<DirectedAcyclicGraph>();
-  }
-  Tree(const Tree& tree) noexcept {
-    if (tree.dag_.get()) {
-      dag_ = std::make_unique<DirectedAcyclicGraph>(*(tree.dag_.get()));
+  // One parent-child edge, read in place. Mirrors Edge's getters; a tree
+  // with only a root lists it as an edge without a dest.
+  class EdgeRef {
+   public:
+    EdgeRef(const Tree* tree, uint32_t h) : tree_(tree), h_(h) {}
+    const Vertex* get_source() const {
+      uint32_t parent = tree_->parent_[h_];
+      return &tree_->vertices_[parent != kNoVertex ? parent : h_];
+    }
+    const Vertex* get_dest() const {
+      return tree_->parent_[h_] != kNoVertex ? &tree_->vertices_[h_] : nullptr;
+    }
+    const Value& value() const {
+      return tree_->parent_[h_] != kNoVertex ? tree_->edge_values_[h_] : kDummyValue;
+    }
+
+   private:
+    const Tree* tree_;
+    uint32_t h_;
+  };
+
+  // Every edge, in the order added.
+  class EdgeRange {
+   public:
+    class iterator {
+     public:
+      iterator(const Tree* tree, uint32_t h) : tree_(tree), h_(h) {}
+      EdgeRef operator*() const {
+	return EdgeRef(tree_, h_);
+      }
+      iterator& operator++() {
+	h_ = tree_->next_added_[h_];
+	return *this;
+      }
+      bool operator==(const iterator& other) const {
+	return h_ == other.h_;
+      }
+      bool operator!=(const iterator& other) const {
+	return h_ != other.h_;
+      }
+
+     private:
+      const Tree* tree_;
+      uint32_t h_;
+    };
+
+    explicit EdgeRange(const Tree* tree) : tree_(tree) {}
+    iterator begin() const {
+      uint32_t root = tree_->root_;
+      if (root == kNoVertex || tree_->first_added_ == kNoVertex) {
+	return iterator(tree_, root);
+      }
+      return iterator(tree_, tree_->first_added_);
     }
-  } 
+    iterator end() const {
+      return iterator(tree_, kNoVertex);
+    }
+    size_t size() const {
+      return tree_->root_ == kNoVertex ? 0 : std::max<size_t>(tree_->handles_.size() - 1, 1);
+    }
+    bool empty() const {
+      return tree_->root_ == kNoVertex;
+    }
+
+   private:
+    const Tree* tree_;
+  };
+
+  // The children of one vertex, oldest first.
+  class ChildView {
+   public:
+    class iterator {
+     public:
+      iterator(const Tree* tree, uint32_t h) : tree_(tree), h_(h) {}
+      Vertex* operator*() const {
+	return const_cast<Vertex*>(&tree_->vertices_[h_]);
+      }
+      iterator& operator++() {
+	h_ = tree_->next_sibling_[h_];
+	return *this;
+      }
+      bool operator==(const iterator& other) const {
+	return h_ == other.h_;
+      }
+      bool operator!=(const iterator& other) const {
+	return h_ != other.h_;
+      }
+
+     private:
+      const Tree* tree_;
+      uint32_t h_;
+    };
+
+    ChildView(const Tree* tree, uint32_t first) : tree_(tree), first_(first) {}
+    iterator begin() const {
+      return iterator(tree_, first_);
+    }
+    iterator end() const {
+      return iterator(tree_, kNoVertex);
+    }
+    size_t size() const {
+      size_t n = 0;
+      for (uint32_t h = first_; h != kNoVertex; h = tree_->next_sibling_[h]) {
+	n++;
+      }
+      return n;
+    }
+    bool empty() const {
+      return first_ == kNoVertex;
+    }
+
+   private:
+    const Tree* tree_;
+    uint32_t first_;
+  };
+
+  // A vertex and all its descendants, in preorder. Walking it needs no
+  // stack: each step follows a child, sibling or parent link.
+  class SubtreeView {
+   public:
+    class iterator {
+     public:
+      iterator(const Tree* tree, uint32_t top, uint32_t h) : tree_(tree), top_(top), h_(h) {}
+      Vertex* operator*() const {
+	return const_cast<Vertex*>(&tree_->vertices_[h_]);
+      }
+      iterator& operator++() {
+	h_ = tree_->next_preorder_(h_, top_);
+	return *this;
+      }
+      bool operator==(const iterator& other) const {
+	return h_ == other.h_;
+      }
+      bool operator!=(const iterator& other) const {
+	return h_ != other.h_;
+      }
+
+     private:
+      const Tree* tree_;
+      uint32_t top_;
+      uint32_t h_;
+    };
+
+    SubtreeView(const Tree* tree, uint32_t top) : tree_(tree), top_(top) {}
+    iterator begin() const {
+      return iterator(tree_, top_, top_);
+    }
+    iterator end() const {
+      return iterator(tree_, top_, kNoVertex);
+    }
+    bool empty() const {
+      return top_ == kNoVertex;
+    }
+
+   private:
+    const Tree* tree_;
+    uint32_t top_;
+  };
+
+  Tree() : Tree(std::pmr::get_default_resource()) {}
+  // resource must outlive the tree (see DirectedGraph).
+  explicit Tree(std::pmr::memory_resource* resource)
+    : vertices_(resource), handles_(resource), parent_(resource), first_child_(resource),
+      last_child_(resource), prev_sibling_(resource), next_sibling_(resource), prev_added_(resource),
+      next_added_(resource), edge_values_(resource), free_handles_(resource), depth_(resource), enter_(resource),
+      exit_(resource), shallowest_(resource) {}
+
+  // Only allowed when the tree is empty: the vertex becomes the root.
   bool add(const Vertex* u) {
-    if (get_adjacency_list().size() > 0) {
-      // Only allowed to add when the tree is empty.
+    if (root_ != kNoVertex) {
       return false;
     }
-    return dag_.get()->add(u);
+    root_ = intern_(*u);
+    return true;
   }
+
+  // Links dest under source. dest must be new to the tree, or be the
+  // root with source new, which puts source above it as the new root. In
+  // an empty tree source becomes the root.
   bool add_edge(const Vertex* source, const Vertex* dest) {
-    return dag_.get()->add_edge(source, dest);
+    return add_edge_(source, dest, kDummyValue);
   }
+
   bool add_edge(const Edge* edge) {
-    return dag_.get()->add_edge(edge);
+    if (edge->get_source() && edge->get_dest()) {
+      return add_edge_(edge->get_source().get(), edge->get_dest().get(),
+		       edge->value() ? *edge->value() : kDummyValue);
+    }
+    // An edge with one end can only bring in a root.
+    if (edge->get_source()) {
+      return add(edge->get_source().get());
+    }
+    return edge->get_dest() && add(edge->get_dest().get());
   }
+
   vector<Edge> get_adjacency_list() {
-    return dag_.get()->get_adjacency_list();
+    vector<Edge> edges;
+    for (const EdgeRef& e : this->edges()) {
+      edges.emplace_back(std::make_unique<Vertex>(*e.get_source()),
+			 e.get_dest() ? std::make_unique<Vertex>(*e.get_dest()) : nullptr,
+			 std::make_unique<Value>(e.value()));
+    }
+    return edges;
+  }
+
+  EdgeRange edges() const {
+    return EdgeRange(this);
+  }
+
+  CsrGraph freeze() const {
+    vector<const Vertex*> live;
+    vector<uint32_t> position(vertices_.size(), kNoVertex);
+    vector<std::pair<uint32_t, uint32_t>> edges;
+    for (uint32_t h = root_; h != kNoVertex; h = next_preorder_(h, root_)) {
+      position[h] = live.size();
+      live.push_back(&vertices_[h]);
+      // Preorder reaches a parent before its children.
+      if (parent_[h] != kNoVertex) {
+	edges.emplace_back(position[parent_[h]], position[h]);
+      }
+    }
+    return CsrGraph(live, edges);
+  }
+
+  bool are_adjacent(const Vertex* u, const Vertex* v) const {
+    uint32_t source = find_(u);
+    uint32_t dest = find_(v);
+    return source != kNoVertex && dest != kNoVertex && parent_[dest] == source;
+  }
+
+  int edge_count() const {
+    return handles_.empty() ? 0 : handles_.size() - 1;
+  }
+
+  vector<Vertex*> get_neighbors(Vertex* u) const {
+    GRAPHS_STATS_OP(kTreeGetNeighbors);
+    vector<Vertex*> neighbors;
+    for (Vertex* child : children(u)) {
+      neighbors.push_back(child);
+    }
+    GRAPHS_STATS_SCANNED(neighbors.size());
+    return neighbors;
+  }
+
+  ChildView neighbor_view(const Vertex* u) const {
+    return children(u);
+  }
+
+  ChildView children(const Vertex* u) const {
+    uint32_t h = find_(u);
+    return ChildView(this, h != kNoVertex ? first_child_[h] : kNoVertex);
+  }
+
+  // The tree's copy of u's parent, or nullptr for the root and for
+  // vertices not in the tree.
+  Vertex* parent(const Vertex* u) const {
+    GRAPHS_STATS_OP(kTreeParent);
+    uint32_t h = find_(u);
+    return h != kNoVertex && parent_[h] != kNoVertex ? const_cast<Vertex*>(&vertices_[parent_[h]]) : nullptr;
+  }
+
+  // u's parent as a list, which is empty for the root and for vertices
+  // not in the tree.
+  vector<Vertex*> get_predecessors(Vertex* u) const {
+    Vertex* p = parent(u);
+    return p ? vector<Vertex*>{p} : vector<Vertex*>();
+  }
+
+  int in_degree(const Vertex* u) const {
+    uint32_t h = find_(u);
+    return h != kNoVertex && parent_[h] != kNoVertex;
+  }
+
+  int out_degree(const Vertex* u) const {
+    return children(u).size();
   }
-  bool are_adjacent(const Vertex* u, const Vertex* v) {
-    return dag_.get()->are_adjacent(u, v);
+
+  // u and its descendants in preorder; empty if u is not in the tree.
+  SubtreeView subtree(const Vertex* u) const {
+    return SubtreeView(this, find_(u));
   }
-  int edge_count() {
-    return dag_.get()->edge_count();
+
+  // The number of edges between u and the root, or -1 if u is not in
+  // the tree.
+  int depth(const Vertex* u) {
+    uint32_t h = find_(u);
+    if (h == kNoVertex) {
+      return -1;
+    }
+    index_();
+    return depth_[h];
   }
-  vector<Vertex*> get_neighbors(Vertex* u) {
-    return dag_.get()->get_neighbors(u);
+
+  // Whether u is v or an ancestor of v.
+  bool is_ancestor(const Vertex* u, const Vertex* v) {
+    uint32_t a = find_(u);
+    uint32_t b = find_(v);
+    if (a == kNoVertex || b == kNoVertex) {
+      return false;
+    }
+    index_();
+    return enter_[a] <= enter_[b] && enter_[b] < exit_[a];
   }
+
+  // The deepest vertex that is an ancestor of both u and v, or nullptr
+  // if either is not in the tree.
+  Vertex* lca(const Vertex* u, const Vertex* v) {
+    GRAPHS_STATS_OP(kTreeLca);
+    uint32_t a = find_(u);
+    uint32_t b = find_(v);
+    if (a == kNoVertex || b == kNoVertex) {
+      return nullptr;
+    }
+    if (a == b) {
+      return &vertices_[a];
+    }
+    index_();
+    // Between the two in preorder, after the earlier one, the shallowest
+    // vertex is a child of their LCA on the path to the later one.
+    uint32_t begin = std::min(enter_[a], enter_[b]) + 1;
+    uint32_t end = std::max(enter_[a], enter_[b]) + 1;
+    uint32_t k = 0;
+    while (uint32_t(2) << k <= end - begin) {
+      k++;
+    }
+    uint32_t x = shallowest_[k][begin];
+    uint32_t y = shallowest_[k][end - (uint32_t(1) << k)];
+    return &vertices_[parent_[depth_[x] <= depth_[y] ? x : y]];
+  }
+
+  // The tree's copy of the vertex with u's ID, or nullptr if absent.
+  Vertex* find(const Vertex* u) const {
+    uint32_t h = find_(u);
+    return h != kNoVertex ? const_cast<Vertex*>(&vertices_[h]) : nullptr;
+  }
+
+  // Removes u with its whole subtree, so what is left is still a tree.
+  // Removing the root empties it.
   void remove(const Vertex* u) {
-    dag_.get()->remove(u);
+    GRAPHS_STATS_OP(kTreeRemove);
+    uint32_t top = find_(u);
+    if (top == kNoVertex) {
+      return;
+    }
+    index_valid_ = false;
+    unlink_(top);
+    if (top == root_) {
+      root_ = kNoVertex;
+    }
+    // unlink_() took top off the list of edges; its descendants go below.
+    // Collect first: freeing a handle mid-walk would cut the links the
+    // walk follows.
+    vector<uint32_t> doomed;
+    for (uint32_t h = top; h != kNoVertex; h = next_preorder_(h, top)) {
+      doomed.push_back(h);
+    }
+    GRAPHS_STATS_SCANNED(doomed.size());
+    for (uint32_t h : doomed) {
+      if (h != top) {
+	unlist_(h);
+      }
+      handles_.erase(vertices_[h].value().second);
+      first_child_[h] = last_child_[h] = kNoVertex;
+      free_handles_.push_back(h);
+    }
   }
-  Vertex* top() {
-    return dag_.get()->top();
+
+  Vertex* top() const {
+    return root_ != kNoVertex ? const_cast<Vertex*>(&vertices_[root_]) : nullptr;
   }
-  int vertex_count() {
-    return dag_.get()->vertex_count();
+
+  int vertex_count() const {
+    return handles_.size();
   }
-  string to_string() {
-    return dag_.get()->to_string();
+
+  string to_string() const {
+    return graph_lib::graph_to_string(*this);
   }
 
  private:
-  unique_ptr<DirectedAcyclicGraph> dag_;
+  std::pmr::deque<Vertex> vertices_;
+  std::pmr::unordered_map<int, uint32_t> handles_;
+  // Per handle; kNoVertex where there is none.
+  std::pmr::vector<uint32_t> parent_;
+  std::pmr::vector<uint32_t> first_child_;
+  std::pmr::vector<uint32_t> last_child_;
+  std::pmr::vector<uint32_t> prev_sibling_;
+  std::pmr::vector<uint32_t> next_sibling_;
+  // The edge from each vertex's parent on the list of edges, oldest
+  // first, with its neighbors on either side.
+  std::pmr::vector<uint32_t> prev_added_;
+  std::pmr::vector<uint32_t> next_added_;
+  uint32_t first_added_ = kNoVertex;
+  uint32_t last_added_ = kNoVertex;
+  // The value of the edge from each vertex's parent.
+  std::pmr::vector<Value> edge_values_;
+  std::pmr::vector<uint32_t> free_handles_;
+  uint32_t root_ = kNoVertex;
+  // The ancestor index, dropped by every change. Per handle: its depth,
+  // and the preorder positions where its subtree starts and ends.
+  // shallowest_[k][i] is the shallowest vertex at preorder positions
+  // [i, i + 2^k).
+  bool index_valid_ = false;
+  std::pmr::vector<uint32_t> depth_;
+  std::pmr::vector<uint32_t> enter_;
+  std::pmr::vector<uint32_t> exit_;
+  std::pmr::vector<std::pmr::vector<uint32_t>> shallowest_;
+
+  bool add_edge_(const Vertex* source, const Vertex* dest, const Value& value) {
+    GRAPHS_STATS_OP(kTreeAddEdge);
+    if (source->value().second == dest->value().second) {
+      return false;
+    }
+    uint32_t s = find_(source);
+    uint32_t d = find_(dest);
+    if (root_ == kNoVertex) {
+      root_ = intern_(*source);
+      s = root_;
+    } else if (d != kNoVertex) {
+      // dest must have no parent, which leaves only the root, and must
+      // not be an ancestor of source.
+      if (parent_[d] != kNoVertex) {
+	return false;
+      }
+      for (uint32_t h = s; h != kNoVertex; h = parent_[h]) {
+	GRAPHS_STATS_SCANNED(1);
+	if (h == d) {
+	  return false;
+	}
+      }
+      if (s == kNoVertex) {
+	s = intern_(*source);
+	root_ = s;
+      }
+    } else if (s == kNoVertex) {
+      // Neither end is in the tree: that would start a second one.
+      return false;
+    }
+    if (d == kNoVertex) {
+      d = intern_(*dest);
+    }
+    link_(s, d, value);
+    return true;
+  }
+
+  uint32_t find_(const Vertex* u) const {
+    auto it = handles_.find(u->value().second);
+    return it != handles_.end() ? it->second : kNoVertex;
+  }
+
+  uint32_t intern_(const Vertex& v) {
+    uint32_t h;
+    if (!free_handles_.empty()) {
+      h = free_handles_.back();
+      free_handles_.pop_back();
+      vertices_[h] = v;
+    } else {
+      h = vertices_.size();
+      vertices_.push_back(v);
+      GRAPHS_STATS_ALLOCATED(1);
+      parent_.push_back(kNoVertex);
+      first_child_.push_back(kNoVertex);
+      last_child_.push_back(kNoVertex);
+      prev_sibling_.push_back(kNoVertex);
+      next_sibling_.push_back(kNoVertex);
+      prev_added_.push_back(kNoVertex);
+      next_added_.push_back(kNoVertex);
+      edge_values_.push_back(kDummyValue);
+    }
+    parent_[h] = first_child_[h] = last_child_[h] = prev_sibling_[h] = next_sibling_[h] = kNoVertex;
+    prev_added_[h] = next_added_[h] = kNoVertex;
+    handles_.emplace(v.value().second, h);
+    return h;
+  }
+
+  // Appends child as the youngest child of parent.
+  void link_(uint32_t parent, uint32_t child, const Value& value) {
+    index_valid_ = false;
+    parent_[child] = parent;
+    edge_values_[child] = value;
+    prev_sibling_[child] = last_child_[parent];
+    next_sibling_[child] = kNoVertex;
+    if (last_child_[parent] != kNoVertex) {
+      next_sibling_[last_child_[parent]] = child;
+    } else {
+      first_child_[parent] = child;
+    }
+    last_child_[parent] = child;
+    prev_added_[child] = last_added_;
+    next_added_[child] = kNoVertex;
+    if (last_added_ != kNoVertex) {
+      next_added_[last_added_] = child;
+    } else {
+      first_added_ = child;
+    }
+    last_added_ = child;
+  }
+
+  // Detaches h from its parent and siblings.
+  void unlink_(uint32_t h) {
+    uint32_t parent = parent_[h];
+    if (parent == kNoVertex) {
+      return;
+    }
+    if (prev_sibling_[h] != kNoVertex) {
+      next_sibling_[prev_sibling_[h]] = next_sibling_[h];
+    } else {
+      first_child_[parent] = next_sibling_[h];
+    }
+    if (next_sibling_[h] != kNoVertex) {
+      prev_sibling_[next_sibling_[h]] = prev_sibling_[h];
+    } else {
+      last_child_[parent] = prev_sibling_[h];
+    }
+    parent_[h] = prev_sibling_[h] = next_sibling_[h] = kNoVertex;
+    unlist_(h);
+  }
+
+  // Takes the edge into h off the list of edges.
+  void unlist_(uint32_t h) {
+    if (prev_added_[h] != kNoVertex) {
+      next_added_[prev_added_[h]] = next_added_[h];
+    } else {
+      first_added_ = next_added_[h];
+    }
+    if (next_added_[h] != kNoVertex) {
+      prev_added_[next_added_[h]] = prev_added_[h];
+    } else {
+      last_added_ = prev_added_[h];
+    }
+    prev_added_[h] = next_added_[h] = kNoVertex;
+  }
+
+  // The handle after h in a preorder walk of top's subtree, or kNoVertex
+  // once the walk is done.
+  uint32_t next_preorder_(uint32_t h, uint32_t top) const {
+    if (first_child_[h] != kNoVertex) {
+      return first_child_[h];
+    }
+    while (h != top && next_sibling_[h] == kNoVertex) {
+      h = parent_[h];
+    }
+    return h != top ? next_sibling_[h] : kNoVertex;
+  }
+
+  void index_() {
+    if (index_valid_) {
+      return;
+    }
+    depth_.assign(vertices_.size(), 0);
+    enter_.assign(vertices_.size(), 0);
+    exit_.assign(vertices_.size(), 0);
+    std::pmr::vector<uint32_t> preorder(shallowest_.get_allocator().resource());
+    for (uint32_t h = root_; h != kNoVertex; h = next_preorder_(h, root_)) {
+      enter_[h] = preorder.size();
+      depth_[h] = h != root_ ? depth_[parent_[h]] + 1 : 0;
+      preorder.push_back(h);
+    }
+    // Children end their parent's subtree, so sizes add up backwards.
+    vector<uint32_t> size(vertices_.size(), 1);
+    for (size_t i = preorder.size(); i-- > 1;) {
+      size[parent_[preorder[i]]] += size[preorder[i]];
+    }
+    for (uint32_t h : preorder) {
+      exit_[h] = enter_[h] + size[h];
+    }
+    shallowest_.clear();
+    shallowest_.push_back(std::move(preorder));
+    for (size_t width = 1; 2 * width <= shallowest_[0].size(); width *= 2) {
+      const std::pmr::vector<uint32_t>& half = shallowest_.back();
+      std::pmr::vector<uint32_t> level(half.size() - width, shallowest_.get_allocator().resource());
+      for (size_t i = 0; i < level.size(); i++) {
+	uint32_t x = half[i];
+	uint32_t y = half[i + width];
+	level[i] = depth_[x] <= depth_[y] ? x : y;
+      }
+      shallowest_.push_back(std::move(level));
+    }
+    index_valid_ = true;
+  }
 };
@@ -0,0 +1,409 @@
+// Streams graphs out as text without building a string per edge. A
+// GraphWriter appends to a string, or fills a fixed buffer and hands it
+// to a file descriptor or an ostream whenever it is full; numbers go
+// through std::to_chars. write_graph() walks a graph once in one of:
+//
+// - kText: the to_string() layout, "(name, id) -> (name, id)" per edge.
+// - kDot: a Graphviz digraph with one node per vertex, named by ID and
+//   labeled with the vertex's name.
+// - kEdgeList: the lines load_edge_list() reads. An edge whose value is
+//   not kDummyValue gets the second part of it as its weight. Vertices
+//   without an edge cannot be listed, names must be free of blanks, and
+//   vertices without a payload are all named "_".
+// - kJson: {"vertices": [{"id", "name"}...], "edges": [{"source",
+//   "dest", "value"}...]}.
+//
+// Graphs are read through edges() or, for a CsrGraph, its rows. Vertex
+// payloads are strings or NoPayload.
+namespace graph_lib {
+  enum class GraphFormat {
+    kText,
+    kDot,
+    kEdgeList,
+    kJson,
+  };
+
+  class GraphWriter {
+   public:
+    static const size_t kBufferSize = 1 << 16;
+
+    // Appends to *out, which must outlive the writer.
+    explicit GraphWriter(string* out) : string_(out) {}
+    // Writes to fd, which the writer does not close.
+    explicit GraphWriter(int fd) : fd_(fd) {
+      buffer_.reserve(kBufferSize);
+    }
+    explicit GraphWriter(std::ostream& out) : stream_(&out) {
+      buffer_.reserve(kBufferSize);
+    }
+    GraphWriter(const GraphWriter&) = delete;
+    GraphWriter& operator=(const GraphWriter&) = delete;
+    ~GraphWriter() {
+      flush();
+    }
+
+    // Makes room for about bytes more output up front.
+    void reserve(size_t bytes) {
+      if (string_) {
+	string_->reserve(string_->size() + bytes);
+      }
+    }
+
+    void put(std::string_view s) {
+      if (string_) {
+	string_->append(s.data(), s.size());
+	return;
+      }
+      if (buffer_.size() + s.size() > kBufferSize) {
+	flush();
+	if (s.size() > kBufferSize) {
+	  drain_(s.data(), s.size());
+	  return;
+	}
+      }
+      buffer_.append(s.data(), s.size());
+    }
+
+    void put(char c) {
+      if (string_) {
+	string_->push_back(c);
+	return;
+      }
+      if (buffer_.size() == kBufferSize) {
+	flush();
+      }
+      buffer_.push_back(c);
+    }
+
+    void put(int64_t n) {
+      char digits[24];
+      std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), n);
+      put(std::string_view(digits, result.ptr - digits));
+    }
+
+    // s between double quotes, with quotes, backslashes and control
+    // characters escaped as both DOT and JSON read them.
+    void put_quoted(std::string_view s) {
+      put('"');
+      size_t start = 0;
+      for (size_t i = 0; i < s.size(); i++) {
+	unsigned char c = s[i];
+	if (c != '"' && c != '\\' && c >= 0x20) {
+	  continue;
+	}
+	put(s.substr(start, i - start));
+	start = i + 1;
+	if (c == '"' || c == '\\') {
+	  put('\\');
+	  put(char(c));
+	} else if (c == '\n') {
+	  put("\\n");
+	} else {
+	  static const char kHex[] = "0123456789abcdef";
+	  put("\\u00");
+	  put(kHex[c >> 4]);
+	  put(kHex[c & 15]);
+	}
+      }
+      put(s.substr(start));
+      put('"');
+    }
+
+    // Hands buffered output to the fd or stream. Returns false once any
+    // write has failed.
+    bool flush() {
+      if (!buffer_.empty()) {
+	drain_(buffer_.data(), buffer_.size());
+	buffer_.clear();
+      }
+      if (stream_) {
+	ok_ = ok_ && !stream_->fail();
+      }
+      return ok_;
+    }
+
+   private:
+    string* string_ = nullptr;
+    int fd_ = -1;
+    std::ostream* stream_ = nullptr;
+    string buffer_;
+    bool ok_ = true;
+
+    void drain_(const char* data, size_t size) {
+      if (stream_) {
+	stream_->write(data, size);
+	return;
+      }
+      while (ok_ && size > 0) {
+	ssize_t n = ::write(fd_, data, size);
+	if (n < 0 && errno == EINTR) {
+	  continue;
+	}
+	if (n <= 0) {
+	  ok_ = false;
+	  break;
+	}
+	data += n;
+	size -= n;
+      }
+    }
+  };
+
+  // A vertex as the writer sees it: a name, if it has one, and an ID.
+  struct VertexLabel {
+    bool named;
+    std::string_view name;
+    int64_t id;
+  };
+
+  template<typename Id>
+  VertexLabel vertex_label_(const BasicVertex<string, Id>& v) {
+    return VertexLabel{true, v.value().first, int64_t(v.value().second)};
+  }
+
+  template<typename Id>
+  VertexLabel vertex_label_(const BasicVertex<NoPayload, Id>& v) {
+    return VertexLabel{false, std::string_view(), int64_t(v.id())};
+  }
+
+  // Emits the parts of one format; write_graph() drives it with every
+  // vertex, then every edge.
+  class FormatWriter {
+   public:
+    FormatWriter(GraphWriter& out, GraphFormat format, bool edge_values)
+      : out_(out), format_(format), edge_values_(edge_values) {}
+
+    void begin(const char* title, int vertex_count) {
+      switch (format_) {
+      case GraphFormat::kText:
+	out_.put(title);
+	out_.put(" (# vertices = ");
+	out_.put(int64_t(vertex_count));
+	out_.put("):\n");
+	break;
+      case GraphFormat::kDot:
+	out_.put("digraph {\n");
+	break;
+      case GraphFormat::kJson:
+	out_.put("{\"vertices\": [");
+	break;
+      default:
+	break;
+      }
+    }
+
+    void vertex(const VertexLabel& v) {
+      if (format_ == GraphFormat::kDot) {
+	out_.put("  ");
+	out_.put(v.id);
+	if (v.named) {
+	  out_.put(" [label=");
+	  out_.put_quoted(v.name);
+	  out_.put(']');
+	}
+	out_.put(";\n");
+      } else if (format_ == GraphFormat::kJson) {
+	out_.put(first_ ? "\n  {\"id\": " : ",\n  {\"id\": ");
+	out_.put(v.id);
+	if (v.named) {
+	  out_.put(", \"name\": ");
+	  out_.put_quoted(v.name);
+	}
+	out_.put('}');
+	first_ = false;
+      }
+    }
+
+    void begin_edges() {
+      if (format_ == GraphFormat::kJson) {
+	out_.put(first_ ? "],\n \"edges\": [" : "\n ],\n \"edges\": [");
+	first_ = true;
+      }
+    }
+
+    // source or dest is null for a record without that end, as kept by
+    // DirectedGraph::add(); only kText shows those.
+    void edge(const VertexLabel* source, const VertexLabel* dest, const Value* value) {
+      switch (format_) {
+      case GraphFormat::kText:
+	text_vertex_(source);
+	out_.put(" -> ");
+	text_vertex_(dest);
+	out_.put("\n\n");
+	return;
+      case GraphFormat::kDot:
+	if (source && dest) {
+	  out_.put("  ");
+	  out_.put(source->id);
+	  out_.put(" -> ");
+	  out_.put(dest->id);
+	  if (edge_values_ && *value != kDummyValue) {
+	    out_.put(" [label=");
+	    out_.put(int64_t(value->second));
+	    out_.put(']');
+	  }
+	  out_.put(";\n");
+	}
+	return;
+      case GraphFormat::kEdgeList:
+	if (source && dest) {
+	  out_.put(source->named ? source->name : "_");
+	  out_.put(' ');
+	  out_.put(source->id);
+	  out_.put(' ');
+	  out_.put(dest->named ? dest->name : "_");
+	  out_.put(' ');
+	  out_.put(dest->id);
+	  if (edge_values_ && *value != kDummyValue) {
+	    out_.put(' ');
+	    out_.put(int64_t(value->second));
+	  }
+	  out_.put('\n');
+	}
+	return;
+      case GraphFormat::kJson:
+	if (source && dest) {
+	  out_.put(first_ ? "\n  {\"source\": " : ",\n  {\"source\": ");
+	  out_.put(source->id);
+	  out_.put(", \"dest\": ");
+	  out_.put(dest->id);
+	  if (edge_values_) {
+	    out_.put(", \"value\": [");
+	    out_.put_quoted(value->first);
+	    out_.put(", ");
+	    out_.put(int64_t(value->second));
+	    out_.put(']');
+	  }
+	  out_.put('}');
+	  first_ = false;
+	}
+	return;
+      }
+    }
+
+    void end() {
+      if (format_ == GraphFormat::kDot) {
+	out_.put("}\n");
+      } else if (format_ == GraphFormat::kJson) {
+	out_.put(first_ ? "]}\n" : "\n ]}\n");
+      }
+    }
+
+   private:
+    GraphWriter& out_;
+    GraphFormat format_;
+    bool edge_values_;
+    bool first_ = true;
+
+    void text_vertex_(const VertexLabel* v) {
+      if (!v) {
+	out_.put("NULL");
+	return;
+      }
+      out_.put('(');
+      if (v->named) {
+	out_.put(v->name);
+	out_.put(", ");
+      }
+      out_.put(v->id);
+      out_.put(')');
+    }
+  };
+
+  // Whether the edges of G carry a Value to write.
+  template<typename G>
+  constexpr bool has_edge_values_() {
+    if constexpr (std::is_same<G, CsrGraph>::value) {
+      return false;
+    } else {
+      return std::is_same<std::decay_t<decltype((*std::declval<const G&>().edges().begin()).value())>, Value>::value;
+    }
+  }
+
+  // Writes g to out in format. Returns false if out has failed to write.
+  template<typename G>
+  bool write_graph(const G& g, GraphWriter& out, GraphFormat format = GraphFormat::kText) {
+    // Roughly one line per edge and, for the formats listing them, per
+    // vertex.
+    out.reserve(32 * (size_t(g.edge_count()) + size_t(g.vertex_count())));
+    FormatWriter writer(out, format, has_edge_values_<G>());
+    writer.begin("Graph", g.vertex_count());
+
+    if constexpr (std::is_same<G, CsrGraph>::value) {
+      auto label = [&g](uint32_t i) {
+	return VertexLabel{true, g.name(i), int64_t(g.id(i))};
+      };
+      uint32_t n = g.ids().size();
+      if (format == GraphFormat::kDot || format == GraphFormat::kJson) {
+	for (uint32_t i = 0; i < n; i++) {
+	  writer.vertex(label(i));
+	}
+      }
+      writer.begin_edges();
+      for (uint32_t i = 0; i < n; i++) {
+	VertexLabel source = label(i);
+	if (g.out_degree(i) == 0) {
+	  writer.edge(&source, nullptr, nullptr);
+	}
+	for (uint32_t dest : g.neighbors(i)) {
+	  VertexLabel d = label(dest);
+	  writer.edge(&source, &d, nullptr);
+	}
+      }
+    } else {
+      if (format == GraphFormat::kDot || format == GraphFormat::kJson) {
+	// Every vertex once, in order of first appearance.
+	std::unordered_set<int64_t> seen;
+	seen.reserve(g.vertex_count());
+	for (const auto& e : g.edges()) {
+	  for (const auto* v : {e.get_source(), e.get_dest()}) {
+	    if (v) {
+	      VertexLabel label = vertex_label_(*v);
+	      if (seen.insert(label.id).second) {
+		writer.vertex(label);
+	      }
+	    }
+	  }
+	}
+      }
+      writer.begin_edges();
+      for (const auto& e : g.edges()) {
+	VertexLabel source = {};
+	VertexLabel dest = {};
+	if (e.get_source()) {
+	  source = vertex_label_(*e.get_source());
+	}
+	if (e.get_dest()) {
+	  dest = vertex_label_(*e.get_dest());
+	}
+	const Value* value = nullptr;
+	if constexpr (has_edge_values_<G>()) {
+	  value = &e.value();
+	}
+	writer.edge(e.get_source() ? &source : nullptr, e.get_dest() ? &dest : nullptr, value);
+      }
+    }
+    writer.end();
+    return out.flush();
+  }
+
+  // g in format as one string.
+  template<typename G>
+  string graph_to_string(const G& g, GraphFormat format = GraphFormat::kText) {
+    string s;
+    GraphWriter out(&s);
+    write_graph(g, out, format);
+    return s;
+  }
+
+  void print(Graph<Vertex*, Edge*>& g) {
+    using G = std::decay_t<decltype(g)>;
+    GraphWriter out(std::cout);
+    if constexpr (std::is_same<G, CsrGraph>::value || requires { g.edges(); }) {
+      write_graph(g, out);
+    } else {
+      out.put(g.to_string());
+    }
+    out.put('\n');
+  }
+}